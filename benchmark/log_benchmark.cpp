@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "log/log.h"
+#include "log/log_file_sink.h"
+#include "log/log_latency_histogram.h"
+
+using namespace xl::log;
+
+using LogT = Log<DefaultLevels, DefaultSubjects>;
+
+
+static LogT & get_shared_log() {
+    static LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    return log;
+}
+
+
+// every thread logs to the same log object - throughput should scale with the thread count since logging
+//   doesn't take any locks
+static void log_shared_across_threads(benchmark::State & state) {
+    auto & log = get_shared_log();
+    for (auto _ : state) {
+        log.info("benchmark message");
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(log_shared_across_threads)->ThreadRange(1, 64)->UseRealTime();
+
+
+// same as above, but the messages are discarded because their level is disabled
+static void log_shared_across_threads_disabled(benchmark::State & state) {
+    static LogT & log = [] () -> LogT & {
+        static LogT log([](LogT::LogMessage const & message) {
+            benchmark::DoNotOptimize(message.string.data());
+        });
+        log.set_status(LogT::Levels::Info, false);
+        return log;
+    }();
+    for (auto _ : state) {
+        log.info("benchmark message");
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(log_shared_across_threads_disabled)->ThreadRange(1, 64)->UseRealTime();
+
+
+using MinimumWarnLogT = Log<LevelsWithMinimum<DefaultLevels, DefaultLevels::Levels::Warn>, DefaultSubjects>;
+
+
+// info is below the compile-time minimum level, so the call should compile to nothing
+static void log_level_compiled_out(benchmark::State & state) {
+    MinimumWarnLogT log([](MinimumWarnLogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    for (auto _ : state) {
+        log.info("benchmark message");
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(log_level_compiled_out);
+
+
+// info is compiled in but disabled at runtime - pays for the status lookups on every call
+static void log_level_disabled_at_runtime(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    log.set_status(LogT::Levels::Info, false);
+    for (auto _ : state) {
+        log.info("benchmark message");
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(log_level_disabled_at_runtime);
+
+
+// same, with a control block - adds one load of the block's generation counter
+static void log_level_disabled_with_control_block(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    log.enable_control_block("log_level_disabled_with_control_block.control", StatusFile::RESET_FILE_CONTENTS);
+    LogControlBlock controller("log_level_disabled_with_control_block.control");
+    controller.set_status(static_cast<size_t>(LogT::Levels::Info), false);
+    for (auto _ : state) {
+        log.info("benchmark message");
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(log_level_disabled_with_control_block);
+
+
+static std::string expensive_argument() {
+    return std::string(100, 'x');
+}
+
+
+// the XL_LOG macro skips evaluating the arguments of a compiled out level
+static void log_macro_compiled_out(benchmark::State & state) {
+    MinimumWarnLogT log([](MinimumWarnLogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    for (auto _ : state) {
+        XL_LOG(log, MinimumWarnLogT::Levels::Info, MinimumWarnLogT::Subjects::Default, expensive_argument());
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(log_macro_compiled_out);
+
+
+// calling info() directly still evaluates the arguments even though the message is thrown away
+static void log_function_disabled_at_runtime(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    log.set_status(LogT::Levels::Info, false);
+    for (auto _ : state) {
+        log.info(expensive_argument());
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(log_function_disabled_at_runtime);
+
+
+#ifdef XL_USE_LIB_FMT
+
+// time spent by the logging thread on a formatted message in async mode - the queue is drained outside of the
+//   timed region so the consumer thread never holds up the producer
+template<AsyncFormatting formatting>
+static void log_async_formatted(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    log.enable_async(8192, AsyncOverflowPolicy::BLOCK, formatting);
+    std::string name = "benchmark";
+    size_t count = 0;
+    for (auto _ : state) {
+        log.info("request {} from {} took {:.3f}ms ({} bytes)", count, name, 1.25, 4096);
+        if (++count % 4096 == 0) {
+            state.PauseTiming();
+            log.flush();
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(log_async_formatted, AsyncFormatting::IMMEDIATE);
+BENCHMARK_TEMPLATE(log_async_formatted, AsyncFormatting::DEFERRED);
+
+
+// the same values formatted into the message text versus attached as fields, which are kept as typed values and
+//   never formatted unless a callback asks for them
+static void log_values_formatted(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    int64_t count = 0;
+    for (auto _ : state) {
+        log.info("request done latency_us={} shard={} ratio={}", count++, 7, 0.25);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(log_values_formatted);
+
+
+static void log_values_as_fields(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.fields.begin());
+    });
+    int64_t count = 0;
+    for (auto _ : state) {
+        log.info("request done", kv("latency_us", count++), kv("shard", 7), kv("ratio", 0.25));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(log_values_as_fields);
+
+#endif
+
+
+// cost of sending one message to several callbacks - the message is built once and shared by all of them
+static void log_to_multiple_callbacks(benchmark::State & state) {
+    LogT log;
+    for (int i = 0; i < state.range(0); i++) {
+        log.add_callback([](LogT::LogMessage const & message) {
+            benchmark::DoNotOptimize(message.string.data());
+        });
+    }
+    std::string string = "a message long enough to not fit in a small string buffer";
+    for (auto _ : state) {
+        log.info(string);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(log_to_multiple_callbacks)->Arg(1)->Arg(4)->Arg(16);
+
+
+struct BenchmarkSink {
+    template<class MessageT>
+    void operator()(MessageT const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    }
+};
+
+template<size_t, class T>
+using Repeat = T;
+
+template<size_t... Indexes>
+auto make_log_with_sinks(std::index_sequence<Indexes...>) ->
+    Log<DefaultLevels, DefaultSubjects, std::chrono::system_clock, Repeat<Indexes, BenchmarkSink>...>;
+
+
+// same as log_to_multiple_callbacks, but with sinks given as template parameters instead of std::function callbacks
+template<size_t SinkCount>
+static void log_to_static_sinks(benchmark::State & state) {
+    decltype(make_log_with_sinks(std::make_index_sequence<SinkCount>())) log;
+    std::string string = "a message long enough to not fit in a small string buffer";
+    for (auto _ : state) {
+        log.info(string);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(log_to_static_sinks, 1);
+BENCHMARK_TEMPLATE(log_to_static_sinks, 4);
+BENCHMARK_TEMPLATE(log_to_static_sinks, 16);
+
+
+// every message does a formatted << to an ofstream
+static void log_to_ostream_file(benchmark::State & state) {
+    LogT log;
+    std::ofstream file("log_to_ostream_file.log", std::ios::trunc);
+    log.add_callback(file);
+    for (auto _ : state) {
+        log.info("benchmark message");
+    }
+    file.flush();
+    log.clear_callbacks();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(log_to_ostream_file);
+
+
+// messages are copied into buffers which a background thread writes in batches
+static void log_to_file_sink(benchmark::State & state) {
+    LogT log;
+    LogFileSink<LogT> sink("log_to_file_sink");
+    log.add_callback(std::ref(sink));
+    for (auto _ : state) {
+        log.info("benchmark message");
+    }
+    sink.flush();
+    log.clear_callbacks();
+    state.SetItemsProcessed(state.iterations());
+    state.counters["batch_bytes"] = static_cast<double>(sink.get_bytes_written()) / std::max<uint64_t>(sink.get_batch_count(), 1);
+    state.counters["write_p99_us"] = sink.get_write_latency().get_percentile(99).count() / 1000.0;
+}
+BENCHMARK(log_to_file_sink);
+
+
+static void timestamp_date_format(benchmark::State & state) {
+    auto time = std::chrono::system_clock::now();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(date::format("%H:%M:%S", time));
+        time += std::chrono::microseconds(10);
+    }
+}
+BENCHMARK(timestamp_date_format);
+
+
+static void timestamp_cached_formatter(benchmark::State & state) {
+    auto time = std::chrono::system_clock::now();
+    LogTimestampFormatter formatter(TimestampFormat::TIME_OF_DAY, TimestampPrecision::NANOSECONDS);
+    char buffer[LogTimestampFormatter::max_length];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(formatter.format(time, buffer, sizeof(buffer)));
+        benchmark::ClobberMemory();
+        time += std::chrono::microseconds(10);
+    }
+}
+BENCHMARK(timestamp_cached_formatter);
+
+
+static std::vector<std::string> make_filter_patterns(size_t count) {
+    std::vector<std::string> patterns;
+    for (size_t i = 0; i < count; i++) {
+        patterns.push_back("component" + std::to_string(i) + ": .*failed");
+    }
+    return patterns;
+}
+
+static char const * filter_messages[] = {
+    "component0: request 1234 failed after 3 retries",
+    "component7: request 1234 completed in 15ms",
+    "unrelated subsystem started with 16 worker threads and a 64MB cache",
+    "component3: connection to 10.0.0.1:8080 failed",
+};
+
+
+// how the filter worked before LogFilter - xl::Regex::match copies the message and allocates the capture buffer,
+//   and each pattern needs its own regex
+static void filter_with_regex_match(benchmark::State & state) {
+    std::vector<std::unique_ptr<xl::Regex>> regexes;
+    for (auto const & pattern : make_filter_patterns(state.range(0))) {
+        regexes.push_back(std::make_unique<xl::Regex>(pattern, xl::OPTIMIZE));
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        auto message = filter_messages[i++ % std::size(filter_messages)];
+        bool passed = false;
+        for (auto const & regex : regexes) {
+            if (regex->match(message)) {
+                passed = true;
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(passed);
+    }
+}
+BENCHMARK(filter_with_regex_match)->Arg(1)->Arg(4)->Arg(16);
+
+
+static void filter_with_log_filter(benchmark::State & state) {
+    LogFilter filter(make_filter_patterns(state.range(0)));
+    size_t i = 0;
+    for (auto _ : state) {
+        auto message = filter_messages[i++ % std::size(filter_messages)];
+        benchmark::DoNotOptimize(filter(message));
+    }
+}
+BENCHMARK(filter_with_log_filter)->Arg(1)->Arg(4)->Arg(16);
+
+
+
+// The latency_ benchmarks time each call on its own and report the p50/p99/p999 of those times in nanoseconds,
+//   since a regression in the tail doesn't always move the mean.  The two clock reads around each call add a
+//   roughly constant amount, which latency_timer_overhead shows.  With multiple threads, each percentile is the
+//   average of the threads' own percentiles.
+template<class F>
+static void measure_latency(benchmark::State & state, F && f) {
+    LogLatencyHistogram histogram;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        histogram.record(std::chrono::steady_clock::now() - start);
+    }
+    state.SetItemsProcessed(state.iterations());
+    for (auto [name, percentile] : {std::pair{"p50_ns", 50.0}, std::pair{"p99_ns", 99.0}, std::pair{"p999_ns", 99.9}}) {
+        state.counters[name] = benchmark::Counter(static_cast<double>(histogram.get_percentile(percentile).count()),
+                                                  benchmark::Counter::kAvgThreads);
+    }
+}
+
+
+static void latency_timer_overhead(benchmark::State & state) {
+    measure_latency(state, [] {
+        benchmark::ClobberMemory();
+    });
+}
+BENCHMARK(latency_timer_overhead);
+
+
+static void latency_disabled_level(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    log.set_status(LogT::Levels::Info, false);
+    measure_latency(state, [&log] {
+        log.info("benchmark message");
+    });
+}
+BENCHMARK(latency_disabled_level);
+
+
+static void latency_null_callback(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const &) {});
+    measure_latency(state, [&log] {
+        log.info("benchmark message");
+    });
+}
+BENCHMARK(latency_null_callback);
+
+
+// Arg(0): the filter drops every message, Arg(1): every message passes it
+static void latency_regex_filter(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    log.set_regex_filter("request \\d+ (failed|completed)");
+    auto message = state.range(0) ? "request 1234 completed in 15ms" : "unrelated subsystem started";
+    measure_latency(state, [&log, message] {
+        log.info(message);
+    });
+}
+BENCHMARK(latency_regex_filter)->Arg(0)->Arg(1);
+
+
+// the status file is checked by a background thread, so this should match latency_null_callback
+static void latency_with_status_file(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const &) {});
+    log.enable_status_file("latency_with_status_file.status", StatusFile::RESET_FILE_CONTENTS, std::chrono::milliseconds(1));
+    measure_latency(state, [&log] {
+        log.info("benchmark message");
+    });
+    log.disable_status_file();
+}
+BENCHMARK(latency_with_status_file);
+
+
+// what the background thread pays each time it checks the status file - check() only looks at the file once a
+//   second, reload_if_changed() stats it every time
+static void latency_status_file_check(benchmark::State & state) {
+    LogT log;
+    LogStatusFile status_file(log, "latency_status_file_check.status", StatusFile::RESET_FILE_CONTENTS);
+    measure_latency(state, [&status_file] {
+        benchmark::DoNotOptimize(status_file.check());
+    });
+}
+BENCHMARK(latency_status_file_check);
+
+
+static void latency_status_file_reload_if_changed(benchmark::State & state) {
+    LogT log;
+    LogStatusFile status_file(log, "latency_status_file_check.status", StatusFile::RESET_FILE_CONTENTS);
+    measure_latency(state, [&status_file] {
+        benchmark::DoNotOptimize(status_file.reload_if_changed());
+    });
+}
+BENCHMARK(latency_status_file_reload_if_changed);
+
+
+static void latency_shared_across_threads(benchmark::State & state) {
+    auto & log = get_shared_log();
+    measure_latency(state, [&log] {
+        log.info("benchmark message");
+    });
+}
+BENCHMARK(latency_shared_across_threads)->ThreadRange(1, 64)->UseRealTime();
+
+
+#ifdef XL_LOG_WITH_TEMPLATES
+
+// the template is only filled if the message will be sent to a callback - Arg(0): disabled, Arg(1): enabled
+static void latency_template(benchmark::State & state) {
+    LogT log([](LogT::LogMessage const & message) {
+        benchmark::DoNotOptimize(message.string.data());
+    });
+    log.set_status(LogT::Levels::Info, state.range(0) != 0);
+    xl::templates::Template tmpl("request {{id}} from {{name}} completed");
+    tmpl.compile();
+    std::map<std::string, std::string> values{{"id", "1234"}, {"name", "benchmark"}};
+    measure_latency(state, [&] {
+        log.info(LogT::Subjects::Default, tmpl, values);
+    });
+}
+BENCHMARK(latency_template)->Arg(0)->Arg(1);
+
+#endif
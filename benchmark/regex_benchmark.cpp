@@ -7,6 +7,8 @@
 #include <sstream>
 
 
+// must include json before regexer so PCRE is picked up
+#include "json.h"
 #include "regex/regexer.h"
 
 //using namespace xl;
@@ -88,3 +90,91 @@ static void xl_pcre_regex_replace(benchmark::State& state) {
 
 }
 BENCHMARK(xl_pcre_regex_replace);
+
+
+
+// JIT compiled vs interpreted (studied) PCRE
+
+// the same single regex LogFilter builds out of its include patterns
+static std::string make_log_filter_pattern(size_t count) {
+    std::string pattern;
+    for (size_t i = 0; i < count; i++) {
+        if (!pattern.empty()) {
+            pattern += '|';
+        }
+        pattern += "(?:component" + std::to_string(i) + ": .*failed)";
+    }
+    return pattern;
+}
+
+static char const * log_filter_messages[] = {
+    "component0: request 1234 failed after 3 retries",
+    "component7: request 1234 completed in 15ms",
+    "unrelated subsystem started with 16 worker threads and a 64MB cache",
+    "component3: connection to 10.0.0.1:8080 failed",
+};
+
+
+template<xl::RegexFlags flags>
+static void xl_pcre_log_filter_matches(benchmark::State& state) {
+    xl::RegexPcre regex(make_log_filter_pattern(state.range(0)), flags);
+    assert(regex.matches(log_filter_messages[0]));
+    assert(!regex.matches(log_filter_messages[1]));
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(regex.matches(log_filter_messages[i++ % std::size(log_filter_messages)]));
+    }
+}
+BENCHMARK_TEMPLATE(xl_pcre_log_filter_matches, xl::OPTIMIZE)->Arg(1)->Arg(4)->Arg(16);
+BENCHMARK_TEMPLATE(xl_pcre_log_filter_matches, xl::JIT)->Arg(1)->Arg(4)->Arg(16);
+
+
+template<xl::RegexFlags flags>
+static void xl_pcre_json_match(benchmark::State& state) {
+    xl::RegexPcre regex(xl::json::json_regex_pattern,
+                        flags | xl::EXTENDED | xl::DOTALL | xl::MULTILINE | xl::ALLOW_DUPLICATE_SUBPATTERN_NAMES);
+    std::string source(R"({"name": "bench", "values": [1, 2.5, -3e4, true, null], "nested": {"key": "a \"quoted\" string"}})");
+    assert(regex.match(source).has("object"));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(regex.match(source)["ObjectGuts"]);
+    }
+}
+BENCHMARK_TEMPLATE(xl_pcre_json_match, xl::OPTIMIZE);
+BENCHMARK_TEMPLATE(xl_pcre_json_match, xl::JIT);
+
+
+
+// match() copies the string and allocates the results, matching into a reused RegexMatchDataPcre does neither
+
+template<xl::RegexFlags flags>
+static void xl_pcre_match_allocating(benchmark::State& state) {
+    xl::RegexPcre regex("^([^.]*)\\.(.*)$", flags);
+    std::string source("This is a long string with a . in it");
+
+    // sanity check to make sure the match is happening and it is matching the right data
+    assert(regex.match(source)[1] == "This is a long string with a ");
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(regex.match(source)[0]);
+    }
+}
+BENCHMARK_TEMPLATE(xl_pcre_match_allocating, xl::NONE);
+BENCHMARK_TEMPLATE(xl_pcre_match_allocating, xl::JIT);
+
+
+template<xl::RegexFlags flags>
+static void xl_pcre_match_with_match_data(benchmark::State& state) {
+    xl::RegexPcre regex("^([^.]*)\\.(.*)$", flags);
+    std::string source("This is a long string with a . in it");
+    xl::RegexMatchDataPcre match_data;
+
+    assert(regex.match(source, match_data)[1] == "This is a long string with a ");
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(regex.match(source, match_data)[0]);
+    }
+}
+BENCHMARK_TEMPLATE(xl_pcre_match_with_match_data, xl::NONE);
+BENCHMARK_TEMPLATE(xl_pcre_match_with_match_data, xl::JIT);
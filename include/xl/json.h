@@ -15,7 +15,7 @@
 
 namespace xl::json {
 
-inline xl::RegexPcre json_regex(R"REGEX(
+inline char const * const json_regex_pattern = R"REGEX(
 \A
 (?(DEFINE)(?<StringContents>(?:\\"|[^"])*))
 (?(DEFINE)(?<comment>(\s*(
@@ -55,10 +55,12 @@ inline xl::RegexPcre json_regex(R"REGEX(
 \s*) # end any
 (?&comment)
 \Z
-)REGEX",  xl::OPTIMIZE | xl::EXTENDED | xl::DOTALL | xl::MULTILINE | ALLOW_DUPLICATE_SUBPATTERN_NAMES);
+)REGEX";
 
+inline xl::RegexPcre json_regex(json_regex_pattern, xl::JIT | xl::EXTENDED | xl::DOTALL | xl::MULTILINE | ALLOW_DUPLICATE_SUBPATTERN_NAMES);
 
-inline xl::RegexPcre escaped_character_regex("\\\\(.)", xl::OPTIMIZE | xl::EXTENDED | xl::DOTALL);
+
+inline xl::RegexPcre escaped_character_regex("\\\\(.)", xl::JIT | xl::EXTENDED | xl::DOTALL);
 
 class JsonException : public xl::FormattedException {
     using xl::FormattedException::FormattedException;
@@ -92,6 +94,8 @@ public:
     /**
      * Parses content as JSON, returning the regex match info
      * @throw JsonException if the json is invalid
+     * @throw xl::RegexException if PCRE gives up partway through matching, such as on reaching its match limit,
+     *   rather than deciding whether the json is valid
      * @return regex matches against content
      */
     xl::RegexResultPcre parse() const {
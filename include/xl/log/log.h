@@ -8,6 +8,11 @@
 #include <type_traits>
 #include <fstream>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+#include <bitset>
+#include <initializer_list>
+#include <tuple>
 
 
 #include "../library_extensions.h"
@@ -21,6 +26,36 @@
 #include "../date.h"
 
 #include "log_status_file.h"
+#include "log_status_file_watcher.h"
+#include "log_timer.h"
+#include "log_async.h"
+#include "log_context.h"
+#include "log_control_block.h"
+#include "log_fields.h"
+#include "log_subject_registry.h"
+#include "log_crash_handler.h"
+#include "log_rcu.h"
+#include "log_timestamp.h"
+#include "log_rate_limit.h"
+#include "log_filter.h"
+
+
+
+/**
+ * Logs a message without evaluating the arguments unless it will be sent to a callback.  If the level is below
+ *   the log's compile-time minimum level, the entire statement is removed.
+ * @param log_object the log object to send the message to
+ * @param level must be a constant expression
+ */
+#define XL_LOG(log_object, level, subject, ...) \
+    do { \
+        if constexpr(std::decay_t<decltype(log_object)>::is_compiled(level)) { \
+            if ((log_object).is_live((level), (subject))) { \
+                (log_object).log((level), (subject), __VA_ARGS__); \
+            } \
+        } \
+    } while(false)
+
 
 namespace xl::templates {
 class Template;
@@ -57,31 +92,47 @@ struct DefaultSubjects {
 };
 
 
-template<typename LevelsT, typename SubjectsT, typename Clock>
+template<typename LevelsT, typename SubjectsT, typename Clock, typename... Sinks>
 class CopyLogger {
     using Subjects = typename SubjectsT::Subjects;
     using Levels = typename LevelsT::Levels;
 
-    Log<LevelsT, SubjectsT, Clock> & log_object;
+    Log<LevelsT, SubjectsT, Clock, Sinks...> & log_object;
     Levels level;
     Subjects subject;
-    std::string message_prefix;
+
+    // attached to each message as context instead of being concatenated onto it
+    LogContext message_prefix;
+
+    template<typename F>
+    void with_prefix(F && f) {
+        if (this->message_prefix.value.empty()) {
+            f();
+        } else {
+            LogContextGuard guard(this->message_prefix);
+            f();
+        }
+    }
 
 public:
-    CopyLogger(Log<LevelsT, SubjectsT, Clock> & log_object, Levels level, Subjects subject, xl::string_view message_prefix = {}) :
-        log_object(log_object), level(level), subject(subject), message_prefix(message_prefix)
+    CopyLogger(Log<LevelsT, SubjectsT, Clock, Sinks...> & log_object, Levels level, Subjects subject, xl::string_view message_prefix = {}) :
+        log_object(log_object), level(level), subject(subject), message_prefix("", std::string(message_prefix))
     {}
 
 #ifdef XL_USE_LIB_FMT
     template <typename... Ts>
     CopyLogger & operator()(xl::zstring_view format_string, Ts&&... args) {
-        log_object.log(level, subject, fmt::format(format_string.c_str(), std::forward<Ts>(args)...));
+        this->with_prefix([&] {
+            log_object.log(level, subject, format_string, std::forward<Ts>(args)...);
+        });
         return *this;
     }
 #endif
 
     CopyLogger & operator()(xl::zstring_view log_message) {
-        log_object.log(level, subject, log_message);
+        this->with_prefix([&] {
+            log_object.log(level, subject, log_message);
+        });
         return *this;
     }
 };
@@ -93,8 +144,12 @@ public:
  * Objects of this type take messages to be logged and route them to the registered callback.
  * @tparam Levels must provide an enum named Levels and static std::string const & get_name(Levels)
  * @tparam Subjects must provide an enum named Subjects and static std::string const & get_name(Subjects)
+ * @tparam Sinks objects called with every message before the callbacks.  Held by value and known at compile time,
+ *   so calls to them can be inlined instead of going through std::function.  Like callbacks, they may be called
+ *   from several threads at once.
  */
-template<class LevelsT = log::DefaultLevels, class SubjectsT = log::DefaultSubjects, class Clock = std::chrono::system_clock>
+template<class LevelsT = log::DefaultLevels, class SubjectsT = log::DefaultSubjects, class Clock = std::chrono::system_clock,
+         class... Sinks>
 class Log {
 
     static_assert((size_t)LevelsT::Levels::LOG_LAST_LEVEL >= 0, "Levels enumeration must have LOG_LAST_LEVEL as its final entry");
@@ -114,324 +169,1489 @@ public:
     static constexpr SubjectsUnderlyingType subject_count = static_cast<SubjectsUnderlyingType>(Subjects::LOG_LAST_SUBJECT);
 
 
-    constexpr static auto get(Levels level) {
-        return static_cast<LevelsUnderlyingType>(level);
+    constexpr static auto get(Levels level) {
+        return static_cast<LevelsUnderlyingType>(level);
+    }
+
+    constexpr static auto get(Subjects subject) {
+        return static_cast<SubjectsUnderlyingType>(subject);
+    }
+
+
+    /**
+     * Whether messages at the given level are compiled in.  Levels below LevelsT::minimum_level are not
+     */
+    constexpr static bool is_compiled(Levels level) {
+        return LevelsBase::is_compiled(level);
+    }
+
+    auto to(Levels level, Subjects subject, xl::string_view message_prefix = "") {
+        return CopyLogger(*this, level, subject, message_prefix);
+    }
+
+    /**
+     * Representation of an individual message to be logged.  Includes level, subject, and the string.
+     * Built once per logged message and shared by every callback.  The string is a view of the caller's string,
+     *   so it is only valid for the duration of the callback - callbacks wanting to keep it must copy it.
+     */
+    struct LogMessage {
+        Levels level;
+        Subjects subject;
+        xl::zstring_view string;
+        typename Clock::time_point time;
+
+        // innermost LogContextGuard pair of the thread which logged the message, null if none - only valid for
+        //   the duration of the callback, like string
+        LogContext const * context;
+
+        // values passed with kv() - only valid for the duration of the callback, like string
+        LogFields fields;
+
+        // subject added with add_subject() the message was logged to, null if it was logged to subject directly -
+        //   when set, subject is its parent
+        LogDynamicSubject const * dynamic_subject;
+
+        LogMessage(Levels level, Subjects subject, xl::zstring_view string, typename Clock::time_point time = Clock::now(),
+                   LogContext const * context = LogContext::get_current(), LogFields fields = {},
+                   LogDynamicSubject const * dynamic_subject = nullptr) :
+            level(level),
+            subject(subject),
+            string(string),
+            time(time),
+            context(context),
+            fields(fields),
+            dynamic_subject(dynamic_subject)
+        {}
+
+
+        /**
+         * @return name of the dynamic subject if there is one, otherwise of subject
+         */
+        std::string const & get_subject_name() const {
+            return this->dynamic_subject != nullptr ? this->dynamic_subject->name : Log::get_name(this->subject);
+        }
+
+
+        /**
+         * @return the context as "key=value key=value ", or empty if there is none
+         */
+        std::string get_context_string() const {
+            std::string result(LogContext::get_length(this->context), ' ');
+            LogContext::write(this->context, result.data());
+            return result;
+        }
+
+        template<typename ClockCopy = Clock, std::enable_if_t<std::is_same_v<ClockCopy, std::chrono::system_clock>> * = nullptr>
+        std::string get_time_string() const {
+            char buffer[LogTimestampFormatter::max_length];
+            return std::string(buffer, this->get_time_string(buffer, sizeof(buffer)));
+        }
+
+
+        /**
+         * Writes the time as HH:MM:SS followed by as many fractional digits as the clock has, without allocating
+         * @return number of characters written
+         */
+        template<typename ClockCopy = Clock, std::enable_if_t<std::is_same_v<ClockCopy, std::chrono::system_clock>> * = nullptr>
+        size_t get_time_string(char * buffer, size_t buffer_size) const {
+            thread_local LogTimestampFormatter formatter(TimestampFormat::TIME_OF_DAY,
+                LogTimestampFormatter::precision_for<typename Clock::duration>());
+            return formatter.format(this->time, buffer, buffer_size);
+        }
+    };
+
+
+    using CallbackT = std::function<void(LogMessage const & message)>;
+
+    // if false, logs of this level/subject will be ignored
+    using StatusesT = std::bitset<level_count + subject_count>;
+
+
+    // guarded by writer_mutex, since the status file watcher thread reloads it - see write_status_file()
+    std::unique_ptr<LogStatusFile> log_status_file;
+
+
+    /**
+     * Only messages matching the regex are sent to the callbacks.  Replaces any filters already set.
+     * @param regex_string regex to match messages against - empty removes the filter
+     */
+    void set_regex_filter(xl::zstring_view regex_string) {
+        if (regex_string.empty()) {
+            this->set_filters({});
+        } else {
+            this->set_filters({std::string(regex_string.c_str())});
+        }
+    }
+
+
+    /**
+     * Only messages matching at least one include pattern (if there are any) and none of the exclude patterns are
+     *   sent to the callbacks.  Replaces any filters already set.
+     * @param include_patterns regexes of which a message must match at least one
+     * @param exclude_patterns regexes of which a message must match none
+     * @throw xl::RegexException if any of the patterns is invalid
+     */
+    void set_filters(std::vector<std::string> include_patterns, std::vector<std::string> exclude_patterns = {}) {
+        std::shared_ptr<LogFilter const> filter;
+        if (!include_patterns.empty() || !exclude_patterns.empty()) {
+            filter = std::make_shared<LogFilter const>(std::move(include_patterns), std::move(exclude_patterns));
+        }
+        this->update([&](Snapshot & next) {
+            next.filter = filter;
+            if (this->log_status_file) {
+                this->log_status_file->include_filters = filter ? filter->get_include_patterns() : std::vector<std::string>{};
+                this->log_status_file->exclude_filters = filter ? filter->get_exclude_patterns() : std::vector<std::string>{};
+            }
+        });
+    }
+
+private:
+
+    /**
+     * Everything needed to decide whether and where to send a message.  Never changed once published - writers
+     *   publish a modified copy instead, so threads which are logging never wait on threads changing settings.
+     */
+    struct Snapshot {
+        StatusesT statuses;
+
+        struct CallbackEntry {
+            // shared_ptr so a callback stays alive as long as any snapshot which may still call it
+            std::shared_ptr<CallbackT> callback;
+
+            // levels and subjects this callback is sent - a message must also pass the log's own statuses
+            StatusesT statuses;
+
+            // statuses of named callbacks are saved in the status file
+            std::string name;
+        };
+        std::vector<CallbackEntry> callbacks;
+
+        // union of the statuses of every callback (and any sinks) with the log's own statuses, for each
+        //   combination of level and subject - indexed by get_level_subject_index()
+        std::bitset<level_count * subject_count> live;
+
+        // if set, only show log messages passing this filter
+        std::shared_ptr<LogFilter const> filter;
+
+        // if set, messages are queued and sent to the callbacks from another thread
+        LogAsyncDispatcher<Log> * async_dispatcher = nullptr;
+
+        // indexed by get_level_subject_index() - empty if no rate limits have been set
+        std::vector<LogRateLimit> rate_limits;
+
+        // if set, statuses and filters are shared with other processes through this block
+        std::shared_ptr<LogControlBlock> control_block;
+
+        // generation of the control block that statuses and filter were last brought up to date with
+        uint64_t control_block_generation = 0;
+
+        // woken to bring statuses and filter up to date when the generation changes - set whenever control_block is
+        LogTimer * control_block_refresher = nullptr;
+    };
+
+    RcuPointer<Snapshot> snapshot;
+
+    // serializes threads changing settings - never taken while logging
+    std::mutex writer_mutex;
+
+    // subjects added with add_subject() - declared before the async dispatcher, whose queued messages point at them
+    LogSubjectRegistry dynamic_subjects;
+
+    // subjects added with add_subject() which have a status in the control block, with their position in it, and
+    //   whether statuses the block already had for them when they were added are used - guarded by writer_mutex
+    std::vector<std::pair<LogDynamicSubject const *, size_t>> control_block_dynamic_subjects;
+    bool control_block_dynamic_statuses_used = false;
+
+    // owns the object snapshots point to - made the first time a control block is enabled and kept until the log
+    //   is destroyed, so no snapshot can outlive it
+    std::unique_ptr<LogTimer> control_block_refresher;
+
+    // owns the object snapshots point to
+    std::unique_ptr<LogAsyncDispatcher<Log>> async_dispatcher;
+    friend class LogAsyncDispatcher<Log>;
+
+    std::atomic<bool> status_file_enabled{false};
+
+    // while any StatusFileBatch exists, status file writes wait for the last one to end - guarded by writer_mutex
+    size_t status_file_batch_depth = 0;
+    bool status_file_write_pending = false;
+
+    // checks the status file for changes made by other processes
+    std::unique_ptr<LogStatusFileWatcher> status_file_watcher;
+
+    // told when a change to the status file can't be loaded - guarded by writer_mutex
+    std::function<void(std::string const & error)> status_file_error_callback;
+
+    // how much of its rate limit each level/subject combination has used, indexed by get_level_subject_index()
+    std::unique_ptr<LogRateLimitState[]> rate_limit_states;
+
+    // sends summaries of suppressed messages which no message let through has sent yet, started when the first
+    //   rate limit is set - guarded by writer_mutex
+    std::chrono::milliseconds rate_limit_summary_interval{1000};
+    std::unique_ptr<LogTimer> rate_limit_summary_timer;
+
+    std::tuple<Sinks...> sinks;
+
+    // where crash_drain() writes queued messages - -1 when not registered with LogCrashHandler
+    std::atomic<int> crash_drain_file_descriptor{-1};
+    size_t crash_drain_id = 0;
+
+
+    // runs inside a crash signal handler, so only async-signal-safe code may be called from here
+    static void crash_drain(void * context) {
+        auto & log = *static_cast<Log *>(context);
+        auto file_descriptor = log.crash_drain_file_descriptor.load();
+        auto snapshot = log.snapshot.read();
+        if (file_descriptor != -1 && snapshot->async_dispatcher) {
+            snapshot->async_dispatcher->crash_drain(file_descriptor);
+        }
+    }
+
+
+    static size_t get_level_subject_index(Levels level, Subjects subject) {
+        return get(level) * subject_count + get(subject);
+    }
+
+
+    /**
+     * Publishes a modified copy of the current snapshot
+     * @param modify called with the copy to be published
+     * @param write_status_file whether the status file (if any) should be rewritten to match the new snapshot
+     */
+    template<class ModifyT>
+    void update(ModifyT && modify, bool write_status_file = true) {
+        std::unique_lock<std::mutex> lock(this->writer_mutex);
+        this->update_locked(lock, std::forward<ModifyT>(modify), write_status_file);
+    }
+
+
+    template<class ModifyT>
+    void update_locked(std::unique_lock<std::mutex> & lock, ModifyT && modify, bool write_status_file) {
+        auto next = std::make_unique<Snapshot>(*this->snapshot.get_for_writer());
+
+        // changes made by other processes are picked up first so writing this change back doesn't undo them
+        if (next->control_block) {
+            this->read_control_block(*next);
+        }
+        modify(*next);
+        if (next->control_block) {
+            std::vector<std::pair<size_t, bool>> dynamic_statuses;
+            for (auto const & [subject, index] : this->control_block_dynamic_subjects) {
+                dynamic_statuses.emplace_back(index, this->dynamic_subjects.get_status(*subject));
+            }
+            next->control_block_generation = next->control_block->write(next->control_block_generation, next->statuses,
+                next->filter ? next->filter->get_include_patterns() : std::vector<std::string>{},
+                next->filter ? next->filter->get_exclude_patterns() : std::vector<std::string>{},
+                dynamic_statuses);
+        }
+        update_live(*next);
+        if (!next->rate_limits.empty() && !this->rate_limit_summary_timer && this->rate_limit_summary_interval.count() > 0) {
+            this->rate_limit_summary_timer = std::make_unique<LogTimer>(this->rate_limit_summary_interval, [this]{
+                this->send_suppressed_summaries();
+            });
+        }
+        if (this->log_status_file) {
+            this->log_status_file->control_block = next->control_block ? next->control_block->get_path() : std::string();
+        }
+        auto previous = this->snapshot.exchange(std::move(next));
+        if (write_status_file && this->log_status_file) {
+            if (this->status_file_batch_depth > 0) {
+                this->status_file_write_pending = true;
+            } else {
+                this->log_status_file->write(*this);
+            }
+        }
+
+        // waiting for readers to be done with the previous snapshot happens without holding the lock, otherwise
+        //   a callback changing a setting would deadlock
+        lock.unlock();
+        this->snapshot.retire(std::move(previous));
+    }
+
+
+    /**
+     * Copies the statuses and filters from the control block into next if another process has changed them.  An
+     *   invalid filter pattern leaves the current filter in place.
+     */
+    void read_control_block(Snapshot & next, bool force = false) {
+        auto & control_block = *next.control_block;
+        auto generation = control_block.get_generation();
+        if (generation == next.control_block_generation && !force) {
+            return;
+        }
+
+        next.statuses = control_block.template get_statuses<StatusesT>();
+        for (auto const & [subject, index] : this->control_block_dynamic_subjects) {
+            this->dynamic_subjects.set_status(*subject, control_block.get_status(control_block.get_dynamic_subject_status_index(index)));
+        }
+        std::vector<std::string> include_patterns, exclude_patterns;
+        if (!control_block.get_filters(include_patterns, exclude_patterns)) {
+            // the patterns are still being written - keep the current filter and leave the generation alone so
+            //   they're read again, putting the current ones back if their writer died partway through
+            control_block.recover_filters(next.filter ? next.filter->get_include_patterns() : std::vector<std::string>{},
+                                          next.filter ? next.filter->get_exclude_patterns() : std::vector<std::string>{});
+            return;
+        }
+        if (!next.filter || include_patterns != next.filter->get_include_patterns() ||
+            exclude_patterns != next.filter->get_exclude_patterns()) {
+            try {
+                next.filter = include_patterns.empty() && exclude_patterns.empty() ? nullptr :
+                    std::make_shared<LogFilter const>(std::move(include_patterns), std::move(exclude_patterns));
+            } catch (xl::RegexException const &) {}
+            if (this->log_status_file) {
+                this->log_status_file->include_filters = next.filter ? next.filter->get_include_patterns() : std::vector<std::string>{};
+                this->log_status_file->exclude_filters = next.filter ? next.filter->get_exclude_patterns() : std::vector<std::string>{};
+            }
+        }
+        next.control_block_generation = generation;
+    }
+
+
+    /**
+     * Gives a subject added with add_subject() a status in the control block, unless the block is full.  If the
+     *   block already has one for its name, that status is used when control_block_dynamic_statuses_used is set.
+     */
+    void add_to_control_block(LogControlBlock & control_block, LogDynamicSubject const & subject) {
+        if (auto index = control_block.find_dynamic_subject(subject.name)) {
+            if (this->control_block_dynamic_statuses_used) {
+                this->dynamic_subjects.set_status(subject, control_block.get_status(control_block.get_dynamic_subject_status_index(*index)));
+            }
+            this->control_block_dynamic_subjects.emplace_back(&subject, *index);
+        } else if (auto index = control_block.add_dynamic_subject(subject.name, this->dynamic_subjects.get_status(subject))) {
+            this->control_block_dynamic_subjects.emplace_back(&subject, *index);
+        }
+    }
+
+
+    /**
+     * Enters a read section for logging a message.  If another process changed the control block, the refresher
+     *   thread is woken to publish a new snapshot, so reading the block and compiling filters never happens on a
+     *   thread which is logging.  Without a control block, or when it hasn't changed, this is the same as
+     *   snapshot.read() plus one load of the generation.
+     */
+    typename RcuPointer<Snapshot>::ReadGuard read_snapshot() {
+        auto snapshot = this->snapshot.read();
+        if (snapshot->control_block != nullptr &&
+            snapshot->control_block->get_generation() != snapshot->control_block_generation) {
+            snapshot->control_block_refresher->wake();
+        }
+        return snapshot;
+    }
+
+
+    void dispatch_async_message(LogMessage const & message) {
+        this->call_sinks_and_callbacks(*this->snapshot.read(), message);
+    }
+
+
+    void call_sinks_and_callbacks(Snapshot const & snapshot, LogMessage const & message) {
+        std::apply([&](Sinks & ... sinks) {
+            (sinks(message), ...);
+        }, this->sinks);
+        for (auto & entry : snapshot.callbacks) {
+            if (entry.statuses[get(message.level)] && entry.statuses[level_count + get(message.subject)]) {
+                (*entry.callback)(message);
+            }
+        }
+    }
+
+
+    /**
+     * Recomputes which level and subject combinations are sent anywhere after the statuses or callbacks change
+     */
+    static void update_live(Snapshot & snapshot) {
+        for (auto level : levels()) {
+            for (auto subject : subjects()) {
+                bool live = false;
+                if (snapshot.statuses[get(level)] && snapshot.statuses[level_count + get(subject)]) {
+                    live = sizeof...(Sinks) > 0;
+                    for (auto const & entry : snapshot.callbacks) {
+                        live = live || (entry.statuses[get(level)] && entry.statuses[level_count + get(subject)]);
+                    }
+                }
+                snapshot.live[get_level_subject_index(level, subject)] = live;
+            }
+        }
+    }
+
+
+    static typename Snapshot::CallbackEntry & find_callback(Snapshot & snapshot, CallbackT const & callback) {
+        for (auto & entry : snapshot.callbacks) {
+            if (entry.callback.get() == &callback) {
+                return entry;
+            }
+        }
+        throw LogException("callback is not registered with this log");
+    }
+
+
+    /**
+     * Sets the statuses of a named callback to what the status file has saved for that name, if anything
+     */
+    void load_callback_statuses(typename Snapshot::CallbackEntry & entry) const {
+        if (!this->log_status_file || entry.name.empty()) {
+            return;
+        }
+        for (auto const & callback_statuses : this->log_status_file->callbacks) {
+            if (callback_statuses.name != entry.name) {
+                continue;
+            }
+            for(std::make_unsigned_t<LevelsUnderlyingType> i = 0; i < level_count && i < callback_statuses.levels.size(); i++) {
+                entry.statuses[i] = callback_statuses.levels[i].second;
+            }
+            for(std::make_unsigned_t<SubjectsUnderlyingType> i = 0; i < subject_count && i < callback_statuses.subjects.size(); i++) {
+                entry.statuses[level_count + i] = callback_statuses.subjects[i].second;
+            }
+        }
+    }
+
+
+    /**
+     * @return status the status file has saved for a subject added with add_subject(), if any.  Those are saved
+     *   after the subjects in the enum.
+     */
+    std::optional<bool> get_saved_status(LogDynamicSubject const & subject) const {
+        if (auto all_subjects = std::get_if<bool>(&this->log_status_file->subjects)) {
+            return *all_subjects;
+        }
+        auto & subjects = std::get<LogStatusFile::Statuses>(this->log_status_file->subjects);
+        for (size_t i = subject_count; i < subjects.size(); i++) {
+            if (subjects[i].first == subject.name) {
+                return subjects[i].second;
+            }
+        }
+        return {};
+    }
+
+
+    /**
+     * Sets the statuses and filter in the snapshot to be published, and the statuses of subjects added with
+     *   add_subject(), from the contents of the status file
+     */
+    void load_status_file(Snapshot & next) {
+        auto & status_file = *this->log_status_file;
+
+        next.filter = status_file.include_filters.empty() && status_file.exclude_filters.empty() ?
+                      nullptr : std::make_shared<LogFilter const>(status_file.include_filters, status_file.exclude_filters);
+
+        if (auto all_levels = std::get_if<bool>(&status_file.levels)) {
+            for(std::make_unsigned_t<LevelsUnderlyingType> i = 0; i < level_count; i++) {
+                next.statuses[i] = *all_levels;
+            }
+        } else {
+            auto & levels = std::get<LogStatusFile::Statuses>(status_file.levels);
+            for(std::make_unsigned_t<LevelsUnderlyingType> i = 0; i < level_count && i < levels.size(); i++) {
+                next.statuses[i] = levels[i].second;
+            }
+        }
+
+        if (auto all_subjects = std::get_if<bool>(&status_file.subjects)) {
+            for(std::make_unsigned_t<SubjectsUnderlyingType> i = 0; i < subject_count; i++) {
+                next.statuses[level_count + i] = *all_subjects;
+            }
+        } else {
+            auto & subjects = std::get<LogStatusFile::Statuses>(status_file.subjects);
+            for(std::make_unsigned_t<SubjectsUnderlyingType> i = 0; i < subject_count && i < subjects.size(); i++) {
+                next.statuses[level_count + i] = subjects[i].second;
+            }
+        }
+
+        this->dynamic_subjects.for_each([this](LogDynamicSubject const & subject) {
+            if (auto status = this->get_saved_status(subject)) {
+                this->dynamic_subjects.set_status(subject, *status);
+            }
+        });
+
+        for (auto & entry : next.callbacks) {
+            this->load_callback_statuses(entry);
+        }
+
+        next.rate_limits.clear();
+        for (auto const & rate_limit : status_file.rate_limits) {
+            for (auto level : levels()) {
+                for (auto subject : subjects()) {
+                    if ((rate_limit.level.empty() || rate_limit.level == get_name(level)) &&
+                        (rate_limit.subject.empty() || rate_limit.subject == get_name(subject))) {
+                        next.rate_limits.resize(level_count * subject_count);
+                        next.rate_limits[get_level_subject_index(level, subject)] = rate_limit.limit;
+                    }
+                }
+            }
+        }
+    }
+
+
+    /**
+     * Picks up changes made to the status file by another process.  Called from the status file watcher thread.
+     */
+    void reload_status_file() {
+        std::unique_lock<std::mutex> lock(this->writer_mutex);
+        try {
+            if (this->log_status_file && this->log_status_file->reload_if_changed()) {
+                this->update_locked(lock, [this](Snapshot & next) {
+                    this->load_status_file(next);
+                }, false);
+            }
+        } catch (std::exception const & e) {
+            // another process wrote a file which can't be used - the current settings stay in place until it's
+            //   written again
+            auto callback = this->status_file_error_callback;
+            if (lock.owns_lock()) {
+                lock.unlock();
+            }
+            if (callback) {
+                callback(e.what());
+            }
+        }
+    }
+
+
+    static bool is_live(Snapshot const & snapshot, Levels level, Subjects subject) {
+        return snapshot.live[get_level_subject_index(level, subject)];
+    }
+
+
+    /**
+     * Applies the rate limit and sampling for the level and subject, if any.  Called after is_live() and before
+     *   the message string is built.  Before the first message let through after some were suppressed, a summary
+     *   of how many were suppressed is sent to the callbacks.
+     * @return whether the message should be sent to the callbacks
+     */
+    bool admit(Snapshot const & snapshot, Levels level, Subjects subject) {
+        if (snapshot.rate_limits.empty()) {
+            return true;
+        }
+        auto index = get_level_subject_index(level, subject);
+        auto & limit = snapshot.rate_limits[index];
+        if (!limit.is_limited()) {
+            return true;
+        }
+
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        auto & state = this->rate_limit_states[index];
+        if (!state.admit(limit, now)) {
+            return false;
+        }
+        this->send_suppressed_summary(snapshot, level, subject);
+        return true;
+    }
+
+
+    void send_suppressed_summary(Snapshot const & snapshot, Levels level, Subjects subject) {
+        if (auto suppressed = this->rate_limit_states[get_level_subject_index(level, subject)].take_suppressed_count()) {
+            this->dispatch(snapshot, level, subject, std::to_string(suppressed) + " messages suppressed by rate limit");
+        }
+    }
+
+
+    // sends the summary for every level and subject which has had messages suppressed since its last one
+    void send_suppressed_summaries() {
+        auto snapshot = this->snapshot.read();
+        if (snapshot->rate_limits.empty()) {
+            return;
+        }
+        for (auto level : levels()) {
+            for (auto subject : subjects()) {
+                if (is_live(*snapshot, level, subject)) {
+                    this->send_suppressed_summary(*snapshot, level, subject);
+                }
+            }
+        }
+    }
+
+
+    // sends a message which has passed is_live() and admit() on to the filter and callbacks
+    void log_admitted(Snapshot const & snapshot, Levels level, Subjects subject, xl::zstring_view const & string,
+                      LogFields fields = {}, LogDynamicSubject const * dynamic_subject = nullptr) {
+        // if there's a filter, discard the message if it doesn't match
+        if (snapshot.filter && !(*snapshot.filter)(string)) {
+            return;
+        }
+        this->dispatch(snapshot, level, subject, string, fields, dynamic_subject);
+    }
+
+
+    // the level and subject statuses have already been checked against this snapshot, which can't change
+    void dispatch(Snapshot const & snapshot, Levels level, Subjects subject, xl::zstring_view const & string,
+                  LogFields fields = {}, LogDynamicSubject const * dynamic_subject = nullptr) {
+        if (snapshot.control_block) {
+            snapshot.control_block->count_message();
+        }
+        if (snapshot.async_dispatcher) {
+            snapshot.async_dispatcher->push(level, subject, string, Clock::now(), fields, dynamic_subject);
+            return;
+        }
+
+        this->call_sinks_and_callbacks(snapshot, LogMessage(level, subject, string, Clock::now(), LogContext::get_current(),
+                                                            fields, dynamic_subject));
+    }
+
+
+    static std::unique_ptr<Snapshot const> make_initial_snapshot() {
+        auto snapshot = std::make_unique<Snapshot>();
+        snapshot->statuses.set();
+        update_live(*snapshot);
+        return snapshot;
+    }
+
+
+public:
+
+
+    static auto subjects() {
+        return LogSubjectsBase<SubjectsT>();
+    }
+
+
+    static auto levels() {
+        return log::LogLevelsBase<LevelsT>();
+    }
+
+
+    std::string get_status_string() const {
+        std::stringstream status;
+
+        for(size_t i = 0; i < get(Levels::LOG_LAST_LEVEL); i++) {
+            auto level = (Levels)i;
+            status << LevelsT::get_name(level) << ": " << (bool)get_status(level);
+        }
+        for(size_t i = 0; i < get(Subjects::LOG_LAST_SUBJECT); i++) {
+            auto subject = (Subjects)i;
+            status << SubjectsT::get_name(subject) << ": " << (bool)get_status(subject);
+        }
+        return status.str();
+    }
+
+
+    bool get_status(Levels level) const {
+        return this->snapshot.read()->statuses[get(level)];
+    }
+
+
+    bool set_status(Levels level, bool new_status) {
+        bool previous_status;
+        this->update([&](Snapshot & next) {
+            previous_status = next.statuses[get(level)];
+            next.statuses[get(level)] = new_status;
+        });
+        return previous_status;
+    }
+
+
+    void set_all_subjects(bool new_status) {
+        this->update([&](Snapshot & next) {
+            for(size_t i = 0; i < get(Subjects::LOG_LAST_SUBJECT); i++) {
+                next.statuses[get(Levels::LOG_LAST_LEVEL) + i] = new_status;
+            }
+        });
+    }
+
+    bool get_status(Subjects subject) const {
+        return this->snapshot.read()->statuses[get(Levels::LOG_LAST_LEVEL) + get(subject)];
+    }
+
+    void set_all_levels(bool new_status) {
+        this->update([&](Snapshot & next) {
+            for(size_t i = 0; i < get(Levels::LOG_LAST_LEVEL); i++) {
+                next.statuses[i] = new_status;
+            }
+        });
+    }
+
+
+    /**
+     * Holds back status file writes for as long as it exists, then writes the file once if anything changed.
+     *   Changes still take effect for logging immediately.  Batches may be nested.
+     */
+    class StatusFileBatch {
+        Log & log;
+
+    public:
+        explicit StatusFileBatch(Log & log) :
+            log(log)
+        {
+            std::lock_guard<std::mutex> lock(this->log.writer_mutex);
+            this->log.status_file_batch_depth++;
+        }
+
+        StatusFileBatch(StatusFileBatch const &) = delete;
+        StatusFileBatch & operator=(StatusFileBatch const &) = delete;
+
+        ~StatusFileBatch() {
+            std::lock_guard<std::mutex> lock(this->log.writer_mutex);
+            if (--this->log.status_file_batch_depth == 0 && this->log.status_file_write_pending) {
+                this->log.status_file_write_pending = false;
+                if (this->log.log_status_file) {
+                    this->log.log_status_file->write(this->log);
+                }
+            }
+        }
+    };
+
+
+    /**
+     * Coalesces the status file writes of every change made while the returned batch exists into one:
+     *
+     *   {
+     *       auto batch = log.batch_status_file_writes();
+     *       for (auto subject : subjects_to_disable) {
+     *           log.set_status(subject, false);
+     *       }
+     *   } // status file written here
+     */
+    StatusFileBatch batch_status_file_writes() {
+        return StatusFileBatch(*this);
+    }
+
+
+    bool set_status(Subjects subject, bool new_status) {
+        bool previous_status;
+        this->update([&](Snapshot & next) {
+            previous_status = next.statuses[get(Levels::LOG_LAST_LEVEL) + get(subject)];
+            next.statuses[get(Levels::LOG_LAST_LEVEL) + get(subject)] = new_status;
+        });
+        return previous_status;
+    }
+    
+
+    Log() :
+        snapshot(make_initial_snapshot()),
+        rate_limit_states(std::make_unique<LogRateLimitState[]>(level_count * subject_count))
+    {}
+
+
+    Log(std::string filename, StatusFile status_file_flag = StatusFile::USE_FILE_CONTENTS) : Log() {
+        this->enable_status_file(filename, status_file_flag);
+    }
+
+
+    Log(CallbackT log_callback) : Log()
+    {
+        this->add_callback(std::move(log_callback));
+    }
+
+
+    /**
+     * For sinks which can't be default constructed
+     */
+    explicit Log(std::tuple<Sinks...> sinks) :
+        snapshot(make_initial_snapshot()),
+        rate_limit_states(std::make_unique<LogRateLimitState[]>(level_count * subject_count)),
+        sinks(std::move(sinks))
+    {}
+
+
+    ~Log() {
+        // stops the rate limit summary timer
+        this->set_rate_limit_summary_interval(std::chrono::milliseconds(0));
+        this->disable_crash_drain();
+        this->disable_status_file();
+        this->disable_async();
+
+        // last, since callbacks of messages still queued above may log and wake it
+        this->control_block_refresher.reset();
+    }
+
+
+    template<size_t Index>
+    auto & get_sink() {
+        return std::get<Index>(this->sinks);
+    }
+
+
+    template<class SinkT>
+    SinkT & get_sink() {
+        return std::get<SinkT>(this->sinks);
+    }
+
+
+    void clear_callbacks() {
+        this->update([](Snapshot & next) {
+            next.callbacks.clear();
+        }, false);
+    }
+
+
+    /**
+     * @param callback called with each message which passes the log's statuses and the callback's own statuses
+     * @param name if not empty, the callback's statuses are saved in the status file under this name and
+     *   restored from it
+     * @param statuses which levels and subjects are sent to this callback - by default, all of them
+     */
+    CallbackT & add_callback(CallbackT callback, std::string name = "", StatusesT statuses = StatusesT().set()) {
+        auto new_callback = std::make_shared<CallbackT>(std::move(callback));
+        bool named = !name.empty();
+        this->update([&](Snapshot & next) {
+            next.callbacks.push_back({new_callback, statuses, std::move(name)});
+            this->load_callback_statuses(next.callbacks.back());
+        }, named);
+        return *new_callback;
+    }
+
+
+    CallbackT & add_callback(std::ostream & ostream, std::string prefix = "") {
+        return this->add_callback([&ostream, prefix, this](LogMessage const & message) {
+            char time_string[LogTimestampFormatter::max_length];
+            ostream << "[";
+            ostream.write(time_string, message.get_time_string(time_string, sizeof(time_string)));
+            ostream << "] " << message.get_subject_name() << " ";
+            LogContext::write(message.context, ostream);
+            ostream << prefix << message.string;
+            if (!message.fields.empty()) {
+                std::string fields;
+                message.fields.append_text(fields);
+                ostream << fields;
+            }
+            ostream << "\n";
+        });
+    }
+
+
+    /**
+     * Writes each message to the stream as a line of JSON:
+     *   {"time":"HH:MM:SS","level":"info","subject":"default","message":"...","context":{...},"fields":{...}}
+     *   context and fields are only present if the message has any.
+     */
+    CallbackT & add_json_callback(std::ostream & ostream) {
+        return this->add_callback([&ostream, this](LogMessage const & message) {
+            std::string line = "{\"time\":";
+            LogField::append_json_string(line, message.get_time_string());
+            line += ",\"level\":";
+            LogField::append_json_string(line, this->get_name(message.level));
+            line += ",\"subject\":";
+            LogField::append_json_string(line, message.get_subject_name());
+            line += ",\"message\":";
+            LogField::append_json_string(line, message.string);
+            if (message.context != nullptr) {
+                line += ",\"context\":{";
+                bool first = true;
+                LogContext::for_each(message.context, [&line, &first](LogContext const & pair) {
+                    if (!first) {
+                        line += ',';
+                    }
+                    first = false;
+                    LogField::append_json_string(line, pair.key);
+                    line += ':';
+                    LogField::append_json_string(line, pair.value);
+                });
+                line += '}';
+            }
+            if (!message.fields.empty()) {
+                line += ",\"fields\":";
+                message.fields.append_json(line);
+            }
+            line += "}\n";
+            ostream << line;
+        });
+    }
+
+
+    /**
+     * If the callback was passed in as a reference wrapper, this can find any corresponding entries and remove them.
+     * Once this returns, the callback is no longer running on any thread and won't be called again - unless this is
+     *   called from inside a callback, in which case callbacks already running on other threads may still finish.
+     * @param t pass in the object to find (not as a reference wrapper)
+     */
+    void remove_callback(CallbackT & callback) {
+        this->update([&callback](Snapshot & next) {
+            auto i = next.callbacks.begin();
+            while(i != next.callbacks.end()) {
+                if (i->callback.get() == &callback) {
+                    i = next.callbacks.erase(i);
+                } else {
+                    i++;
+                }
+            }
+        }, false);
+    }
+
+
+    /**
+     * Gives a callback a name, so its statuses are saved in the status file and loaded from it if the status
+     *   file already has statuses for that name
+     * @throw LogException if the callback isn't registered with this log
+     */
+    void set_callback_name(CallbackT const & callback, std::string name) {
+        this->update([&](Snapshot & next) {
+            auto & entry = find_callback(next, callback);
+            entry.name = std::move(name);
+            this->load_callback_statuses(entry);
+        });
+    }
+
+
+    StatusesT get_callback_statuses(CallbackT const & callback) const {
+        auto snapshot = this->snapshot.read();
+        for (auto const & entry : snapshot->callbacks) {
+            if (entry.callback.get() == &callback) {
+                return entry.statuses;
+            }
+        }
+        throw LogException("callback is not registered with this log");
+    }
+
+
+    /**
+     * Sets which levels and subjects are sent to the specified callback
+     * @throw LogException if the callback isn't registered with this log
+     */
+    void set_callback_statuses(CallbackT const & callback, StatusesT statuses) {
+        this->update([&](Snapshot & next) {
+            find_callback(next, callback).statuses = statuses;
+        });
+    }
+
+
+    bool set_callback_status(CallbackT const & callback, Levels level, bool new_status) {
+        bool previous_status;
+        this->update([&](Snapshot & next) {
+            auto & statuses = find_callback(next, callback).statuses;
+            previous_status = statuses[get(level)];
+            statuses[get(level)] = new_status;
+        });
+        return previous_status;
+    }
+
+
+    bool set_callback_status(CallbackT const & callback, Subjects subject, bool new_status) {
+        bool previous_status;
+        this->update([&](Snapshot & next) {
+            auto & statuses = find_callback(next, callback).statuses;
+            previous_status = statuses[level_count + get(subject)];
+            statuses[level_count + get(subject)] = new_status;
+        });
+        return previous_status;
+    }
+
+
+    /**
+     * Statuses of every callback which has a name, for saving in the status file
+     */
+    std::vector<std::pair<std::string, StatusesT>> get_named_callback_statuses() const {
+        std::vector<std::pair<std::string, StatusesT>> result;
+        auto snapshot = this->snapshot.read();
+        for (auto const & entry : snapshot->callbacks) {
+            if (!entry.name.empty()) {
+                result.emplace_back(entry.name, entry.statuses);
+            }
+        }
+        return result;
+    }
+
+    
+
+    /**
+     * Causes a status file with the given name to be maintained with the current
+     *   settings of this log object
+     * @param filename filename to use as status file
+     * @param skip_reset don't read from the file if it already exists
+     * @param check_interval how often a background thread checks the file for changes made by other processes
+     *   where the file can't be watched - otherwise changes are seen as soon as they're written
+     */
+    void enable_status_file(std::string filename, StatusFile status_file_flag = StatusFile::USE_FILE_CONTENTS,
+                            std::chrono::milliseconds check_interval = 1000ms) {
+        this->disable_status_file();
+
+        std::unique_lock<std::mutex> lock(this->writer_mutex);
+        this->log_status_file = std::make_unique<LogStatusFile>(*this, filename, status_file_flag);
+        this->status_file_enabled = true;
+        this->status_file_watcher = std::make_unique<LogStatusFileWatcher>(filename, check_interval, [this]{
+            this->reload_status_file();
+        });
+
+        // if the log status file was in the "bulk" mode of "subjects: false, levels: false",
+        //   writing it back out will expand it into the enumerated save with each subject and level status
+        //   spelled out explicitly in the file
+        this->update_locked(lock, [this](Snapshot & next) {
+            this->load_status_file(next);
+        }, true);
     }
 
-    constexpr static auto get(Subjects subject) {
-        return static_cast<SubjectsUnderlyingType>(subject);
-    }
 
-    auto to(Levels level, Subjects subject, xl::string_view message_prefix = "") {
-        return CopyLogger(*this, level, subject, message_prefix);
+    /**
+     * Sends messages to the callbacks from a dedicated thread instead of the thread calling log().  Messages are
+     *   copied into a preallocated queue, so a slow callback no longer stalls the threads doing the logging.
+     * Callbacks are always called from the same thread, in the order the messages were logged.
+     * @param capacity how many messages may be waiting for the callbacks before overflow_policy applies
+     * @param overflow_policy what to do when a message is logged while the queue is full
+     * @param formatting whether messages logged with a format string and arguments are formatted before being
+     *   queued or by the consumer thread.  With DEFERRED, format strings must outlive the log object.
+     */
+    void enable_async(size_t capacity = 8192, AsyncOverflowPolicy overflow_policy = AsyncOverflowPolicy::BLOCK,
+                      AsyncFormatting formatting = AsyncFormatting::IMMEDIATE) {
+        // anything queued with previous settings is delivered before messages logged with the new ones
+        this->disable_async();
+
+        auto dispatcher = std::make_unique<LogAsyncDispatcher<Log>>(*this, capacity, overflow_policy, formatting);
+        this->update([&](Snapshot & next) {
+            next.async_dispatcher = dispatcher.get();
+            this->async_dispatcher = std::move(dispatcher);
+        }, false);
     }
 
+
     /**
-     * Representation of an individual message to be logged.  Includes level, subject, and the string.
-     * Also includes a reference to the log object so
+     * Delivers any queued messages and goes back to calling callbacks on the logging thread.  Must not be called
+     *   from inside a callback.
      */
-    struct LogMessage {
-        Levels level;
-        Subjects subject;
-        std::string string;
-        typename Clock::time_point time = Clock::now();
+    void disable_async() {
+        std::unique_ptr<LogAsyncDispatcher<Log>> previous_dispatcher;
+        this->update([&](Snapshot & next) {
+            next.async_dispatcher = nullptr;
+            previous_dispatcher = std::move(this->async_dispatcher);
+        }, false);
+
+        // no thread can still be pushing to it, so destroying it here drains whatever is left in its queue
+    }
 
-        LogMessage(Levels level, Subjects subject, std::string string) :
-            level(level),
-            subject(subject),
-            string(std::move(string))
-        {}
 
-        template<typename ClockCopy = Clock, std::enable_if_t<std::is_same_v<ClockCopy, std::chrono::system_clock>> * = nullptr>
-        std::string get_time_string() const {
-            return date::format("%H:%M:%S", this->time);
+    /**
+     * Installs LogCrashHandler and has it write any messages still waiting in the async queue to file_descriptor
+     *   if the process crashes.  Messages already given to the callbacks are up to them - LogFileSink drains
+     *   its own buffers.
+     * @param file_descriptor must stay open for as long as this is enabled
+     */
+    void enable_crash_drain(int file_descriptor = STDERR_FILENO) {
+        std::lock_guard<std::mutex> lock(this->writer_mutex);
+        LogCrashHandler::install();
+        if (this->crash_drain_file_descriptor.exchange(file_descriptor) == -1) {
+            this->crash_drain_id = LogCrashHandler::add_drain(&Log::crash_drain, this);
         }
-    };
+    }
 
 
-    using CallbackT = std::function<void(LogMessage const & message)>;
+    /**
+     * Stops writing queued messages on a crash - the signal handler stays installed for anything else using it
+     */
+    void disable_crash_drain() {
+        std::lock_guard<std::mutex> lock(this->writer_mutex);
+        if (this->crash_drain_file_descriptor.exchange(-1) != -1) {
+            LogCrashHandler::remove_drain(this->crash_drain_id);
+        }
+    }
 
-    // if false, logs of this level/subject will be ignored
-    std::bitset<level_count + subject_count> statuses;
 
+    bool is_async() const {
+        return this->snapshot.read()->async_dispatcher != nullptr;
+    }
 
-    std::unique_ptr<LogStatusFile> log_status_file;
 
- void set_regex_filter(xl::zstring_view regex_string) {
-        if (regex_string.empty()) {
-            this->filter_regex = xl::Regex();
-            this->filter_string = "";
-        } else {
-            this->filter_regex = xl::Regex(regex_string);
-            this->filter_string = regex_string;
-        }
-        if (this->log_status_file) {
-            this->log_status_file->regex_filter = regex_string;
+    /**
+     * Blocks until every message logged before this call has been sent to the callbacks.  Does nothing if
+     *   async mode isn't enabled, since callbacks have already been called by the time log() returns.
+     */
+    void flush() {
+        this->send_suppressed_summaries();
+        auto snapshot = this->snapshot.read();
+        if (snapshot->async_dispatcher) {
+            snapshot->async_dispatcher->flush();
         }
     }
 
-private:
-    // unique_ptr so the callback objects themselves don't move if the vector resizes
-    std::vector<std::unique_ptr<CallbackT>> callbacks;
-
-    void initialize_from_status_file() {
-        if (!this->log_status_file) {
-            return;
-        }
 
-        // disable updating status file as we update the object FROM the log file
-        auto temp = std::move(this->log_status_file);
+    /**
+     * Limits how many messages with the given level and subject are sent to the callbacks.  Messages over the
+     *   limit are counted and a summary of how many were suppressed is sent before the next message let through,
+     *   on flush(), or after the rate limit summary interval, whichever comes first.
+     * @param rate_limit new limit - a default constructed LogRateLimit removes the limit
+     */
+    void set_rate_limit(Levels level, Subjects subject, LogRateLimit rate_limit) {
+        this->update([&](Snapshot & next) {
+            next.rate_limits.resize(level_count * subject_count);
+            next.rate_limits[get_level_subject_index(level, subject)] = rate_limit;
+        });
+    }
 
-        this->set_regex_filter(temp->regex_filter);
 
-        if (auto all_levels = std::get_if<bool>(&temp->levels)) {
-            this->set_all_levels(*all_levels);
-        } else {
-            for(std::make_unsigned_t<LevelsUnderlyingType> i = 0; i < level_count; i++) {
-                if (i < std::get<LogStatusFile::Statuses>(temp->levels).size()) {
-                    typename LevelsT::Levels level = static_cast<Levels>(i);
-                    this->set_status(level, std::get<LogStatusFile::Statuses>(temp->levels)[i].second);
-                }
+    /**
+     * Sets how often summaries of suppressed messages are sent from a background thread when no message has been
+     *   let through to send them - 1 second unless changed
+     * @param interval time between checks - 0 only sends summaries before the next message let through and on
+     *   flush()
+     */
+    void set_rate_limit_summary_interval(std::chrono::milliseconds interval) {
+        std::unique_ptr<LogTimer> previous_timer;
+        {
+            std::lock_guard<std::mutex> lock(this->writer_mutex);
+            this->rate_limit_summary_interval = interval;
+            previous_timer = std::move(this->rate_limit_summary_timer);
+            if (interval.count() > 0 && !this->snapshot.get_for_writer()->rate_limits.empty()) {
+                this->rate_limit_summary_timer = std::make_unique<LogTimer>(interval, [this]{
+                    this->send_suppressed_summaries();
+                });
             }
         }
+        // stopped without holding the lock, since a callback it's sending a summary to may be waiting on it - and
+        //   if this is that callback, the timer leaves its thread to finish on its own
+    }
 
-        if (auto all_subjects = std::get_if<bool>(&temp->subjects)) {
-            this->set_all_subjects(*all_subjects);
-        } else {
-            for(std::make_unsigned_t<SubjectsUnderlyingType> i = 0; i < subject_count; i++) {
-                if (i < std::get<LogStatusFile::Statuses>(temp->subjects).size()) {
-                    typename SubjectsT::Subjects subject = static_cast<Subjects>(i);
-                    this->set_status(subject, std::get<LogStatusFile::Statuses>(temp->subjects)[i].second);
-                }
-            }
-        }
+
+    LogRateLimit get_rate_limit(Levels level, Subjects subject) const {
+        auto snapshot = this->snapshot.read();
+        return snapshot->rate_limits.empty() ? LogRateLimit{} : snapshot->rate_limits[get_level_subject_index(level, subject)];
+    }
 
 
-        // re-enable status file
-        this->log_status_file = std::move(temp);
+    /**
+     * Total number of messages with the given level and subject which were suppressed by rate limiting or sampling
+     */
+    uint64_t get_suppressed_count(Levels level, Subjects subject) const {
+        return this->rate_limit_states[get_level_subject_index(level, subject)].get_suppressed_total();
     }
 
-    // if set, only show log messages matching this regex
-    xl::Regex filter_regex;
-    std::string filter_string;
+
+    /**
+     * Number of messages discarded because the async queue was full
+     */
+    size_t get_dropped_count() const {
+        auto snapshot = this->snapshot.read();
+        return snapshot->async_dispatcher ? snapshot->async_dispatcher->get_dropped_count() : 0;
+    }
 
 
-public:
+    /**
+     * Writes the status file from the log's current settings, such as after it was removed or changed by hand.
+     *   Waits for the end of any status file batch, like every other write.  Use this instead of writing
+     *   log_status_file directly, since the status file watcher thread uses it too.
+     */
+    void write_status_file() {
+        std::lock_guard<std::mutex> lock(this->writer_mutex);
+        if (!this->log_status_file) {
+            return;
+        }
+        if (this->status_file_batch_depth > 0) {
+            this->status_file_write_pending = true;
+        } else {
+            this->log_status_file->write(*this);
+        }
+    }
 
 
-    static auto subjects() {
-        return LogSubjectsBase<SubjectsT>();
+    /**
+     * Sets what's called when the status file is changed by another process but can't be loaded, because it
+     *   isn't valid JSON or has an invalid entry or filter.  The log keeps the settings it had.  Called from the
+     *   status file watcher thread.
+     * @param callback given a description of what's wrong with the file - empty to ignore errors
+     */
+    void set_status_file_error_callback(std::function<void(std::string const & error)> callback) {
+        std::lock_guard<std::mutex> lock(this->writer_mutex);
+        this->status_file_error_callback = std::move(callback);
     }
 
 
-    static auto levels() {
-        return log::LogLevelsBase<LevelsT>();
+    void disable_status_file() {
+        std::unique_ptr<LogStatusFileWatcher> watcher;
+        {
+            std::lock_guard<std::mutex> lock(this->writer_mutex);
+            this->status_file_enabled = false;
+            this->log_status_file.reset();
+            watcher = std::move(this->status_file_watcher);
+        }
+        // stopped without holding the lock, since the watcher thread may be waiting on it
     }
 
 
-    std::string get_status_string() const {
-        std::stringstream status;
+    bool is_status_file_enabled() const {
+        return this->status_file_enabled.load();
+    }
 
-        for(size_t i = 0; i < get(Levels::LOG_LAST_LEVEL); i++) {
-            auto level = (Levels)i;
-            status << LevelsT::get_name(level) << ": " << (bool)get_status(level);
+
+    /**
+     * Shares the level and subject statuses and the filters through a memory-mapped control block at path (such as
+     *   a file under /dev/shm), so another process can change them through a LogControlBlock without going through
+     *   the status file.  Logging a message compares the block's generation counter with the one last seen and
+     *   wakes a background thread to pick up any change, so messages logged right after a change may still use
+     *   the previous settings - refresh_control_block() picks it up right away.
+     * @param path file holding the block - created if it doesn't exist, and left in place when disabled
+     * @param status_file_flag with USE_FILE_CONTENTS, a block already made for the same levels and subjects keeps
+     *   its statuses and filters and the log takes them - otherwise the block takes the log's
+     * @throw LogControlBlockException if the block can't be created
+     */
+    void enable_control_block(std::string path, StatusFile status_file_flag = StatusFile::USE_FILE_CONTENTS) {
+        static_assert(level_count + subject_count <= LogControlBlock::max_status_bits,
+                      "too many levels and subjects for a log control block");
+        std::vector<std::string> level_names, subject_names;
+        for (auto level : levels()) {
+            level_names.push_back(get_name(level));
         }
-        for(size_t i = 0; i < get(Subjects::LOG_LAST_SUBJECT); i++) {
-            auto subject = (Subjects)i;
-            status << SubjectsT::get_name(subject) << ": " << (bool)get_status(subject);
+        for (auto subject : subjects()) {
+            subject_names.push_back(get_name(subject));
         }
-        return status.str();
+
+        auto control_block = std::make_shared<LogControlBlock>(std::move(path), level_names, subject_names);
+        this->update([&](Snapshot & next) {
+            if (!this->control_block_refresher) {
+                this->control_block_refresher = std::make_unique<LogTimer>(std::chrono::milliseconds(0), [this]{
+                    this->refresh_control_block();
+                });
+            }
+            next.control_block = control_block;
+            next.control_block_refresher = this->control_block_refresher.get();
+            this->control_block_dynamic_statuses_used =
+                status_file_flag == StatusFile::USE_FILE_CONTENTS && control_block->is_existing_contents_used();
+            this->control_block_dynamic_subjects.clear();
+            this->dynamic_subjects.for_each([&](LogDynamicSubject const & subject) {
+                this->add_to_control_block(*control_block, subject);
+            });
+            if (this->control_block_dynamic_statuses_used) {
+                this->read_control_block(next, true);
+            } else {
+                next.control_block_generation = control_block->get_generation();
+            }
+        });
     }
 
 
-    bool get_status(Levels level) const {
-        return this->statuses[get(level)];
+    void disable_control_block() {
+        // rewrites the status file so it no longer points to the block
+        this->update([this](Snapshot & next) {
+            next.control_block.reset();
+            next.control_block_refresher = nullptr;
+            this->control_block_dynamic_subjects.clear();
+        });
     }
 
 
-    bool set_status(Levels level, bool new_status) {
-        bool previous_status;
-        previous_status = get_status(level);
-
-        statuses[get(level)] = new_status;
-        if (this->log_status_file) {
-            this->log_status_file->write(*this);
+    /**
+     * Brings the statuses and filters up to date with changes another process made to the control block.  Done on
+     *   a background thread after a message is logged, this picks them up without waiting for it.
+     */
+    void refresh_control_block() {
+        std::unique_lock<std::mutex> lock(this->writer_mutex);
+        auto current = this->snapshot.get_for_writer();
+        if (current->control_block && current->control_block->get_generation() != current->control_block_generation) {
+            this->update_locked(lock, [](Snapshot &) {}, false);
         }
-        return previous_status;
     }
 
 
-    void set_all_subjects(bool new_status) {
-        for(size_t i = 0; i < get(Subjects::LOG_LAST_SUBJECT); i++) {
-            set_status(static_cast<Subjects>(i), new_status);
-        }
+    bool is_control_block_enabled() const {
+        return this->snapshot.read()->control_block != nullptr;
     }
 
-    bool get_status(Subjects subject) const {
-        return statuses[get(Levels::LOG_LAST_LEVEL) + get(subject)];
-    }
 
-    void set_all_levels(bool new_status) {
-        for(size_t i = 0; i < get(Levels::LOG_LAST_LEVEL); i++) {
-            set_status((Levels)i, new_status);
+    void log(Levels level, Subjects subject, xl::zstring_view const & string) {
+        // constant folded away when level is known at compile time
+        if (!is_compiled(level)) {
+            return;
+        }
+
+        auto snapshot = this->read_snapshot();
+        if (!is_live(*snapshot, level, subject) || !this->admit(*snapshot, level, subject)) {
+            return;
         }
+        this->log_admitted(*snapshot, level, subject, string);
     }
 
 
-    bool set_status(Subjects subject, bool new_status) {
-        bool previous_status = get_status(subject);
-        statuses[get(Levels::LOG_LAST_LEVEL) + get(subject)] = new_status;
-        if (this->log_status_file) {
-            this->log_status_file->write(*this);
+    /**
+     * Logs a message with typed values attached, which callbacks see in LogMessage::fields.  With libfmt, the
+     *   fields can also be passed directly:  log.info(subject, "message", kv("key", value), ...)
+     */
+    void log(Levels level, Subjects subject, xl::zstring_view const & string, std::initializer_list<LogField> fields) {
+        if (!is_compiled(level)) {
+            return;
         }
-        return previous_status;
-    }
-    
 
-    Log() :
-        statuses(0xffffffffffffffff)
-    {
-        // in case there are more statuses than a bitfield constructor will initialize
-        //   then set them here
-        if constexpr(level_count + subject_count > sizeof(long long) * 8) {
-            this->statuses.set(); // sets all bits to 1
+        auto snapshot = this->read_snapshot();
+        if (!is_live(*snapshot, level, subject) || !this->admit(*snapshot, level, subject)) {
+            return;
         }
+        this->log_admitted(*snapshot, level, subject, string, LogFields(fields.begin(), fields.size()));
     }
 
 
-    Log(std::string filename, StatusFile status_file_flag = StatusFile::USE_FILE_CONTENTS) : Log() {
-        this->enable_status_file(filename, status_file_flag);
+    /**
+     * Adds a subject while the program is running, for code which can't add to the Subjects enum, such as plugins.
+     *   Messages logged to it go through the statuses, callback statuses and rate limits of parent, and are also
+     *   dropped while its own status is off.  Subjects in the enum don't pay anything for this.
+     * @param name name callbacks see for the subject - adding the same name again returns the existing subject
+     * @param parent subject in the enum the new subject is logged under.  Ignored if name already exists.
+     * @return the subject, valid for as long as the log is.  New subjects start out with the status saved for
+     *   their name in the status file or control block, or enabled if there isn't one.
+     */
+    LogDynamicSubject const & add_subject(std::string_view name, Subjects parent = Subjects{}) {
+        if (auto existing = this->dynamic_subjects.find(name)) {
+            return *existing;
+        }
+
+        std::unique_lock<std::mutex> lock(this->writer_mutex);
+        auto count = this->dynamic_subjects.size();
+        auto & subject = this->dynamic_subjects.add(name, get(parent));
+        if (this->dynamic_subjects.size() == count ||
+            (!this->log_status_file && !this->snapshot.get_for_writer()->control_block)) {
+            return subject;
+        }
+        this->update_locked(lock, [&](Snapshot & next) {
+            if (this->log_status_file) {
+                if (auto status = this->get_saved_status(subject)) {
+                    this->dynamic_subjects.set_status(subject, *status);
+                }
+            }
+            if (next.control_block) {
+                this->add_to_control_block(*next.control_block, subject);
+            }
+        }, true);
+        return subject;
     }
 
 
-    Log(CallbackT log_callback) : Log()
-    {
-        this->add_callback(std::move(log_callback));
+    /**
+     * @return the subject added with add_subject() with the given name, or null if there isn't one
+     */
+    LogDynamicSubject const * find_subject(std::string_view name) const {
+        return this->dynamic_subjects.find(name);
     }
 
 
-    void clear_callbacks() {
-        this->callbacks.clear();
+    /**
+     * @return number of subjects added with add_subject()
+     */
+    size_t get_dynamic_subject_count() const {
+        return this->dynamic_subjects.size();
     }
 
 
-    CallbackT & add_callback(CallbackT callback) {
-        this->callbacks.push_back(std::make_unique<CallbackT>(callback));
-        return *this->callbacks.back();
+    /**
+     * Calls callback(LogDynamicSubject const &) on each subject added with add_subject(), in the order they were
+     *   added.  Subjects can't be added from inside the callback.
+     */
+    template<class CallbackT>
+    void for_each_dynamic_subject(CallbackT && callback) const {
+        this->dynamic_subjects.for_each(std::forward<CallbackT>(callback));
     }
 
 
-    CallbackT & add_callback(std::ostream & ostream, std::string prefix = "") {
-        return this->add_callback([&ostream, prefix, this](LogMessage const & message) {
-            ostream << "[" << message.get_time_string() << "] " << this->get_name(message.subject) << " " << prefix << message.string << "\n";
-        });
+    bool get_status(LogDynamicSubject const & subject) const {
+        return this->dynamic_subjects.get_status(subject);
     }
 
 
     /**
-     * If the callback was passed in as a reference wrapper, this can find any corresponding entries and remove them
-     * @param t pass in the object to find (not as a reference wrapper)
+     * Changes the status of a subject added with add_subject() and saves it in the status file and control
+     *   block, if there are any
+     * @return the previous status
      */
-    void remove_callback(CallbackT & callback) {
-
-        auto i = this->callbacks.begin();
-        while(i != this->callbacks.end()) {
-            CallbackT & c = **i;
-            if (&c == &callback) {
-                i = this->callbacks.erase(i);
-            } else {
-                i++;
-            }
+    bool set_status(LogDynamicSubject const & subject, bool new_status) {
+        std::unique_lock<std::mutex> lock(this->writer_mutex);
+        if (!this->log_status_file && !this->snapshot.get_for_writer()->control_block) {
+            return this->dynamic_subjects.set_status(subject, new_status);
         }
+
+        // changed after the control block is read, so a change another process made to it first doesn't undo this
+        bool previous_status = false;
+        this->update_locked(lock, [&](Snapshot &) {
+            previous_status = this->dynamic_subjects.set_status(subject, new_status);
+        }, true);
+        return previous_status;
     }
 
-    
 
-    /**
-     * Causes a status file with the given name to be maintained with the current
-     *   settings of this log object
-     * @param filename filename to use as status file
-     * @param skip_reset don't read from the file if it already exists
-     */
-    void enable_status_file(std::string filename, StatusFile status_file_flag = StatusFile::USE_FILE_CONTENTS) {
-        this->log_status_file = std::make_unique<LogStatusFile>(*this, filename, status_file_flag);
-        initialize_from_status_file();
-        
-        // if the log status file was in the "bulk" mode of "subjects: false, levels: false",
-        //   this will expand it into the enumerated save with each subject and level status
-        //   spelled out explicitly in the file
-        this->log_status_file->initialize_from_log(*this);
-        this->log_status_file->write();
+    bool is_live(Levels level, LogDynamicSubject const & subject) const {
+        return is_live(level, static_cast<Subjects>(subject.parent)) && this->dynamic_subjects.get_status(subject);
     }
 
 
-    void disable_status_file() {
-        this->log_status_file.release();
-    }
+    /**
+     * Logs to a subject added with add_subject().  args may be kv() fields or, with libfmt, format arguments.
+     */
+    template<class... Ts>
+    void log(Levels level, LogDynamicSubject const & subject, xl::zstring_view const & string, Ts && ... args) {
+        if (!is_compiled(level)) {
+            return;
+        }
 
+        auto parent = static_cast<Subjects>(subject.parent);
+        auto snapshot = this->read_snapshot();
+        if (!is_live(*snapshot, level, parent) || !this->dynamic_subjects.get_status(subject) ||
+            !this->admit(*snapshot, level, parent)) {
+            return;
+        }
 
-    bool is_status_file_enabled() const {
-        return (bool)this->log_status_file;
+        if constexpr(sizeof...(Ts) == 0) {
+            this->log_admitted(*snapshot, level, parent, string, {}, &subject);
+        } else if constexpr((std::is_same_v<std::decay_t<Ts>, LogField> && ...)) {
+            LogField const fields[] = {args...};
+            this->log_admitted(*snapshot, level, parent, string, LogFields(fields, sizeof...(Ts)), &subject);
+        } else {
+#ifdef XL_USE_LIB_FMT
+            this->log_admitted(*snapshot, level, parent, fmt::format(string.c_str(), std::forward<Ts>(args)...), {}, &subject);
+#else
+            static_assert(sizeof...(Ts) == 0, "format arguments require XL_USE_LIB_FMT");
+#endif
+        }
     }
 
 
-    void log(Levels level, Subjects subject, xl::zstring_view const & string) {
-        if (this->log_status_file) {
-            if (this->log_status_file->check()) {
-                this->initialize_from_status_file();
-            }
+    template<class... Ts, class T = Levels, std::enable_if_t<(int)T::Info >= 0, int> = 0>
+    void info(LogDynamicSubject const & subject, xl::zstring_view const & string, Ts && ... args) {
+        if constexpr(is_compiled(Levels::Info)) {
+            log(Levels::Info, subject, string, std::forward<Ts>(args)...);
         }
+    }
 
-        if (!is_live(level, subject)) {
-            return;
-        }
 
-        // if there's a filter, discard the message if it doesn't match
-        if (this->filter_regex && !this->filter_regex.match(string)) {
-            return;
+    template<class... Ts, class T = Levels, std::enable_if_t<(int)T::Warn >= 0, int> = 0>
+    void warn(LogDynamicSubject const & subject, xl::zstring_view const & string, Ts && ... args) {
+        if constexpr(is_compiled(Levels::Warn)) {
+            log(Levels::Warn, subject, string, std::forward<Ts>(args)...);
         }
+    }
 
-        for (auto & callback : this->callbacks) {
-            if (this->get_status(level) &&
-                this->get_status(subject)) {
-                (*callback)(LogMessage(level, subject, string));
-            }
+
+    template<class... Ts, class T = Levels, std::enable_if_t<(int)T::Error >= 0, int> = 0>
+    void error(LogDynamicSubject const & subject, xl::zstring_view const & string, Ts && ... args) {
+        if constexpr(is_compiled(Levels::Error)) {
+            log(Levels::Error, subject, string, std::forward<Ts>(args)...);
         }
     }
     
 
     template<class T = Levels, std::enable_if_t<(int)T::Info >= 0, int> = 0>
     void info(Subjects subject, xl::zstring_view message) {
-        log(Levels::Info, subject, message);
+        if constexpr(is_compiled(Levels::Info)) {
+            log(Levels::Info, subject, message);
+        }
     }
     
 
     template<class L = Levels, class S = Subjects,
              std::enable_if_t<(int)L::Info >= 0 && (int)S::Default >= 0, int> = 0>
     void info(xl::zstring_view message) {
-        log(Levels::Info, Subjects::Default, message);
+        if constexpr(is_compiled(Levels::Info)) {
+            log(Levels::Info, Subjects::Default, message);
+        }
     }
 
 
     template<class T = Levels, std::enable_if_t<(int)T::Warn >= 0, int> = 0>
     void warn(Subjects subject, xl::zstring_view message) {
-        log(Levels::Warn, subject, message);
+        if constexpr(is_compiled(Levels::Warn)) {
+            log(Levels::Warn, subject, message);
+        }
     }
 
     template<class T = Levels, class S = Subjects, std::enable_if_t<(int)T::Warn >= 0 && (int)S::Default >= 0, int> = 0>
     void warn(xl::zstring_view message) {
-        log(Levels::Warn, Subjects::Default, message);
+        if constexpr(is_compiled(Levels::Warn)) {
+            log(Levels::Warn, Subjects::Default, message);
+        }
     }
 
 
     template<class T = Levels, std::enable_if_t<(int)T::Error >= 0, int> = 0>
     void error(Subjects subject, xl::zstring_view message) {
-        log(Levels::Error, subject, message);
+        if constexpr(is_compiled(Levels::Error)) {
+            log(Levels::Error, subject, message);
+        }
     }
 
     template<class T = Levels, class S = Subjects, std::enable_if_t<(int)T::Error >= 0 && (int)S::Default >= 0, int> = 0>
     void error(xl::zstring_view message) {
-        log(Levels::Error, Subjects::Default, message);
+        if constexpr(is_compiled(Levels::Error)) {
+            log(Levels::Error, Subjects::Default, message);
+        }
     }
 
     
@@ -445,21 +1665,20 @@ public:
     }
 
     
-    auto get_statuses() const {
-        return this->statuses;
+    StatusesT get_statuses() const {
+        return this->snapshot.read()->statuses;
     }
 
     
-    void set_statuses(decltype(Log::statuses) statuses) {
-        this->statuses = std::move(statuses);
-        if (this->log_status_file) {
-            this->log_status_file->write();
-        }
+    void set_statuses(StatusesT statuses) {
+        this->update([&statuses](Snapshot & next) {
+            next.statuses = std::move(statuses);
+        });
     }
     
 
-    bool is_live(Levels level, Subjects subject) {
-        return !this->callbacks.empty() && this->get_status(level) && this->get_status(subject);
+    bool is_live(Levels level, Subjects subject) const {
+        return is_live(*this->snapshot.read(), level, subject);
     }
 
 
@@ -467,8 +1686,30 @@ public:
 
     template<class... Ts>
     void log(Levels level, Subjects subject, xl::zstring_view const & format_string, Ts && ... args) {
-        if (this->is_live(level, subject)) { // don't build the string if it wont be used
-            log(level, subject, fmt::format(format_string.c_str(), std::forward<Ts>(args)...));
+        // a message followed only by kv() fields isn't a format string
+        if constexpr(sizeof...(Ts) > 0 && (std::is_same_v<std::decay_t<Ts>, LogField> && ...)) {
+            this->log(level, subject, format_string, {args...});
+        } else {
+            if (!is_compiled(level)) {
+                return;
+            }
+            auto snapshot = this->read_snapshot();
+            if (!is_live(*snapshot, level, subject) || !this->admit(*snapshot, level, subject)) { // don't build the string if it wont be used
+                return;
+            }
+
+            if constexpr(LogDeferredFormat::fits<Ts...>) {
+                // a filter needs the formatted string to decide whether the message is queued at all
+                auto dispatcher = snapshot->async_dispatcher;
+                if (dispatcher != nullptr && dispatcher->get_formatting() == AsyncFormatting::DEFERRED && !snapshot->filter) {
+                    if (snapshot->control_block) {
+                        snapshot->control_block->count_message();
+                    }
+                    dispatcher->push_deferred(level, subject, Clock::now(), format_string.c_str(), std::forward<Ts>(args)...);
+                    return;
+                }
+            }
+            this->log_admitted(*snapshot, level, subject, fmt::format(format_string.c_str(), std::forward<Ts>(args)...));
         }
     }
     
@@ -476,34 +1717,46 @@ public:
     template<class L = Levels, class... Ts,
         std::enable_if_t<(int)L::Info >= 0, int> = 0>
     void info(Subjects subject, xl::zstring_view format_string, Ts&&... args) {
-        log(Levels::Info, subject, format_string, std::forward<Ts>(args)...);
+        if constexpr(is_compiled(Levels::Info)) {
+            log(Levels::Info, subject, format_string, std::forward<Ts>(args)...);
+        }
     }
 
     template<class... Ts, class T = Levels, class S = Subjects, std::enable_if_t<(int)T::Info >= 0 && (int)S::Default >= 0, int> = 0>
     void info(xl::zstring_view const & format_string, Ts && ... args) {
-        log(Levels::Info, Subjects::Default, format_string, std::forward<Ts>(args)...);
+        if constexpr(is_compiled(Levels::Info)) {
+            log(Levels::Info, Subjects::Default, format_string, std::forward<Ts>(args)...);
+        }
     }
 
 
     template<class... Ts, class T = Levels, std::enable_if_t<(int)T::Warn >= 0, int> = 0>
     void warn(Subjects subject, xl::zstring_view const & format_string, Ts && ... args) {
-        log(Levels::Warn, subject, format_string, std::forward<Ts>(args)...);
+        if constexpr(is_compiled(Levels::Warn)) {
+            log(Levels::Warn, subject, format_string, std::forward<Ts>(args)...);
+        }
     }
 
     template<class... Ts, class T = Levels, class S = Subjects, std::enable_if_t<(int)T::Warn >= 0 && (int)S::Default >= 0, int> = 0>
     void warn(xl::zstring_view const & format_string, Ts && ... args) {
-        log(Levels::Warn, Subjects::Default, format_string, std::forward<Ts>(args)...);
+        if constexpr(is_compiled(Levels::Warn)) {
+            log(Levels::Warn, Subjects::Default, format_string, std::forward<Ts>(args)...);
+        }
     }
     
     
     template<class... Ts, class T = Levels, std::enable_if_t<(int)T::Error >= 0, int> = 0>
     void error(Subjects subject, xl::zstring_view const & format_string, Ts && ... args) {
-        log(Levels::Error, subject, format_string, std::forward<Ts>(args)...);
+        if constexpr(is_compiled(Levels::Error)) {
+            log(Levels::Error, subject, format_string, std::forward<Ts>(args)...);
+        }
     }
     
     template<class... Ts, class T = Levels, class S = Subjects, std::enable_if_t<(int)T::Error >= 0 && (int)S::Default >= 0, int> = 0>
     void error(xl::zstring_view const & format_string, Ts && ... args) {
-        log(Levels::Error, Subjects::Default, format_string, std::forward<Ts>(args)...);
+        if constexpr(is_compiled(Levels::Error)) {
+            log(Levels::Error, Subjects::Default, format_string, std::forward<Ts>(args)...);
+        }
     }
 #endif
 
@@ -549,30 +1802,45 @@ namespace xl::log {
  * when the log level/subject is disabled, using a xl::Template will allow for specifying callbacks
  * or user-defined provider objects which are only used if the string will be sent to a callback
  */
-template<class LevelsT, class SubjectsT, class Clock>
+template<class LevelsT, class SubjectsT, class Clock, class... Sinks>
 template<typename... Ts>
-void Log<LevelsT, SubjectsT, Clock>::log(Levels level, Subjects subject, xl::templates::Template const & tmpl, Ts&&... args) {
-    if (this->is_live(level, subject)) { // don't build the string if it wont be used
-        this->log(level, subject, tmpl.fill(std::forward<Ts>(args)...));
+void Log<LevelsT, SubjectsT, Clock, Sinks...>::log(Levels level, Subjects subject, xl::templates::Template const & tmpl, Ts&&... args) {
+    if (!is_compiled(level)) {
+        return;
+    }
+    auto snapshot = this->read_snapshot();
+    if (is_live(*snapshot, level, subject) && this->admit(*snapshot, level, subject)) { // don't build the string if it wont be used
+        auto result = tmpl.fill(std::forward<Ts>(args)...);
+        if (result) {
+            this->log_admitted(*snapshot, level, subject, *result);
+        } else {
+            this->log_admitted(*snapshot, level, subject, "Error filling log template: " + result.error().get_pretty_string());
+        }
     }
 };
 
-template<class LevelsT, class SubjectsT, class Clock>
+template<class LevelsT, class SubjectsT, class Clock, class... Sinks>
 template<class... Ts, class T, std::enable_if_t<(int)T::Info >= 0, int>>
-void Log<LevelsT, SubjectsT, Clock>::info(Subjects subject, xl::templates::Template const & tmpl, Ts && ... args) {
-    this->log(Levels::Info, subject, tmpl, std::forward<Ts>(args)...);
+void Log<LevelsT, SubjectsT, Clock, Sinks...>::info(Subjects subject, xl::templates::Template const & tmpl, Ts && ... args) {
+    if constexpr(is_compiled(Levels::Info)) {
+        this->log(Levels::Info, subject, tmpl, std::forward<Ts>(args)...);
+    }
 }
 
-template<class LevelsT, class SubjectsT, class Clock>
+template<class LevelsT, class SubjectsT, class Clock, class... Sinks>
 template<class... Ts, class T, std::enable_if_t<(int)T::Warn >= 0, int>>
-void Log<LevelsT, SubjectsT, Clock>::warn(Subjects subject, xl::templates::Template const & tmpl, Ts && ... args) {
-    this->log(Levels::Warn, subject, tmpl, std::forward<Ts>(args)...);
+void Log<LevelsT, SubjectsT, Clock, Sinks...>::warn(Subjects subject, xl::templates::Template const & tmpl, Ts && ... args) {
+    if constexpr(is_compiled(Levels::Warn)) {
+        this->log(Levels::Warn, subject, tmpl, std::forward<Ts>(args)...);
+    }
 }
 
-template<class LevelsT, class SubjectsT, class Clock>
+template<class LevelsT, class SubjectsT, class Clock, class... Sinks>
 template<class... Ts, class T, std::enable_if_t<(int)T::Error >= 0, int>>
-void Log<LevelsT, SubjectsT, Clock>::error(Subjects subject, xl::templates::Template const & tmpl, Ts && ... args) {
-    this->log(Levels::Error, subject, tmpl, std::forward<Ts>(args)...);
+void Log<LevelsT, SubjectsT, Clock, Sinks...>::error(Subjects subject, xl::templates::Template const & tmpl, Ts && ... args) {
+    if constexpr(is_compiled(Levels::Error)) {
+        this->log(Levels::Error, subject, tmpl, std::forward<Ts>(args)...);
+    }
 }
 #endif
 
@@ -622,6 +1890,37 @@ public:
     ~LogCallbackGuard(){
         this->logger.remove_callback(*this->registered_callback);
     }
+
+
+    /**
+     * Sets which levels and subjects are sent to the guarded callback
+     */
+    void set_statuses(typename LogT::StatusesT statuses) {
+        this->logger.set_callback_statuses(*this->registered_callback, statuses);
+    }
+
+
+    typename LogT::StatusesT get_statuses() const {
+        return this->logger.get_callback_statuses(*this->registered_callback);
+    }
+
+
+    bool set_status(typename LogT::Levels level, bool new_status) {
+        return this->logger.set_callback_status(*this->registered_callback, level, new_status);
+    }
+
+
+    bool set_status(typename LogT::Subjects subject, bool new_status) {
+        return this->logger.set_callback_status(*this->registered_callback, subject, new_status);
+    }
+
+
+    /**
+     * Names the guarded callback so its statuses are saved in the log's status file
+     */
+    void set_name(std::string name) {
+        this->logger.set_callback_name(*this->registered_callback, std::move(name));
+    }
 };
 
 } // end namespace xl::log
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "../zstring_view.h"
+#include "log_context.h"
+#include "log_crash_handler.h"
+#include "log_fields.h"
+#include "log_ring_buffer.h"
+#include "log_subject_registry.h"
+#include "log_deferred_format.h"
+#include "log_timestamp.h"
+
+namespace xl::log {
+
+
+/**
+ * What a thread logging a message does when the async queue has no free slot
+ */
+enum class AsyncOverflowPolicy {
+    BLOCK = 0,   // wait for the consumer thread to free up a slot - the consumer thread itself drops the message
+    DROP_NEWEST, // discard the message being logged
+    DROP_OLDEST  // discard the oldest queued message to make room for the new one
+};
+
+
+/**
+ * Which thread turns format strings and arguments into message text in async mode
+ */
+enum class AsyncFormatting {
+    IMMEDIATE = 0, // the thread logging the message formats it before queueing it
+    DEFERRED       // the format string pointer and copies of the arguments are queued and formatted by the
+                   //   consumer thread - format strings must outlive the log object (e.g. string literals)
+};
+
+
+/**
+ * Moves the work of calling log callbacks off of the logging thread.  Messages are copied into a preallocated
+ * ring buffer and a dedicated consumer thread hands them to the callbacks of the log object in the order they
+ * were queued.
+ * @tparam LogT type of the log object whose callbacks will be called
+ */
+template<class LogT>
+class LogAsyncDispatcher {
+
+    using Levels = typename LogT::Levels;
+    using Subjects = typename LogT::Subjects;
+    using LogMessage = typename LogT::LogMessage;
+    using TimePoint = decltype(LogMessage::time);
+
+    struct Entry {
+        Levels level{};
+        Subjects subject{};
+        LogDynamicSubject const * dynamic_subject = nullptr;
+        std::string string;
+        TimePoint time{};
+
+        // if not empty, string is built from this on the consumer thread
+        LogDeferredFormat deferred;
+
+        // copy of the logging thread's context, outermost first - empty if it had none
+        std::vector<LogContext> context;
+
+        // copies of the fields, whose keys and string values point into field_text
+        std::vector<LogField> fields;
+        std::vector<char> field_text;
+
+        // non-zero means this entry isn't a message, but a marker queued by flush()
+        size_t flush_id = 0;
+    };
+
+    LogT & log;
+    AsyncOverflowPolicy overflow_policy;
+    AsyncFormatting formatting;
+    LogRingBuffer<Entry> queue;
+
+    std::atomic<size_t> dropped_count{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> consumer_sleeping{false};
+
+    std::mutex mutex;
+    std::condition_variable consumer_wakeup;
+    std::condition_variable flush_completed;
+    size_t last_flush_id = 0;
+    size_t last_completed_flush_id = 0;
+
+    // declared last so all the state it uses is constructed before the thread starts
+    std::thread consumer_thread;
+
+
+    void wake_consumer() {
+        // pairs with the fence in consume() so either the producer sees the consumer is sleeping or the
+        //   consumer sees the newly pushed entry
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->consumer_sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->consumer_wakeup.notify_one();
+        }
+    }
+
+
+    void complete_flush(size_t flush_id) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->last_completed_flush_id = std::max(this->last_completed_flush_id, flush_id);
+        }
+        this->flush_completed.notify_all();
+    }
+
+
+    // returns false if the entry being pushed was dropped
+    template<class WriterT>
+    bool push_with(WriterT && writer, AsyncOverflowPolicy policy) {
+        while (!this->queue.try_push_with(writer)) {
+            // a callback logging to its own log would wait for itself to free a slot forever
+            if (policy == AsyncOverflowPolicy::BLOCK && std::this_thread::get_id() == this->consumer_thread.get_id()) {
+                policy = AsyncOverflowPolicy::DROP_NEWEST;
+            }
+            if (policy == AsyncOverflowPolicy::DROP_NEWEST) {
+                this->dropped_count++;
+                return false;
+            } else if (policy == AsyncOverflowPolicy::DROP_OLDEST) {
+                this->queue.try_pop_with([this](Entry & entry) {
+                    if (entry.flush_id != 0) {
+                        // everything queued before the marker is gone, so the flush is done
+                        this->complete_flush(entry.flush_id);
+                    } else {
+                        entry.deferred.reset();
+                        this->dropped_count++;
+                    }
+                });
+            } else {
+                this->wake_consumer();
+                std::this_thread::yield();
+            }
+        }
+        this->wake_consumer();
+        return true;
+    }
+
+
+    void consume() {
+        // copied out of the slot being read so the slot is released before any callbacks run - strings are
+        //   swapped so their buffers are handed back and forth instead of being reallocated
+        Entry entry;
+        auto take = [&entry](Entry & slot_entry) {
+            entry.level = slot_entry.level;
+            entry.subject = slot_entry.subject;
+            entry.dynamic_subject = slot_entry.dynamic_subject;
+            entry.time = slot_entry.time;
+            entry.flush_id = slot_entry.flush_id;
+            std::swap(entry.context, slot_entry.context);
+            std::swap(entry.fields, slot_entry.fields);
+            std::swap(entry.field_text, slot_entry.field_text);
+            if (!slot_entry.deferred.empty()) {
+                slot_entry.deferred.format_to(entry.string);
+            } else {
+                std::swap(entry.string, slot_entry.string);
+            }
+        };
+
+        while (true) {
+            if (this->queue.try_pop_with(take)) {
+                if (entry.flush_id != 0) {
+                    this->complete_flush(entry.flush_id);
+                } else {
+                    LogMessage message(entry.level, entry.subject, entry.string, entry.time,
+                                       entry.context.empty() ? nullptr : &entry.context.back(),
+                                       LogFields(entry.fields.data(), entry.fields.size()), entry.dynamic_subject);
+                    this->log.dispatch_async_message(message);
+                }
+                continue;
+            }
+            if (this->stopping.load()) {
+                break;
+            }
+
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->consumer_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            // the timeout is a backstop - producers wake the consumer when it's sleeping
+            this->consumer_wakeup.wait_for(lock, std::chrono::milliseconds(10), [this] {
+                return this->stopping.load() || !this->queue.empty();
+            });
+            this->consumer_sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+
+public:
+
+    /**
+     * @param log log object whose callbacks messages will be sent to
+     * @param capacity number of messages which can be queued before overflow_policy is applied
+     * @param overflow_policy what to do with messages logged when the queue is full
+     * @param formatting which thread formats messages logged with a format string
+     */
+    LogAsyncDispatcher(LogT & log, size_t capacity, AsyncOverflowPolicy overflow_policy,
+                       AsyncFormatting formatting = AsyncFormatting::IMMEDIATE) :
+        log(log),
+        overflow_policy(overflow_policy),
+        formatting(formatting),
+        queue(capacity),
+        consumer_thread([this]{this->consume();})
+    {}
+
+
+    /**
+     * Delivers everything already queued then stops the consumer thread
+     */
+    ~LogAsyncDispatcher() {
+        this->stopping.store(true);
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->consumer_wakeup.notify_one();
+        }
+        this->consumer_thread.join();
+    }
+
+
+    /**
+     * Queues a copy of the message for the consumer thread
+     * @return false if the message was dropped because the queue was full
+     */
+    bool push(Levels level, Subjects subject, std::string_view string, TimePoint time, LogFields fields = {},
+              LogDynamicSubject const * dynamic_subject = nullptr) {
+        return this->push_with([&](Entry & entry) {
+            entry.level = level;
+            entry.subject = subject;
+            entry.dynamic_subject = dynamic_subject;
+            entry.string.assign(string.data(), string.length());
+            entry.time = time;
+            entry.flush_id = 0;
+            entry.deferred.reset();
+            LogContext::copy(LogContext::get_current(), entry.context);
+            fields.copy(entry.fields, entry.field_text);
+        }, this->overflow_policy);
+    }
+
+
+#ifdef XL_USE_LIB_FMT
+    /**
+     * Queues the format string pointer and copies of the arguments to be formatted by the consumer thread
+     * @return false if the message was dropped because the queue was full
+     */
+    template<class... Ts>
+    bool push_deferred(Levels level, Subjects subject, TimePoint time, char const * format_string, Ts && ... args) {
+        return this->push_with([&](Entry & entry) {
+            entry.level = level;
+            entry.subject = subject;
+            entry.dynamic_subject = nullptr;
+            entry.time = time;
+            entry.flush_id = 0;
+            entry.deferred.capture(format_string, std::forward<Ts>(args)...);
+            LogContext::copy(LogContext::get_current(), entry.context);
+            entry.fields.clear();
+        }, this->overflow_policy);
+    }
+#endif
+
+
+    /**
+     * Blocks until every message queued before this call has been sent to the callbacks (or dropped)
+     */
+    void flush() {
+        // a callback flushing its own log would wait on itself forever
+        if (std::this_thread::get_id() == this->consumer_thread.get_id()) {
+            return;
+        }
+
+        size_t flush_id;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            flush_id = ++this->last_flush_id;
+        }
+
+        // waits for room instead of applying the overflow policy - flushing shouldn't lose messages
+        this->push_with([flush_id](Entry & entry) {
+            entry.string.clear();
+            entry.deferred.reset();
+            entry.context.clear();
+            entry.fields.clear();
+            entry.flush_id = flush_id;
+        }, AsyncOverflowPolicy::BLOCK);
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->flush_completed.wait(lock, [this, flush_id] {
+            return this->last_completed_flush_id >= flush_id;
+        });
+    }
+
+
+    /**
+     * Writes the messages still waiting in the queue to file_descriptor in the same format as
+     *   add_callback(std::ostream &), using only async-signal-safe calls.  For LogCrashHandler - the queue is read
+     *   without claiming anything, so it must not be used while the process is still running normally.  Messages
+     *   queued with deferred formatting can't be formatted without allocating, so their format string is written
+     *   instead.
+     */
+    void crash_drain(int file_descriptor) const {
+        this->queue.visit_unread([file_descriptor](Entry const & entry) {
+            if (entry.flush_id != 0) {
+                return;
+            }
+
+            char time_string[LogTimestampFormatter::max_length];
+            size_t time_length = 0;
+            if constexpr(std::is_same_v<typename TimePoint::clock, std::chrono::system_clock>) {
+                LogTimestampFormatter formatter(TimestampFormat::TIME_OF_DAY,
+                    LogTimestampFormatter::precision_for<typename TimePoint::duration>());
+                time_length = formatter.format(entry.time, time_string, sizeof(time_string));
+            }
+            std::string_view subject_name = entry.dynamic_subject != nullptr ?
+                std::string_view(entry.dynamic_subject->name) : std::string_view(LogT::get_name(entry.subject));
+            std::string_view string = entry.deferred.empty() ?
+                std::string_view(entry.string) : std::string_view(entry.deferred.get_format_string());
+
+            LogCrashHandler::write_all(file_descriptor, "[", 1);
+            LogCrashHandler::write_all(file_descriptor, time_string, time_length);
+            LogCrashHandler::write_all(file_descriptor, "] ", 2);
+            LogCrashHandler::write_all(file_descriptor, subject_name.data(), subject_name.length());
+            LogCrashHandler::write_all(file_descriptor, " ", 1);
+            LogCrashHandler::write_all(file_descriptor, string.data(), string.length());
+            LogCrashHandler::write_all(file_descriptor, "\n", 1);
+        });
+    }
+
+
+    /**
+     * Number of messages discarded because the queue was full
+     */
+    size_t get_dropped_count() const {
+        return this->dropped_count.load();
+    }
+
+
+    size_t capacity() const {
+        return this->queue.capacity();
+    }
+
+
+    AsyncOverflowPolicy get_overflow_policy() const {
+        return this->overflow_policy;
+    }
+
+
+    AsyncFormatting get_formatting() const {
+        return this->formatting;
+    }
+};
+
+
+} // end namespace xl::log
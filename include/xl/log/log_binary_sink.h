@@ -0,0 +1,672 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../exceptions.h"
+#include "log_context.h"
+#include "log_enum_bases.h"
+#include "log_fields.h"
+#include "log_timestamp.h"
+
+namespace xl::log {
+
+
+class LogBinaryFileException : public xl::FormattedException {
+
+public:
+
+    using xl::FormattedException::FormattedException;
+};
+
+
+/**
+ * Layout of the files written by LogBinarySink.  All integers are in the byte order of the machine which wrote
+ * the file.
+ *
+ * File header:
+ *   magic (8 bytes), version (uint32)
+ *   clock period numerator (int64), clock period denominator (int64)
+ *   level count (uint32), then for each level: name length (uint32), name bytes
+ *   subject count (uint32), then for each subject: name length (uint32), name bytes
+ *
+ * Followed by records:
+ *   record size including this field (uint32), level (uint32), subject (uint32), time in clock ticks since the
+ *   clock's epoch (int64), message length (uint32), message bytes, dynamic subject name length (uint32), dynamic
+ *   subject name bytes, context pair count (uint32), then for each pair from the outermost: key length (uint32),
+ *   key bytes, value length (uint32), value bytes, then fields to the end of the record
+ *
+ * The dynamic subject name is the name of the subject added with Log::add_subject() the message was logged to, in
+ *   which case subject is its parent, and is empty for messages logged to a subject in the enum.
+ *
+ * Each field:
+ *   type (LogFieldType as uint8), key length (uint32), key bytes, value - uint8 for BOOL, int64 for INT, uint64
+ *   for UINT, double for DOUBLE, length (uint32) and bytes for STRING
+ *
+ * Version 1 records had no message length or fields - the message was the rest of the record.  Version 2 records
+ *   had no dynamic subject name.  Version 3 records had no context.
+ *
+ * Files are sized up front and zero filled, so a record size of 0 marks the end of the records.
+ */
+struct LogBinaryFormat {
+    static constexpr char magic[8] = {'X', 'L', 'L', 'O', 'G', 'B', 'I', 'N'};
+    static constexpr uint32_t version = 4;
+    static constexpr size_t record_header_size = sizeof(uint32_t) * 6 + sizeof(int64_t);
+    static constexpr size_t version_3_record_header_size = sizeof(uint32_t) * 5 + sizeof(int64_t);
+    static constexpr size_t version_2_record_header_size = sizeof(uint32_t) * 4 + sizeof(int64_t);
+    static constexpr size_t version_1_record_header_size = sizeof(uint32_t) * 3 + sizeof(int64_t);
+
+
+    static size_t get_field_size(LogField const & field) {
+        size_t size = sizeof(uint8_t) + sizeof(uint32_t) + field.get_key().length();
+        switch (field.get_type()) {
+            case LogFieldType::BOOL:
+                return size + sizeof(uint8_t);
+            case LogFieldType::STRING:
+                return size + sizeof(uint32_t) + field.get_string().length();
+            default:
+                return size + sizeof(uint64_t);
+        }
+    }
+
+
+    static size_t get_context_size(LogContext const * context) {
+        size_t size = 0;
+        LogContext::for_each(context, [&size](LogContext const & pair) {
+            size += sizeof(uint32_t) * 2 + pair.key.length() + pair.value.length();
+        });
+        return size;
+    }
+};
+
+
+/**
+ * Log callback which appends messages as binary records to a memory-mapped file.  Each file is created at a fixed
+ * size and when a message doesn't fit in what's left of it, the file is trimmed to the records actually written
+ * and logging continues in a new file.  Files are named <base filename>.<number>, only the most recent max_files
+ * are kept - counting any left over from previous runs, which numbering continues after.
+ *
+ * Register with log.add_callback(std::ref(sink)) - the sink must outlive its registration.  Use
+ * LogBinaryReader or the log_decoder program to turn the files back into text.
+ * @tparam LogT type of the log object whose messages will be written
+ */
+template<class LogT>
+class LogBinarySink {
+
+    using LogMessage = typename LogT::LogMessage;
+    using Period = typename decltype(LogMessage::time)::period;
+
+    std::string base_filename;
+    size_t header_size;
+    size_t file_size;
+    size_t max_files;
+
+    // callbacks may be called from multiple threads at once
+    std::mutex mutex;
+
+    size_t file_number = 0;
+    std::string current_filename;
+    int file_descriptor = -1;
+    char * mapping = nullptr;
+    size_t offset = 0;
+
+
+    template<class T>
+    void append(T value) {
+        std::memcpy(this->mapping + this->offset, &value, sizeof(value));
+        this->offset += sizeof(value);
+    }
+
+
+    void append(std::string_view string) {
+        std::memcpy(this->mapping + this->offset, string.data(), string.length());
+        this->offset += string.length();
+    }
+
+
+    std::string get_filename(size_t number) const {
+        return this->base_filename + "." + std::to_string(number);
+    }
+
+
+    // numbers of the files already left over from previous runs, oldest first
+    std::vector<size_t> find_existing_file_numbers() const {
+        std::filesystem::path base_path(this->base_filename);
+        auto directory = base_path.has_parent_path() ? base_path.parent_path() : std::filesystem::path(".");
+        auto prefix = base_path.filename().string() + ".";
+
+        std::vector<size_t> numbers;
+        std::error_code error_code;
+        for (auto const & entry : std::filesystem::directory_iterator(directory, error_code)) {
+            auto name = entry.path().filename().string();
+            auto digits = name.size() - std::min(name.size(), prefix.size());
+            if (digits > 0 && digits < 19 && name.compare(0, prefix.size(), prefix) == 0 &&
+                name.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+                numbers.push_back(std::stoull(name.substr(prefix.size())));
+            }
+        }
+        std::sort(numbers.begin(), numbers.end());
+        return numbers;
+    }
+
+
+    // continues after the newest file left over from a previous run, deleting all but the newest of them so
+    //   there are max_files once the first file is opened
+    void remove_old_files() {
+        auto numbers = this->find_existing_file_numbers();
+        this->file_number = numbers.empty() ? 0 : numbers.back() + 1;
+        for (size_t i = 0; i + this->max_files <= numbers.size(); i++) {
+            std::error_code error_code;
+            std::filesystem::remove(this->get_filename(numbers[i]), error_code);
+        }
+    }
+
+
+    void write_header() {
+        this->append(std::string_view(LogBinaryFormat::magic, sizeof(LogBinaryFormat::magic)));
+        this->append(LogBinaryFormat::version);
+        this->append(static_cast<int64_t>(Period::num));
+        this->append(static_cast<int64_t>(Period::den));
+
+        this->append(static_cast<uint32_t>(LogT::level_count));
+        for (auto level : LogT::levels()) {
+            auto & name = LogT::get_name(level);
+            this->append(static_cast<uint32_t>(name.length()));
+            this->append(std::string_view(name));
+        }
+
+        this->append(static_cast<uint32_t>(LogT::subject_count));
+        for (auto subject : LogT::subjects()) {
+            auto & name = LogT::get_name(subject);
+            this->append(static_cast<uint32_t>(name.length()));
+            this->append(std::string_view(name));
+        }
+    }
+
+
+    static size_t get_header_size() {
+        size_t size = sizeof(LogBinaryFormat::magic) + sizeof(uint32_t) + sizeof(int64_t) * 2 + sizeof(uint32_t) * 2;
+        for (auto level : LogT::levels()) {
+            size += sizeof(uint32_t) + LogT::get_name(level).length();
+        }
+        for (auto subject : LogT::subjects()) {
+            size += sizeof(uint32_t) + LogT::get_name(subject).length();
+        }
+        return size;
+    }
+
+
+    void open_next_file() {
+        this->close_file();
+
+        this->current_filename = this->get_filename(this->file_number);
+        this->file_descriptor = ::open(this->current_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (this->file_descriptor == -1) {
+            throw LogBinaryFileException("Could not open binary log file: " + this->current_filename);
+        }
+        if (::ftruncate(this->file_descriptor, this->file_size) != 0) {
+            ::close(this->file_descriptor);
+            this->file_descriptor = -1;
+            throw LogBinaryFileException("Could not size binary log file: " + this->current_filename);
+        }
+        void * mapping = ::mmap(nullptr, this->file_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->file_descriptor, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(this->file_descriptor);
+            this->file_descriptor = -1;
+            throw LogBinaryFileException("Could not map binary log file: " + this->current_filename);
+        }
+        this->mapping = static_cast<char *>(mapping);
+        this->offset = 0;
+        this->write_header();
+
+        if (this->file_number >= this->max_files) {
+            std::error_code error_code;
+            std::filesystem::remove(this->get_filename(this->file_number - this->max_files), error_code);
+        }
+        this->file_number++;
+    }
+
+
+    // trims the file to what was actually written
+    void close_file() {
+        if (this->file_descriptor == -1) {
+            return;
+        }
+        ::munmap(this->mapping, this->file_size);
+        [[maybe_unused]] auto result = ::ftruncate(this->file_descriptor, this->offset);
+        ::close(this->file_descriptor);
+        this->mapping = nullptr;
+        this->file_descriptor = -1;
+    }
+
+
+public:
+
+    /**
+     * @param base_filename files are named this followed by a period and a number
+     * @param file_size size of each file - messages longer than fit in an empty file are truncated
+     * @param max_files older files are deleted when a new one would make more than this many
+     */
+    LogBinarySink(std::string base_filename, size_t file_size = 64 * 1024 * 1024, size_t max_files = 4) :
+        base_filename(std::move(base_filename)),
+        header_size(get_header_size()),
+        file_size(std::max(file_size, this->header_size + LogBinaryFormat::record_header_size + 1)),
+        max_files(std::max<size_t>(max_files, 1))
+    {
+        this->remove_old_files();
+        this->open_next_file();
+    }
+
+    LogBinarySink(LogBinarySink const &) = delete;
+    LogBinarySink & operator=(LogBinarySink const &) = delete;
+
+    ~LogBinarySink() {
+        this->close_file();
+    }
+
+
+    void operator()(LogMessage const & message) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        std::string_view string = message.string;
+        std::string_view dynamic_subject = message.dynamic_subject ? std::string_view(message.dynamic_subject->name) : std::string_view();
+        auto context = message.context;
+        size_t context_size = LogBinaryFormat::get_context_size(context);
+        auto fields = message.fields;
+        size_t fields_size = 0;
+        for (auto const & field : fields) {
+            fields_size += LogBinaryFormat::get_field_size(field);
+        }
+
+        auto record_size = [&] {
+            return LogBinaryFormat::record_header_size + string.length() + dynamic_subject.length() + context_size + fields_size;
+        };
+        if (this->offset + record_size() > this->file_size) {
+            if (this->offset != this->header_size) {
+                this->open_next_file();
+            }
+
+            // a message too big for even an empty file loses its context and fields and is truncated instead of
+            //   leaving behind an empty file
+            if (this->offset + record_size() > this->file_size) {
+                context = nullptr;
+                context_size = 0;
+                fields = {};
+                fields_size = 0;
+                dynamic_subject = dynamic_subject.substr(0, this->file_size - this->offset - LogBinaryFormat::record_header_size);
+                string = string.substr(0, this->file_size - this->offset - LogBinaryFormat::record_header_size - dynamic_subject.length());
+            }
+        }
+
+        this->append(static_cast<uint32_t>(record_size()));
+        this->append(static_cast<uint32_t>(LogT::get(message.level)));
+        this->append(static_cast<uint32_t>(LogT::get(message.subject)));
+        this->append(static_cast<int64_t>(message.time.time_since_epoch().count()));
+        this->append(static_cast<uint32_t>(string.length()));
+        this->append(string);
+        this->append(static_cast<uint32_t>(dynamic_subject.length()));
+        this->append(dynamic_subject);
+
+        uint32_t context_count = 0;
+        LogContext::for_each(context, [&context_count](LogContext const &) {
+            context_count++;
+        });
+        this->append(context_count);
+        LogContext::for_each(context, [this](LogContext const & pair) {
+            this->append(static_cast<uint32_t>(pair.key.length()));
+            this->append(std::string_view(pair.key));
+            this->append(static_cast<uint32_t>(pair.value.length()));
+            this->append(std::string_view(pair.value));
+        });
+
+        for (auto const & field : fields) {
+            this->append(static_cast<uint8_t>(field.get_type()));
+            this->append(static_cast<uint32_t>(field.get_key().length()));
+            this->append(field.get_key());
+            switch (field.get_type()) {
+                case LogFieldType::BOOL:
+                    this->append(static_cast<uint8_t>(field.get_bool()));
+                    break;
+                case LogFieldType::INT:
+                    this->append(field.get_int());
+                    break;
+                case LogFieldType::UINT:
+                    this->append(field.get_uint());
+                    break;
+                case LogFieldType::DOUBLE:
+                    this->append(field.get_double());
+                    break;
+                case LogFieldType::STRING:
+                    this->append(static_cast<uint32_t>(field.get_string().length()));
+                    this->append(field.get_string());
+                    break;
+            }
+        }
+    }
+
+
+    /**
+     * Asks the operating system to start writing what has been logged so far to disk
+     */
+    void flush() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        ::msync(this->mapping, this->offset, MS_ASYNC);
+    }
+
+
+    std::string get_current_filename() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->current_filename;
+    }
+};
+
+
+/**
+ * Reads files written by LogBinarySink.  Only needs the file - level and subject names come from its header.
+ */
+class LogBinaryReader {
+
+    // only used when the reader was given a filename
+    std::vector<char> file_contents;
+
+    std::string_view contents;
+    size_t offset = 0;
+    uint32_t version = 0;
+
+
+    template<class T>
+    T read() {
+        if (this->offset + sizeof(T) > this->contents.size()) {
+            throw LogBinaryFileException("Binary log file is truncated");
+        }
+        T value;
+        std::memcpy(&value, this->contents.data() + this->offset, sizeof(T));
+        this->offset += sizeof(T);
+        return value;
+    }
+
+
+    std::string_view read_string(size_t length) {
+        if (this->offset + length > this->contents.size()) {
+            throw LogBinaryFileException("Binary log file is truncated");
+        }
+        std::string_view string(this->contents.data() + this->offset, length);
+        this->offset += length;
+        return string;
+    }
+
+
+    std::vector<std::string> read_names() {
+        std::vector<std::string> names(this->read<uint32_t>());
+        for (auto & name : names) {
+            name = this->read_string(this->read<uint32_t>());
+        }
+        return names;
+    }
+
+
+    LogTimestampFormatter timestamp_formatter;
+
+
+    LogField read_field() {
+        auto type = static_cast<LogFieldType>(this->read<uint8_t>());
+        auto key = this->read_string(this->read<uint32_t>());
+        switch (type) {
+            case LogFieldType::BOOL:
+                return LogField(key, this->read<uint8_t>() != 0);
+            case LogFieldType::INT:
+                return LogField(key, this->read<int64_t>());
+            case LogFieldType::UINT:
+                return LogField(key, this->read<uint64_t>());
+            case LogFieldType::DOUBLE:
+                return LogField(key, this->read<double>());
+            case LogFieldType::STRING:
+                return LogField(key, this->read_string(this->read<uint32_t>()));
+        }
+        throw LogBinaryFileException("Invalid field type in binary log file");
+    }
+
+
+public:
+
+    struct Record {
+        uint32_t level;
+
+        // for a message logged to a subject added with Log::add_subject(), its parent
+        uint32_t subject;
+
+        // name of the subject added with Log::add_subject() the message was logged to, otherwise empty
+        std::string_view dynamic_subject;
+
+        // key/value pairs of LogContext the message was logged in, outermost first - point into the reader's copy
+        //   of the file
+        std::vector<std::pair<std::string_view, std::string_view>> context;
+
+        // ticks of the clock which wrote the file
+        int64_t time;
+        std::string_view string;
+
+        // keys and string values point into the reader's copy of the file
+        std::vector<LogField> fields;
+    };
+
+    int64_t period_numerator;
+    int64_t period_denominator;
+    std::vector<std::string> level_names;
+    std::vector<std::string> subject_names;
+
+
+    explicit LogBinaryReader(std::string const & filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            throw LogBinaryFileException("Could not open binary log file: " + filename);
+        }
+        this->file_contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        this->contents = std::string_view(this->file_contents.data(), this->file_contents.size());
+        this->read_header(filename);
+    }
+
+
+    /**
+     * Reads a binary log file already in memory - such as a mapping of a file still being written - without
+     *   copying it.  contents must outlive the reader and every record read from it.
+     * @param size bytes of contents which may be read
+     * @throw LogBinaryFileException if contents don't start with a complete header
+     */
+    LogBinaryReader(char const * contents, size_t size) :
+        contents(contents, size)
+    {
+        this->read_header("<memory>");
+    }
+
+
+    LogBinaryReader(LogBinaryReader const &) = delete;
+    LogBinaryReader & operator=(LogBinaryReader const &) = delete;
+
+
+private:
+
+    void read_header(std::string const & filename) {
+        if (this->read_string(sizeof(LogBinaryFormat::magic)) != std::string_view(LogBinaryFormat::magic, sizeof(LogBinaryFormat::magic))) {
+            throw LogBinaryFileException("Not a binary log file: " + filename);
+        }
+        this->version = this->read<uint32_t>();
+        if (this->version < 1 || this->version > LogBinaryFormat::version) {
+            throw LogBinaryFileException("Unsupported binary log file version: " + std::to_string(this->version));
+        }
+        this->period_numerator = this->read<int64_t>();
+        this->period_denominator = this->read<int64_t>();
+        this->level_names = this->read_names();
+        this->subject_names = this->read_names();
+
+        auto precision = TimestampPrecision::NANOSECONDS;
+        if (this->period_numerator != 1 || this->period_denominator == 1) {
+            precision = TimestampPrecision::SECONDS;
+        } else if (this->period_denominator <= 1'000) {
+            precision = TimestampPrecision::MILLISECONDS;
+        } else if (this->period_denominator <= 1'000'000) {
+            precision = TimestampPrecision::MICROSECONDS;
+        }
+        this->timestamp_formatter = LogTimestampFormatter(TimestampFormat::TIME_OF_DAY, precision);
+    }
+
+
+public:
+
+    /**
+     * @return offset of the next record in the file - the first record's offset right after construction
+     */
+    size_t get_offset() const {
+        return this->offset;
+    }
+
+
+    /**
+     * Moves to the record at offset, which must have come from get_offset()
+     */
+    void seek(size_t offset) {
+        this->offset = std::min(offset, this->contents.size());
+    }
+
+
+    /**
+     * Moves past the next record without decoding it, for indexing records of large files
+     * @return false if there's no complete record left - the offset isn't changed, so skipping can be retried
+     *   once more of a file being written is available
+     * @throw LogBinaryFileException if the record size is invalid
+     */
+    bool skip() {
+        if (this->offset + sizeof(uint32_t) > this->contents.size()) {
+            return false;
+        }
+        uint32_t record_size;
+        std::memcpy(&record_size, this->contents.data() + this->offset, sizeof(record_size));
+        if (record_size == 0) {
+            return false;
+        }
+        if (record_size < LogBinaryFormat::version_1_record_header_size) {
+            throw LogBinaryFileException("Invalid record size in binary log file");
+        }
+        if (this->offset + record_size > this->contents.size()) {
+            return false;
+        }
+        this->offset += record_size;
+        return true;
+    }
+
+
+    /**
+     * @return the next record, or nothing if all records have been read.  The string in the record is only valid
+     *   as long as this object.
+     */
+    std::optional<Record> next() {
+        if (this->offset + sizeof(uint32_t) > this->contents.size()) {
+            return {};
+        }
+        auto record_size = this->read<uint32_t>();
+        if (record_size == 0) {
+            return {};
+        }
+        auto record_header_size = this->version == 1 ? LogBinaryFormat::version_1_record_header_size :
+                                  this->version == 2 ? LogBinaryFormat::version_2_record_header_size :
+                                  this->version == 3 ? LogBinaryFormat::version_3_record_header_size :
+                                  LogBinaryFormat::record_header_size;
+        if (record_size < record_header_size) {
+            throw LogBinaryFileException("Invalid record size in binary log file");
+        }
+        auto record_end = this->offset - sizeof(uint32_t) + record_size;
+
+        Record record;
+        record.level = this->read<uint32_t>();
+        record.subject = this->read<uint32_t>();
+        record.time = this->read<int64_t>();
+        if (this->version == 1) {
+            record.string = this->read_string(record_size - record_header_size);
+        } else {
+            record.string = this->read_string(this->read<uint32_t>());
+            if (this->version >= 3) {
+                record.dynamic_subject = this->read_string(this->read<uint32_t>());
+            }
+            if (this->version >= 4) {
+                auto context_count = this->read<uint32_t>();
+                for (uint32_t i = 0; i < context_count; i++) {
+                    auto key = this->read_string(this->read<uint32_t>());
+                    record.context.emplace_back(key, this->read_string(this->read<uint32_t>()));
+                }
+            }
+            while (this->offset < record_end) {
+                record.fields.push_back(this->read_field());
+            }
+            if (this->offset != record_end) {
+                throw LogBinaryFileException("Invalid field in binary log file");
+            }
+        }
+        if (record.level >= this->level_names.size() || record.subject >= this->subject_names.size()) {
+            throw LogBinaryFileException("Invalid level or subject in binary log file");
+        }
+        return record;
+    }
+
+
+    std::chrono::nanoseconds get_time_since_epoch(Record const & record) const {
+        // exact for any clock with a period of a whole number of nanoseconds, which covers the standard clocks
+        if (1'000'000'000 % this->period_denominator == 0) {
+            return std::chrono::nanoseconds(record.time * this->period_numerator * (1'000'000'000 / this->period_denominator));
+        }
+        return std::chrono::nanoseconds(static_cast<int64_t>(
+            static_cast<long double>(record.time) * this->period_numerator * 1'000'000'000 / this->period_denominator));
+    }
+
+
+    /**
+     * Formats the time the same way LogMessage::get_time_string does for the clock which wrote the file
+     */
+    std::string get_time_string(Record const & record) {
+        return this->timestamp_formatter.format(
+            std::chrono::time_point<std::chrono::system_clock, std::chrono::nanoseconds>(this->get_time_since_epoch(record)));
+    }
+
+
+    /**
+     * @return name of the subject the record was logged to, the same as LogMessage::get_subject_name()
+     */
+    std::string_view get_subject_name(Record const & record) const {
+        return record.dynamic_subject.empty() ? std::string_view(this->subject_names[record.subject]) : record.dynamic_subject;
+    }
+
+
+    /**
+     * Formats the record the same way as the ostream callback of Log:
+     *   [HH:MM:SS] subject context_key=value message field_key=value
+     */
+    std::string to_text(Record const & record) {
+        auto text = "[" + this->get_time_string(record) + "] " + std::string(this->get_subject_name(record)) + " ";
+        for (auto const & [key, value] : record.context) {
+            if (!key.empty()) {
+                text.append(key);
+                text += '=';
+            }
+            text.append(value);
+            text += ' ';
+        }
+        text.append(record.string);
+        LogFields(record.fields.data(), record.fields.size()).append_text(text);
+        return text;
+    }
+};
+
+
+} // end namespace xl::log
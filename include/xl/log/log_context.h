@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace xl::log {
+
+
+/**
+ * One key/value pair of the context a thread is logging in, linked to the pair added before it.  Each LogMessage
+ *   points at the innermost pair of the thread which logged it, so attaching context to a message is a pointer
+ *   copy and nothing is turned into text unless a callback or sink asks for it.
+ */
+class LogContext {
+
+    friend class LogContextGuard;
+
+    // innermost context of each thread - null when there is none
+    static inline thread_local LogContext const * current = nullptr;
+
+public:
+
+    // if empty, only the value is shown
+    std::string key;
+    std::string value;
+
+    // added before this one - null for the outermost
+    LogContext const * parent = nullptr;
+
+
+    LogContext() = default;
+
+    LogContext(std::string key, std::string value) :
+        key(std::move(key)),
+        value(std::move(value))
+    {}
+
+
+    /**
+     * @return innermost context of the calling thread, or null if there is none
+     */
+    static LogContext const * get_current() {
+        return current;
+    }
+
+
+    /**
+     * Calls callback(LogContext const &) on each pair from the outermost to context itself
+     */
+    template<class CallbackT>
+    static void for_each(LogContext const * context, CallbackT && callback) {
+        if (context != nullptr) {
+            for_each(context->parent, callback);
+            callback(*context);
+        }
+    }
+
+
+    /**
+     * @return number of characters write() will produce
+     */
+    static size_t get_length(LogContext const * context) {
+        size_t length = 0;
+        for_each(context, [&length](LogContext const & pair) {
+            length += (pair.key.empty() ? 0 : pair.key.length() + 1) + pair.value.length() + 1;
+        });
+        return length;
+    }
+
+
+    /**
+     * Writes each pair as "key=value " (or "value " without a key), outermost first
+     */
+    static char * write(LogContext const * context, char * buffer) {
+        for_each(context, [&buffer](LogContext const & pair) {
+            if (!pair.key.empty()) {
+                buffer = std::copy(pair.key.begin(), pair.key.end(), buffer);
+                *buffer++ = '=';
+            }
+            buffer = std::copy(pair.value.begin(), pair.value.end(), buffer);
+            *buffer++ = ' ';
+        });
+        return buffer;
+    }
+
+
+    static void write(LogContext const * context, std::ostream & ostream) {
+        for_each(context, [&ostream](LogContext const & pair) {
+            if (!pair.key.empty()) {
+                ostream << pair.key << '=';
+            }
+            ostream << pair.value << ' ';
+        });
+    }
+
+
+    /**
+     * Copies the pairs up to context into copies, reusing their strings' buffers, for a message which will be
+     *   used after the thread which logged it has moved on
+     * @return the copy of context, or null if context is null
+     */
+    static LogContext const * copy(LogContext const * context, std::vector<LogContext> & copies) {
+        size_t count = 0;
+        for (auto pair = context; pair != nullptr; pair = pair->parent) {
+            count++;
+        }
+        copies.resize(count);
+
+        auto index = count;
+        for (auto pair = context; pair != nullptr; pair = pair->parent) {
+            index--;
+            copies[index].key.assign(pair->key);
+            copies[index].value.assign(pair->value);
+        }
+        for (size_t i = 0; i < count; i++) {
+            copies[i].parent = i == 0 ? nullptr : &copies[i - 1];
+        }
+        return count == 0 ? nullptr : &copies.back();
+    }
+};
+
+
+/**
+ * Adds a key/value pair to every message logged by the current thread for as long as the guard exists:
+ *
+ *   LogContextGuard request("request", request_id);
+ *   log.info("started"); // callbacks see request=<request_id> attached to the message
+ *
+ * Guards must be destroyed in the reverse order they were created in, which local variables always are.
+ */
+class LogContextGuard {
+
+    LogContext owned_context;
+    LogContext & context;
+
+
+    void push() {
+        this->context.parent = LogContext::current;
+        LogContext::current = &this->context;
+    }
+
+
+public:
+
+    LogContextGuard(std::string key, std::string value) :
+        owned_context(std::move(key), std::move(value)),
+        context(this->owned_context)
+    {
+        this->push();
+    }
+
+
+    template<class T, std::enable_if_t<std::is_arithmetic_v<T>> * = nullptr>
+    LogContextGuard(std::string key, T value) :
+        LogContextGuard(std::move(key), std::to_string(value))
+    {}
+
+
+    /**
+     * Adds an existing pair instead of building a new one, so a pair added over and over is only built once.
+     *   context must not be in use by any other guard at the same time.
+     */
+    explicit LogContextGuard(LogContext & context) :
+        context(context)
+    {
+        this->push();
+    }
+
+    LogContextGuard(LogContextGuard const &) = delete;
+    LogContextGuard & operator=(LogContextGuard const &) = delete;
+
+
+    ~LogContextGuard() {
+        LogContext::current = this->context.parent;
+    }
+};
+
+
+} // end namespace xl::log
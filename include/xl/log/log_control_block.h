@@ -0,0 +1,557 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../exceptions.h"
+#include "../library_extensions.h"
+
+namespace xl::log {
+
+
+class LogControlBlockException : public xl::FormattedException {
+
+public:
+
+    using xl::FormattedException::FormattedException;
+};
+
+
+/**
+ * Level and subject statuses and filter patterns of a log, kept in a memory-mapped file (typically under /dev/shm)
+ *   so another process - such as log_gui - can change them by writing to memory instead of editing the status file.
+ *
+ * Anyone changing the block bumps its generation counter after the change, so the log only has to compare the
+ *   generation against the one it last saw to know whether to pick up a change.  Status bits are laid out like
+ *   Log::StatusesT: one bit per level followed by one bit per subject, then one bit for each subject added with
+ *   Log::add_subject(), in the order the log added them to the block.  Filter patterns are guarded by a sequence
+ *   number, odd while they're being written, so they're never read half written.  Readers and writers only wait
+ *   so long for the patterns, and the process writing them is recorded, so a controller which dies partway
+ *   through a write can't leave every log waiting on it.
+ */
+class LogControlBlock {
+
+public:
+
+    static constexpr uint64_t magic = 0x34424347'4f4c4c58; // "XLLOGCB4"
+    static constexpr size_t max_status_bits = 1024;
+    static constexpr size_t max_filter_length = 4096;
+    static constexpr size_t max_names_length = 16384;
+
+    // times the filter patterns are tried before giving up on a writer which is taking too long
+    static constexpr size_t max_filter_attempts = 4096;
+
+private:
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "control block atomics must be lock free to be shared between processes");
+
+    struct Layout {
+        std::atomic<uint64_t> magic;
+        uint32_t level_count;
+        uint32_t subject_count;
+        uint32_t names_length;
+
+        std::atomic<uint64_t> generation;
+        std::atomic<uint64_t> statuses[max_status_bits / 64];
+
+        // each pattern on its own line, prefixed with + for include patterns or - for exclude patterns.  While
+        //   filter_writer holds the id of a process, only it may change filter_sequence and the patterns.
+        std::atomic<int32_t> filter_writer;
+        std::atomic<uint64_t> filter_sequence;
+        std::atomic<uint32_t> filter_length;
+        char filter[max_filter_length];
+
+        // level names followed by subject names, each followed by a null
+        char names[max_names_length];
+
+        // names of subjects added with Log::add_subject(), each followed by a null.  Only the log appends to them,
+        //   and only counts a name once it's all written.
+        std::atomic<uint32_t> dynamic_subject_count;
+        uint32_t dynamic_names_length;
+        char dynamic_names[max_names_length];
+
+        // messages sent to callbacks, on its own cache line since only the log's process writes it
+        alignas(64) std::atomic<uint64_t> message_count;
+    };
+
+    std::string path;
+    Layout * layout = nullptr;
+    bool existing_contents_used = false;
+
+
+    void map(std::string const & path, int flags) {
+        auto file_descriptor = ::open(path.c_str(), flags, 0644);
+        if (file_descriptor == -1) {
+            throw LogControlBlockException("Could not open log control block: " + path);
+        }
+        struct stat file_status{};
+        bool sized = ::fstat(file_descriptor, &file_status) == 0 &&
+            (static_cast<size_t>(file_status.st_size) >= sizeof(Layout) || ::ftruncate(file_descriptor, sizeof(Layout)) == 0);
+        void * memory = sized ? ::mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0) : MAP_FAILED;
+        ::close(file_descriptor);
+        if (memory == MAP_FAILED) {
+            throw LogControlBlockException("Could not map log control block: " + path);
+        }
+        this->layout = static_cast<Layout *>(memory);
+    }
+
+
+    static std::string join_names(std::vector<std::string> const & level_names, std::vector<std::string> const & subject_names) {
+        std::string names;
+        for (auto const & list : {&level_names, &subject_names}) {
+            for (auto const & name : *list) {
+                names += name;
+                names += '\0';
+            }
+        }
+        return names;
+    }
+
+
+    static std::vector<std::string> get_names(char const * names, size_t names_length, size_t first, size_t count) {
+        std::vector<std::string> result;
+        auto name = names;
+        for (size_t i = 0; i < first + count && name < names + names_length; i++) {
+            size_t length = ::strnlen(name, names + names_length - name);
+            if (i >= first) {
+                result.emplace_back(name, length);
+            }
+            name += length + 1;
+        }
+        return result;
+    }
+
+
+public:
+
+    /**
+     * Opens a control block created by a log, for a process controlling it
+     * @throw LogControlBlockException if path can't be mapped or doesn't hold a control block
+     */
+    explicit LogControlBlock(std::string path) :
+        path(std::move(path))
+    {
+        this->map(this->path, O_RDWR);
+        if (this->layout->magic.load() != magic) {
+            ::munmap(this->layout, sizeof(Layout));
+            throw LogControlBlockException("Not a log control block: " + this->path);
+        }
+        this->existing_contents_used = true;
+    }
+
+
+    /**
+     * Opens the control block at path for the log with these names, creating it if needed.  If it already holds a
+     *   block for the same names, its statuses and filters are kept - otherwise it's reset to everything enabled
+     *   and no filters.
+     * @throw LogControlBlockException if path can't be mapped or the names don't fit
+     */
+    LogControlBlock(std::string path, std::vector<std::string> const & level_names, std::vector<std::string> const & subject_names) :
+        path(std::move(path))
+    {
+        auto names = join_names(level_names, subject_names);
+        if (level_names.size() + subject_names.size() > max_status_bits || names.length() > max_names_length) {
+            throw LogControlBlockException("Too many levels and subjects for log control block: " + this->path);
+        }
+        this->map(this->path, O_RDWR | O_CREAT);
+
+        auto & layout = *this->layout;
+        if (layout.magic.load() == magic && layout.level_count == level_names.size() &&
+            layout.subject_count == subject_names.size() && layout.names_length == names.length() &&
+            std::memcmp(layout.names, names.data(), names.length()) == 0) {
+            this->existing_contents_used = true;
+            return;
+        }
+
+        layout.magic.store(0);
+        layout.level_count = static_cast<uint32_t>(level_names.size());
+        layout.subject_count = static_cast<uint32_t>(subject_names.size());
+        layout.names_length = static_cast<uint32_t>(names.length());
+        std::memcpy(layout.names, names.data(), names.length());
+        for (size_t i = 0; i < max_status_bits; i++) {
+            this->set_status(i, i < level_names.size() + subject_names.size());
+        }
+        layout.filter_writer.store(0);
+        layout.filter_sequence.store(0);
+        layout.filter_length.store(0);
+        layout.dynamic_subject_count.store(0);
+        layout.dynamic_names_length = 0;
+        layout.message_count.store(0);
+        layout.magic.store(magic);
+        layout.generation.fetch_add(1);
+    }
+
+
+    LogControlBlock(LogControlBlock const &) = delete;
+    LogControlBlock & operator=(LogControlBlock const &) = delete;
+
+
+    ~LogControlBlock() {
+        ::munmap(this->layout, sizeof(Layout));
+    }
+
+
+    std::string const & get_path() const {
+        return this->path;
+    }
+
+
+    /**
+     * @return whether the block already held statuses for the same levels and subjects when it was opened
+     */
+    bool is_existing_contents_used() const {
+        return this->existing_contents_used;
+    }
+
+
+    /**
+     * Changes whenever anything in the block changes
+     */
+    uint64_t get_generation() const {
+        return this->layout->generation.load(std::memory_order_acquire);
+    }
+
+
+    size_t get_level_count() const {
+        return this->layout->level_count;
+    }
+
+
+    size_t get_subject_count() const {
+        return this->layout->subject_count;
+    }
+
+
+    std::vector<std::string> get_level_names() const {
+        return get_names(this->layout->names, this->layout->names_length, 0, this->layout->level_count);
+    }
+
+
+    std::vector<std::string> get_subject_names() const {
+        return get_names(this->layout->names, this->layout->names_length, this->layout->level_count, this->layout->subject_count);
+    }
+
+
+    /**
+     * @return number of subjects added with Log::add_subject() which have a status in the block
+     */
+    size_t get_dynamic_subject_count() const {
+        return this->layout->dynamic_subject_count.load(std::memory_order_acquire);
+    }
+
+
+    /**
+     * @return names of the subjects added with Log::add_subject(), in the order of their statuses
+     */
+    std::vector<std::string> get_dynamic_subject_names() const {
+        return get_names(this->layout->dynamic_names, max_names_length, 0, this->get_dynamic_subject_count());
+    }
+
+
+    /**
+     * @param index position of the subject in get_dynamic_subject_names()
+     * @return index of its status for get_status() and set_status()
+     */
+    size_t get_dynamic_subject_status_index(size_t index) const {
+        return this->layout->level_count + this->layout->subject_count + index;
+    }
+
+
+    /**
+     * @return position of the named subject in get_dynamic_subject_names(), or nothing if it isn't in the block
+     */
+    std::optional<size_t> find_dynamic_subject(std::string_view name) const {
+        auto names = this->get_dynamic_subject_names();
+        auto found = std::find(names.begin(), names.end(), name);
+        return found == names.end() ? std::optional<size_t>() : std::optional<size_t>(found - names.begin());
+    }
+
+
+    /**
+     * Gives a subject added with Log::add_subject() a status in the block.  Only called by the log, which is the
+     *   only process adding names.  Doesn't bump the generation, since the log already knows about it.
+     * @return position of the subject in get_dynamic_subject_names(), or nothing if the block is full
+     */
+    std::optional<size_t> add_dynamic_subject(std::string_view name, bool status) {
+        auto & layout = *this->layout;
+        auto index = layout.dynamic_subject_count.load(std::memory_order_relaxed);
+        if (this->get_dynamic_subject_status_index(index) >= max_status_bits ||
+            layout.dynamic_names_length + name.length() + 1 > max_names_length) {
+            return {};
+        }
+        std::memcpy(layout.dynamic_names + layout.dynamic_names_length, name.data(), name.length());
+        layout.dynamic_names[layout.dynamic_names_length + name.length()] = '\0';
+        layout.dynamic_names_length += static_cast<uint32_t>(name.length() + 1);
+
+        auto bit = uint64_t(1) << (this->get_dynamic_subject_status_index(index) % 64);
+        auto & word = layout.statuses[this->get_dynamic_subject_status_index(index) / 64];
+        if (status) {
+            word.fetch_or(bit, std::memory_order_relaxed);
+        } else {
+            word.fetch_and(~bit, std::memory_order_relaxed);
+        }
+        layout.dynamic_subject_count.store(index + 1, std::memory_order_release);
+        return index;
+    }
+
+
+    /**
+     * @param index level index, level count plus subject index, or get_dynamic_subject_status_index()
+     */
+    bool get_status(size_t index) const {
+        return (this->layout->statuses[index / 64].load(std::memory_order_relaxed) >> (index % 64)) & 1;
+    }
+
+
+    /**
+     * Changes one status and bumps the generation so the log picks it up
+     * @param index level index, level count plus subject index, or get_dynamic_subject_status_index()
+     */
+    void set_status(size_t index, bool new_status) {
+        auto bit = uint64_t(1) << (index % 64);
+        if (new_status) {
+            this->layout->statuses[index / 64].fetch_or(bit, std::memory_order_relaxed);
+        } else {
+            this->layout->statuses[index / 64].fetch_and(~bit, std::memory_order_relaxed);
+        }
+        this->layout->generation.fetch_add(1, std::memory_order_release);
+    }
+
+
+    /**
+     * Called by the log for each message it sends to its callbacks
+     */
+    void count_message() {
+        this->layout->message_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+    /**
+     * @return messages the log has sent to its callbacks since the block was created - sampled over time by a
+     *   controller to show how fast the process is logging
+     */
+    uint64_t get_message_count() const {
+        return this->layout->message_count.load(std::memory_order_relaxed);
+    }
+
+
+    template<class StatusesT>
+    StatusesT get_statuses() const {
+        StatusesT statuses;
+        for (size_t i = 0; i < statuses.size(); i++) {
+            statuses[i] = this->get_status(i);
+        }
+        return statuses;
+    }
+
+
+    /**
+     * @param include_patterns filled with the include patterns
+     * @param exclude_patterns filled with the exclude patterns
+     * @return false if the patterns were being written the whole time they were tried - both are left alone
+     */
+    bool get_filters(std::vector<std::string> & include_patterns, std::vector<std::string> & exclude_patterns) const {
+        char filter[max_filter_length];
+        uint32_t length = 0;
+        bool read = false;
+        for (size_t attempt = 0; attempt < max_filter_attempts && !read; attempt++) {
+            auto sequence = this->layout->filter_sequence.load(std::memory_order_acquire);
+            if (sequence % 2 == 0) {
+                length = std::min<uint32_t>(this->layout->filter_length.load(std::memory_order_relaxed), max_filter_length);
+                std::memcpy(filter, this->layout->filter, length);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                read = this->layout->filter_sequence.load(std::memory_order_relaxed) == sequence;
+            }
+            if (!read) {
+                std::this_thread::yield();
+            }
+        }
+        if (!read) {
+            return false;
+        }
+
+        include_patterns.clear();
+        exclude_patterns.clear();
+        std::string_view lines(filter, length);
+        while (!lines.empty()) {
+            auto line = lines.substr(0, lines.find('\n'));
+            lines.remove_prefix(std::min(lines.length(), line.length() + 1));
+            if (!line.empty()) {
+                (line[0] == '-' ? exclude_patterns : include_patterns).emplace_back(line.substr(1));
+            }
+        }
+        return true;
+    }
+
+
+private:
+
+    static bool is_dead(int32_t process_id) {
+        return process_id != 0 && ::kill(process_id, 0) == -1 && errno == ESRCH;
+    }
+
+
+    static std::string join_filters(std::vector<std::string> const & include_patterns, std::vector<std::string> const & exclude_patterns) {
+        std::string filter;
+        for (auto const & [prefix, patterns] : {std::pair{'+', &include_patterns}, std::pair{'-', &exclude_patterns}}) {
+            for (auto const & pattern : *patterns) {
+                if (pattern.find('\n') != std::string::npos) {
+                    throw LogControlBlockException("Log control block filter patterns can't contain newlines");
+                }
+                filter += prefix;
+                filter += pattern;
+                filter += '\n';
+            }
+        }
+        if (filter.length() > max_filter_length) {
+            throw LogControlBlockException("Filter patterns too long for log control block");
+        }
+        return filter;
+    }
+
+
+XL_PRIVATE_UNLESS_TESTING:
+
+    /**
+     * Takes the filter patterns for this process to write and makes the sequence odd.  A writer whose process has
+     *   died is taken over from.
+     * @param wait whether to wait for a writer which is still running - otherwise only a free or abandoned
+     *   write is taken
+     * @return the odd sequence to pass to end_filter_write(), or nothing if another process kept the patterns
+     *   too long
+     */
+    std::optional<uint64_t> begin_filter_write(bool wait) {
+        auto process_id = static_cast<int32_t>(::getpid());
+        for (size_t attempt = 0; attempt < max_filter_attempts; attempt++) {
+            auto writer = this->layout->filter_writer.load();
+            if ((writer == 0 || is_dead(writer)) && this->layout->filter_writer.compare_exchange_strong(writer, process_id)) {
+                // a writer which died partway through has already made it odd
+                auto sequence = this->layout->filter_sequence.load();
+                if (sequence % 2 == 0) {
+                    this->layout->filter_sequence.store(++sequence);
+                }
+                std::atomic_thread_fence(std::memory_order_release);
+                return sequence;
+            }
+            if (!wait) {
+                return {};
+            }
+            std::this_thread::yield();
+        }
+        return {};
+    }
+
+
+    void end_filter_write(uint64_t sequence) {
+        this->layout->filter_sequence.store(sequence + 1, std::memory_order_release);
+        this->layout->filter_writer.store(0, std::memory_order_release);
+        this->layout->generation.fetch_add(1, std::memory_order_release);
+    }
+
+
+private:
+
+    void write_filters(uint64_t sequence, std::string const & filter) {
+        std::memcpy(this->layout->filter, filter.data(), filter.length());
+        this->layout->filter_length.store(static_cast<uint32_t>(filter.length()), std::memory_order_relaxed);
+        this->end_filter_write(sequence);
+    }
+
+
+public:
+
+
+    /**
+     * Replaces the filter patterns and bumps the generation so the log picks them up
+     * @throw LogControlBlockException if they don't fit, a pattern contains a newline, or another process kept
+     *   them for too long
+     */
+    void set_filters(std::vector<std::string> const & include_patterns, std::vector<std::string> const & exclude_patterns) {
+        auto filter = join_filters(include_patterns, exclude_patterns);
+        auto sequence = this->begin_filter_write(true);
+        if (!sequence) {
+            throw LogControlBlockException("Log control block filter patterns are being written by another process");
+        }
+        this->write_filters(*sequence, filter);
+    }
+
+
+    /**
+     * Replaces the filter patterns only if the process which was writing them died partway through, so they can
+     *   be read again
+     * @return whether they were replaced
+     */
+    bool recover_filters(std::vector<std::string> const & include_patterns, std::vector<std::string> const & exclude_patterns) {
+        auto filter = join_filters(include_patterns, exclude_patterns);
+        if (!is_dead(this->layout->filter_writer.load())) {
+            return false;
+        }
+        auto sequence = this->begin_filter_write(false);
+        if (!sequence) {
+            return false;
+        }
+        this->write_filters(*sequence, filter);
+        return true;
+    }
+
+
+    /**
+     * Writes a log's own changes to the block, touching only the statuses which differ so concurrent changes by
+     *   a controller to other statuses aren't lost
+     * @param seen_generation generation the log's statuses were last brought up to date with
+     * @param dynamic_statuses position in get_dynamic_subject_names() and status of subjects added with
+     *   Log::add_subject()
+     * @return generation the log is now up to date with - still seen_generation if someone else changed the block
+     *   meanwhile, so their change is picked up next time
+     */
+    template<class StatusesT>
+    uint64_t write(uint64_t seen_generation, StatusesT const & statuses,
+                   std::vector<std::string> const & include_patterns, std::vector<std::string> const & exclude_patterns,
+                   std::vector<std::pair<size_t, bool>> const & dynamic_statuses = {}) {
+        // patterns which can't be read or written right now are left for the next write
+        std::vector<std::string> current_include_patterns, current_exclude_patterns;
+        bool filters_changed = this->get_filters(current_include_patterns, current_exclude_patterns) &&
+            (current_include_patterns != include_patterns || current_exclude_patterns != exclude_patterns);
+        if (filters_changed) {
+            try {
+                this->set_filters(include_patterns, exclude_patterns);
+            } catch (LogControlBlockException const &) {
+                filters_changed = false;
+            }
+        }
+
+        size_t changes = filters_changed ? 1 : 0;
+        for (size_t i = 0; i < statuses.size(); i++) {
+            if (this->get_status(i) != statuses[i]) {
+                this->set_status(i, statuses[i]);
+                changes++;
+            }
+        }
+        for (auto const & [index, status] : dynamic_statuses) {
+            auto status_index = this->get_dynamic_subject_status_index(index);
+            if (this->get_status(status_index) != status) {
+                this->set_status(status_index, status);
+                changes++;
+            }
+        }
+        auto generation = this->get_generation();
+        return generation == seen_generation + changes ? generation : seen_generation;
+    }
+};
+
+
+} // end namespace xl::log
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "../exceptions.h"
+
+namespace xl::log {
+
+
+class LogCrashHandlerException : public xl::FormattedException {
+
+public:
+
+    using xl::FormattedException::FormattedException;
+};
+
+
+/**
+ * Writes out log messages still held in memory when the process is killed by a crash signal, then lets the signal
+ *   kill the process as it would have otherwise.
+ *
+ * Anything holding messages in memory (LogFileSink, Log::enable_crash_drain()) registers a drain function.  When
+ *   one of the installed signals arrives, the handler calls each drain function, puts back whatever handled the
+ *   signal before install() and raises the signal again.  Drain functions run inside a signal handler while other
+ *   threads may be in the middle of anything, so they must only use async-signal-safe calls such as write(2) - no
+ *   locks, no allocation, no stdio.
+ */
+class LogCrashHandler {
+
+public:
+
+    using DrainFunction = void (*)(void * context);
+
+    static constexpr size_t max_drains = 32;
+
+private:
+
+    // only ever has static storage duration, so starts out zeroed
+    struct Drain {
+        std::atomic<DrainFunction> function;
+        std::atomic<void *> context;
+    };
+
+    static inline Drain drains[max_drains];
+
+    // only the first thread to crash drains - anything after that may be crashing because of the drain itself
+    static inline std::atomic<bool> draining{false};
+
+    // only used outside of the signal handler
+    static inline std::mutex mutex;
+    static inline struct sigaction previous_actions[NSIG];
+    static inline bool installed_signals[NSIG] = {};
+    static inline std::unique_ptr<char[]> alternate_stack;
+
+
+    static void handle_signal(int signal_number, siginfo_t *, void *) {
+        if (!draining.exchange(true)) {
+            drain();
+        }
+
+        // the signal is blocked until this handler returns, so it's delivered to the previous action right after
+        sigaction(signal_number, &previous_actions[signal_number], nullptr);
+        raise(signal_number);
+    }
+
+
+public:
+
+    /**
+     * Sets the handler for the given signals.  The first call also gives the calling thread an alternate signal
+     *   stack so a stack overflow on that thread can still be drained.  Calling it again for a signal already
+     *   installed does nothing.
+     */
+    static void install(std::initializer_list<int> signals = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!alternate_stack) {
+            size_t stack_size = 64 * 1024;
+            alternate_stack = std::make_unique<char[]>(stack_size);
+            stack_t stack{};
+            stack.ss_sp = alternate_stack.get();
+            stack.ss_size = stack_size;
+            stack.ss_flags = 0;
+            sigaltstack(&stack, nullptr);
+        }
+
+        for (auto signal_number : signals) {
+            if (signal_number <= 0 || signal_number >= NSIG) {
+                throw LogCrashHandlerException("Invalid signal number: " + std::to_string(signal_number));
+            }
+            if (installed_signals[signal_number]) {
+                continue;
+            }
+            struct sigaction action{};
+            action.sa_sigaction = &handle_signal;
+            action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+            sigemptyset(&action.sa_mask);
+            if (sigaction(signal_number, &action, &previous_actions[signal_number]) != 0) {
+                throw LogCrashHandlerException("Could not install handler for signal " + std::to_string(signal_number));
+            }
+            installed_signals[signal_number] = true;
+        }
+    }
+
+
+    /**
+     * Puts back the handlers which were in place before install()
+     */
+    static void uninstall() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int signal_number = 1; signal_number < NSIG; signal_number++) {
+            if (installed_signals[signal_number]) {
+                sigaction(signal_number, &previous_actions[signal_number], nullptr);
+                installed_signals[signal_number] = false;
+            }
+        }
+    }
+
+
+    /**
+     * @param function called with context when a crash signal arrives - must be async-signal-safe
+     * @return id to pass to remove_drain()
+     * @throw LogCrashHandlerException if max_drains are already registered
+     */
+    static size_t add_drain(DrainFunction function, void * context) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < max_drains; i++) {
+            if (drains[i].function.load() == nullptr) {
+                drains[i].context.store(context);
+                drains[i].function.store(function);
+                return i;
+            }
+        }
+        throw LogCrashHandlerException("Too many crash drains registered");
+    }
+
+
+    /**
+     * Once this returns, the drain won't be started - but one already running in a crashing thread may still finish
+     */
+    static void remove_drain(size_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        drains[id].function.store(nullptr);
+    }
+
+
+    /**
+     * Calls every registered drain function, in the order they were added.  Called by the signal handler, but may
+     *   also be called directly.
+     */
+    static void drain() {
+        for (auto & drain : drains) {
+            if (auto function = drain.function.load()) {
+                function(drain.context.load());
+            }
+        }
+    }
+
+
+    /**
+     * Writes all of length bytes to the file descriptor using only async-signal-safe calls
+     * @return false if the write failed
+     */
+    static bool write_all(int file_descriptor, char const * data, size_t length) {
+        while (length > 0) {
+            auto result = ::write(file_descriptor, data, length);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += result;
+            length -= static_cast<size_t>(result);
+        }
+        return true;
+    }
+};
+
+
+} // end namespace xl::log
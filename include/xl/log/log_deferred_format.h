@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#ifdef XL_USE_LIB_FMT
+#include <fmt/format.h>
+#endif
+
+namespace xl::log {
+
+
+/**
+ * A format string and copies of its arguments, stored inline in a fixed-size buffer so the formatting can be
+ * done later on another thread (in the style of NanoLog).  Anything which can be viewed as a string is copied
+ * into a std::string, since what it points to may be gone by the time the message is formatted.  Everything
+ * else is copied by value.
+ *
+ * Only the pointer to the format string is kept, so the format string itself must outlive the object -
+ * string literals are the intended use.
+ */
+class LogDeferredFormat {
+
+public:
+
+    static constexpr size_t capacity = 128;
+
+    // the type an argument of type T is stored as
+    template<class T>
+    using CapturedT = std::conditional_t<std::is_convertible_v<T const &, std::string_view>, std::string, std::decay_t<T>>;
+
+    // whether arguments of the given types fit in the inline buffer
+    template<class... Ts>
+    static constexpr bool fits = sizeof(std::tuple<CapturedT<Ts>...>) <= capacity &&
+                                 alignof(std::tuple<CapturedT<Ts>...>) <= alignof(std::max_align_t);
+
+private:
+
+    alignas(std::max_align_t) std::byte storage[capacity];
+    char const * format_string = nullptr;
+
+    // formats the stored arguments into out (unless it's null) and then destroys them
+    void (*format_and_destroy)(char const * format_string, std::byte * storage, std::string * out) = nullptr;
+
+
+public:
+
+    LogDeferredFormat() = default;
+    LogDeferredFormat(LogDeferredFormat const &) = delete;
+    LogDeferredFormat & operator=(LogDeferredFormat const &) = delete;
+
+    ~LogDeferredFormat() {
+        this->reset();
+    }
+
+
+    bool empty() const {
+        return this->format_and_destroy == nullptr;
+    }
+
+
+    /**
+     * @return format string of the stored message, or null if empty
+     */
+    char const * get_format_string() const {
+        return this->empty() ? nullptr : this->format_string;
+    }
+
+
+#ifdef XL_USE_LIB_FMT
+    /**
+     * Stores the format string pointer and copies of the arguments, replacing anything previously stored
+     */
+    template<class... Ts>
+    void capture(char const * format_string, Ts && ... args) {
+        static_assert(fits<Ts...>, "arguments too large to defer formatting");
+        using ArgumentsT = std::tuple<CapturedT<Ts>...>;
+
+        this->reset();
+        new (this->storage) ArgumentsT(std::forward<Ts>(args)...);
+        this->format_string = format_string;
+        this->format_and_destroy = [](char const * format_string, std::byte * storage, std::string * out) {
+            auto & arguments = *std::launder(reinterpret_cast<ArgumentsT *>(storage));
+            if (out != nullptr) {
+                out->clear();
+                try {
+                    std::apply([&](auto const & ... args) {
+                        fmt::format_to(std::back_inserter(*out), format_string, args...);
+                    }, arguments);
+                } catch (std::exception const & e) {
+                    // the thread doing the formatting isn't the one which logged the message, so there's
+                    //   nobody to throw to
+                    *out = std::string("Error formatting log message \"") + format_string + "\": " + e.what();
+                }
+            }
+            arguments.~ArgumentsT();
+        };
+    }
+#endif
+
+
+    /**
+     * Formats the stored message into out, reusing its buffer, and empties this object
+     */
+    void format_to(std::string & out) {
+        if (!this->empty()) {
+            this->format_and_destroy(this->format_string, this->storage, &out);
+            this->format_and_destroy = nullptr;
+        }
+    }
+
+
+    /**
+     * Destroys the stored arguments without formatting them
+     */
+    void reset() {
+        if (!this->empty()) {
+            this->format_and_destroy(this->format_string, this->storage, nullptr);
+            this->format_and_destroy = nullptr;
+        }
+    }
+};
+
+
+} // end namespace xl::log
@@ -39,12 +39,33 @@ public:
 };
 
 
+// true if T provides `static constexpr Levels minimum_level`
+template<class T, class = void>
+struct has_minimum_level : std::false_type {};
+
+template<class T>
+struct has_minimum_level<T, std::void_t<decltype(T::minimum_level)>> : std::true_type {};
+
+
 template<class T>
 struct LogLevelsBase {
 
     using Levels = typename T::Levels;
 
 
+    /**
+     * Lowest level compiled into the program - messages below it are removed at compile time.  Levels types may
+     *   provide `static constexpr Levels minimum_level`, otherwise every level is compiled in.
+     */
+    static constexpr Levels get_minimum_level() {
+        if constexpr(has_minimum_level<T>::value) {
+            return T::minimum_level;
+        } else {
+            return static_cast<Levels>(0);
+        }
+    }
+
+
     EnumIterator<typename T::Levels> begin() {
         return EnumIterator<typename T::Levels>();
     }
@@ -62,11 +83,28 @@ struct LogLevelsBase {
         return static_cast<UnderlyingType>(level);
     }
 
+    /**
+     * Whether messages at the given level are compiled in at all
+     */
+    constexpr static bool is_compiled(typename T::Levels level) {
+        return get(level) >= get(get_minimum_level());
+    }
+
     static_assert(get(Levels::LOG_LAST_LEVEL) == sizeof(T::level_names) / sizeof(std::string));
 
 };
 
 
+/**
+ * Wraps a Levels type, removing every level below MinimumLevel at compile time:
+ *   Log<LevelsWithMinimum<DefaultLevels, DefaultLevels::Levels::Warn>>
+ */
+template<class T, typename T::Levels MinimumLevel>
+struct LevelsWithMinimum : T {
+    static constexpr typename T::Levels minimum_level = MinimumLevel;
+};
+
+
 template<class T>
 struct LogSubjectsBase {
 
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace xl::log {
+
+
+enum class LogFieldType : uint8_t {
+    BOOL = 0,
+    INT,
+    UINT,
+    DOUBLE,
+    STRING
+};
+
+
+/**
+ * A named, typed value attached to a log message with kv().  The value is stored as is, not as text, so nothing
+ *   is formatted unless a callback or sink asks for it.  The key and string values are views of the caller's
+ *   strings and, like LogMessage::string, are only valid for the duration of the callback.
+ */
+class LogField {
+
+    struct StringValue {
+        char const * data;
+        size_t length;
+    };
+
+    std::string_view key;
+    LogFieldType type;
+    union {
+        bool boolean;
+        int64_t integer;
+        uint64_t unsigned_integer;
+        double floating_point;
+        StringValue string;
+    } value;
+
+
+public:
+
+    template<class T>
+    LogField(std::string_view key, T const & value) :
+        key(key)
+    {
+        if constexpr(std::is_same_v<T, bool>) {
+            this->type = LogFieldType::BOOL;
+            this->value.boolean = value;
+        } else if constexpr(std::is_integral_v<T> && std::is_signed_v<T>) {
+            this->type = LogFieldType::INT;
+            this->value.integer = value;
+        } else if constexpr(std::is_integral_v<T>) {
+            this->type = LogFieldType::UINT;
+            this->value.unsigned_integer = value;
+        } else if constexpr(std::is_floating_point_v<T>) {
+            this->type = LogFieldType::DOUBLE;
+            this->value.floating_point = value;
+        } else {
+            static_assert(std::is_convertible_v<T const &, std::string_view>,
+                          "log field values must be bool, integer, floating point or string");
+            std::string_view string = value;
+            this->type = LogFieldType::STRING;
+            this->value.string = StringValue{string.data(), string.length()};
+        }
+    }
+
+
+    std::string_view get_key() const {
+        return this->key;
+    }
+
+
+    /**
+     * @return the same value under a different key
+     */
+    LogField with_key(std::string_view key) const {
+        auto result = *this;
+        result.key = key;
+        return result;
+    }
+
+
+    LogFieldType get_type() const {
+        return this->type;
+    }
+
+
+    bool get_bool() const {
+        return this->value.boolean;
+    }
+
+
+    int64_t get_int() const {
+        return this->value.integer;
+    }
+
+
+    uint64_t get_uint() const {
+        return this->value.unsigned_integer;
+    }
+
+
+    double get_double() const {
+        return this->value.floating_point;
+    }
+
+
+    std::string_view get_string() const {
+        return std::string_view(this->value.string.data, this->value.string.length);
+    }
+
+
+    /**
+     * Appends the value as text - strings as they are, numbers in decimal, bools as true/false
+     */
+    void append_value(std::string & out) const {
+        char buffer[32];
+        switch (this->type) {
+            case LogFieldType::BOOL:
+                out += this->value.boolean ? "true" : "false";
+                break;
+            case LogFieldType::INT:
+                out.append(buffer, std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(this->value.integer)));
+                break;
+            case LogFieldType::UINT:
+                out.append(buffer, std::snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(this->value.unsigned_integer)));
+                break;
+            case LogFieldType::DOUBLE: {
+                // the shorter of the two precisions which still reads back as the same value
+                auto length = std::snprintf(buffer, sizeof(buffer), "%.15g", this->value.floating_point);
+                if (std::strtod(buffer, nullptr) != this->value.floating_point) {
+                    length = std::snprintf(buffer, sizeof(buffer), "%.17g", this->value.floating_point);
+                }
+                out.append(buffer, length);
+                break;
+            }
+            case LogFieldType::STRING:
+                out.append(this->value.string.data, this->value.string.length);
+                break;
+        }
+    }
+
+
+    /**
+     * Appends string as a quoted JSON string
+     */
+    static void append_json_string(std::string & out, std::string_view string) {
+        static char const hex_digits[] = "0123456789abcdef";
+        out += '"';
+        for (auto c : string) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        out += "\\u00";
+                        out += hex_digits[c >> 4];
+                        out += hex_digits[c & 0xf];
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+        out += '"';
+    }
+
+
+    /**
+     * Appends the value as JSON - non-finite doubles, which JSON can't represent, become null
+     */
+    void append_json_value(std::string & out) const {
+        if (this->type == LogFieldType::STRING) {
+            append_json_string(out, this->get_string());
+        } else if (this->type == LogFieldType::DOUBLE && !std::isfinite(this->value.floating_point)) {
+            out += "null";
+        } else {
+            this->append_value(out);
+        }
+    }
+};
+
+
+/**
+ * Makes a field to pass along with a message:  log.info(subject, "request done", kv("latency_us", 123), kv("shard", 7))
+ */
+template<class T>
+LogField kv(std::string_view key, T const & value) {
+    return LogField(key, value);
+}
+
+
+/**
+ * The fields attached to a message - a view of fields owned by whoever logged it
+ */
+class LogFields {
+
+    LogField const * fields = nullptr;
+    size_t count = 0;
+
+public:
+
+    LogFields() = default;
+
+    LogFields(LogField const * fields, size_t count) :
+        fields(fields),
+        count(count)
+    {}
+
+
+    LogField const * begin() const {
+        return this->fields;
+    }
+
+
+    LogField const * end() const {
+        return this->fields + this->count;
+    }
+
+
+    size_t size() const {
+        return this->count;
+    }
+
+
+    bool empty() const {
+        return this->count == 0;
+    }
+
+
+    LogField const & operator[](size_t index) const {
+        return this->fields[index];
+    }
+
+
+    /**
+     * Appends " key=value" for each field
+     */
+    void append_text(std::string & out) const {
+        for (auto const & field : *this) {
+            out += ' ';
+            out.append(field.get_key().data(), field.get_key().length());
+            out += '=';
+            field.append_value(out);
+        }
+    }
+
+
+    /**
+     * Appends the fields as a JSON object
+     */
+    void append_json(std::string & out) const {
+        out += '{';
+        for (auto const & field : *this) {
+            if (&field != this->fields) {
+                out += ',';
+            }
+            LogField::append_json_string(out, field.get_key());
+            out += ':';
+            field.append_json_value(out);
+        }
+        out += '}';
+    }
+
+
+    /**
+     * Copies the fields and the strings they point to into copies and text, reusing their storage, for a message
+     *   which will be used after the thread which logged it has moved on.  text is a vector and not a string so
+     *   the copies still point into it after it's swapped with another.
+     * @return view of the copies
+     */
+    LogFields copy(std::vector<LogField> & copies, std::vector<char> & text) const {
+        size_t text_length = 0;
+        for (auto const & field : *this) {
+            text_length += field.get_key().length();
+            if (field.get_type() == LogFieldType::STRING) {
+                text_length += field.get_string().length();
+            }
+        }
+        copies.clear();
+        text.resize(text_length);
+
+        auto position = text.data();
+        auto copy_string = [&position](std::string_view string) {
+            std::memcpy(position, string.data(), string.length());
+            position += string.length();
+            return std::string_view(position - string.length(), string.length());
+        };
+        for (auto const & field : *this) {
+            auto key = copy_string(field.get_key());
+            if (field.get_type() == LogFieldType::STRING) {
+                copies.emplace_back(key, copy_string(field.get_string()));
+            } else {
+                copies.push_back(field.with_key(key));
+            }
+        }
+        return LogFields(copies.data(), copies.size());
+    }
+};
+
+
+} // end namespace xl::log
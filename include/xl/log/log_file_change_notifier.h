@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <unistd.h>
+
+namespace xl::log {
+
+
+/**
+ * Tells when a file has been written or replaced, using inotify on Linux.  It has a file descriptor which becomes
+ *   readable when something happens to the file, so a thread can sleep in poll() until then - or an event loop
+ *   can watch it, like log_gui does with QSocketNotifier - instead of checking the file's timestamp over and over.
+ *
+ * The directory holding the file is watched rather than the file itself, because LogStatusFile::write() replaces
+ *   the file by renaming another one over it and a watch on the file would be left watching the replaced one.
+ *
+ * Where inotify isn't available, is_available() is false and the caller has to fall back to checking the file
+ *   itself every so often.
+ */
+class LogFileChangeNotifier {
+
+    // empty when told about every file in the directory
+    std::string name;
+    int inotify_descriptor = -1;
+
+
+    LogFileChangeNotifier(std::filesystem::path const & directory, std::string name) :
+        name(std::move(name))
+    {
+#ifdef __linux__
+        this->inotify_descriptor = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (this->inotify_descriptor != -1 &&
+            ::inotify_add_watch(this->inotify_descriptor, directory.empty() ? "." : directory.c_str(),
+                                IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) == -1) {
+            ::close(this->inotify_descriptor);
+            this->inotify_descriptor = -1;
+        }
+#else
+        (void)directory;
+#endif
+    }
+
+
+public:
+
+    /**
+     * @param filename file to be told about - it doesn't need to exist yet, but its directory does
+     */
+    explicit LogFileChangeNotifier(std::string const & filename) :
+        LogFileChangeNotifier(std::filesystem::path(filename).parent_path(), std::filesystem::path(filename).filename().string())
+    {}
+
+
+    /**
+     * @return a notifier told about every file in directory being written, replaced or removed - for watching
+     *   many status files at once
+     */
+    static std::unique_ptr<LogFileChangeNotifier> for_directory(std::string const & directory) {
+        return std::unique_ptr<LogFileChangeNotifier>(new LogFileChangeNotifier(std::filesystem::path(directory), std::string()));
+    }
+
+    LogFileChangeNotifier(LogFileChangeNotifier const &) = delete;
+    LogFileChangeNotifier & operator=(LogFileChangeNotifier const &) = delete;
+
+    ~LogFileChangeNotifier() {
+        if (this->inotify_descriptor != -1) {
+            ::close(this->inotify_descriptor);
+        }
+    }
+
+
+    /**
+     * @return whether changes will be reported - if not, the file has to be checked on a timer instead
+     */
+    bool is_available() const {
+        return this->inotify_descriptor != -1;
+    }
+
+
+    /**
+     * @return descriptor which is readable while there are events for read_events() to read, or -1 if
+     *   is_available() is false
+     */
+    int get_file_descriptor() const {
+        return this->inotify_descriptor;
+    }
+
+
+    /**
+     * Reads every event waiting, without blocking
+     * @return whether any of them could have changed the file - including when so many happened that some
+     *   were lost
+     */
+    bool read_events() {
+        auto names = this->read_changed_names();
+        return !names.empty() && (names.back().empty() || this->name.empty() ||
+            std::find(names.begin(), names.end(), this->name) != names.end());
+    }
+
+
+    /**
+     * Reads every event waiting, without blocking
+     * @return names of the files in the directory which changed, each once, with an empty name at the end if so
+     *   many things happened that some were lost and every file should be treated as changed
+     */
+    std::vector<std::string> read_changed_names() {
+        std::vector<std::string> names;
+        bool overflowed = false;
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = ::read(this->inotify_descriptor, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < length;) {
+                auto event = reinterpret_cast<inotify_event const *>(buffer + offset);
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflowed = true;
+                } else if (event->len > 0 && std::find(names.begin(), names.end(), event->name) == names.end()) {
+                    names.emplace_back(event->name);
+                }
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+#endif
+        if (overflowed) {
+            names.emplace_back();
+        }
+        return names;
+    }
+};
+
+
+} // end namespace xl::log
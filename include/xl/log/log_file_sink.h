@@ -0,0 +1,586 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "../exceptions.h"
+#include "log_context.h"
+#include "log_crash_handler.h"
+#include "log_fields.h"
+#include "log_latency_histogram.h"
+#include "log_timestamp.h"
+
+namespace xl::log {
+
+
+class LogFileException : public xl::FormattedException {
+
+public:
+
+    using xl::FormattedException::FormattedException;
+};
+
+
+/**
+ * When LogFileSink asks the operating system to put what it has written on disk
+ */
+enum class FsyncPolicy {
+    NEVER = 0, // only when the operating system decides to
+    INTERVAL,  // after a write, if at least fsync_interval has passed since the last fsync
+    BYTES      // after a write, if at least fsync_bytes have been written since the last fsync
+};
+
+
+struct LogFileSinkOptions {
+
+    // messages are collected in buffers of this size (rounded up to a multiple of 4096) - longer messages are truncated
+    size_t buffer_size = 256 * 1024;
+
+    // how many buffers can be filled while earlier ones are being written.  Logging waits when all of them are full.
+    size_t buffer_count = 8;
+
+    // a partially filled buffer is written after at most this long
+    std::chrono::milliseconds flush_interval{100};
+
+    FsyncPolicy fsync_policy = FsyncPolicy::NEVER;
+    std::chrono::milliseconds fsync_interval{1000};
+    size_t fsync_bytes = 1024 * 1024;
+
+    // a new file is started before a write would make the current one bigger than this - 0 for no limit
+    size_t rotate_size = 0;
+
+    // a new file is started before writing to one older than this - 0 for no limit
+    std::chrono::seconds rotate_interval{0};
+
+    // older files are deleted when a new one would make more than this many, counting any left over from previous
+    //   runs
+    size_t max_files = 4;
+
+    // register with LogCrashHandler so buffers not yet written are written if the process crashes - the handler
+    //   itself is installed with LogCrashHandler::install() or Log::enable_crash_drain()
+    bool drain_on_crash = true;
+};
+
+
+/**
+ * Log callback which writes messages to a text file in the same format as add_callback(std::ostream &).
+ *
+ * The thread logging a message only copies the formatted message into a buffer.  A background thread writes every
+ * buffer filled since its last write with a single writev call, so the cost of the system call (and of any fsync)
+ * is shared by all the messages in the batch.  Files are named <base filename>.<number>.
+ *
+ * Register with log.add_callback(std::ref(sink)) - the sink must outlive its registration.
+ * @tparam LogT type of the log object whose messages will be written
+ */
+template<class LogT>
+class LogFileSink {
+
+    using LogMessage = typename LogT::LogMessage;
+
+    static constexpr size_t alignment = 4096;
+
+    // length and sequence are atomic only so the crash drain can read them without the mutex
+    struct Buffer {
+        std::unique_ptr<char, decltype(&std::free)> data{nullptr, &std::free};
+        std::atomic<size_t> length{0};
+
+        // order buffers were started in, so the crash drain can write them oldest first
+        std::atomic<uint64_t> sequence{0};
+    };
+
+    std::string base_filename;
+    LogFileSinkOptions options;
+
+    std::mutex mutex;
+
+    // the writer thread waits on this for buffers to write, flushes and shutting down
+    std::condition_variable writer_condition;
+
+    // logging threads wait on this for a free buffer and flush() waits on it for the flush to finish
+    std::condition_variable buffer_condition;
+
+    std::vector<Buffer> buffers;
+
+    // buffer messages are being added to - null while all buffers are waiting to be written
+    Buffer * current = nullptr;
+    std::vector<Buffer *> full_buffers;
+    std::vector<Buffer *> free_buffers;
+
+    uint64_t next_sequence = 0;
+    uint64_t flush_requested = 0;
+    uint64_t flush_completed = 0;
+    bool stopping = false;
+
+    std::string current_filename;
+
+    // only used by the writer thread once it has started
+    size_t file_number = 0;
+    std::atomic<int> file_descriptor{-1};
+    size_t file_bytes = 0;
+    std::chrono::steady_clock::time_point file_opened_time;
+    size_t bytes_since_fsync = 0;
+    std::chrono::steady_clock::time_point last_fsync_time;
+    std::vector<iovec> iovecs;
+
+    LogLatencyHistogram write_latency;
+    LogLatencyHistogram fsync_latency;
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> batch_count{0};
+    std::atomic<uint64_t> write_error_count{0};
+
+    // started last, once everything it uses is set up
+    std::thread writer_thread;
+
+    size_t crash_drain_id = 0;
+
+
+    // must hold the mutex
+    void start_buffer(Buffer * buffer) {
+        buffer->sequence.store(++this->next_sequence, std::memory_order_relaxed);
+        this->current = buffer;
+    }
+
+
+    // runs inside a crash signal handler - writes whatever hasn't been written yet, oldest buffer first, using
+    //   nothing but write(2).  A batch the writer thread was in the middle of may end up in the file twice.
+    static void crash_drain(void * context) {
+        auto & sink = *static_cast<LogFileSink *>(context);
+        auto file_descriptor = sink.file_descriptor.load();
+        if (file_descriptor == -1) {
+            return;
+        }
+
+        uint64_t last_sequence = 0;
+        while (true) {
+            Buffer * next = nullptr;
+            for (auto & buffer : sink.buffers) {
+                auto sequence = buffer.sequence.load(std::memory_order_relaxed);
+                if (sequence > last_sequence && buffer.length.load(std::memory_order_acquire) > 0 &&
+                    (next == nullptr || sequence < next->sequence.load(std::memory_order_relaxed))) {
+                    next = &buffer;
+                }
+            }
+            if (next == nullptr) {
+                return;
+            }
+            last_sequence = next->sequence.load(std::memory_order_relaxed);
+            LogCrashHandler::write_all(file_descriptor, next->data.get(), next->length.load(std::memory_order_acquire));
+        }
+    }
+
+
+    std::string get_filename(size_t number) const {
+        return this->base_filename + "." + std::to_string(number);
+    }
+
+
+    // numbers of the files already left over from previous runs, oldest first
+    std::vector<size_t> find_existing_file_numbers() const {
+        std::filesystem::path base_path(this->base_filename);
+        auto directory = base_path.has_parent_path() ? base_path.parent_path() : std::filesystem::path(".");
+        auto prefix = base_path.filename().string() + ".";
+
+        std::vector<size_t> numbers;
+        std::error_code error_code;
+        for (auto const & entry : std::filesystem::directory_iterator(directory, error_code)) {
+            auto name = entry.path().filename().string();
+            auto digits = name.size() - std::min(name.size(), prefix.size());
+            if (digits > 0 && digits < 19 && name.compare(0, prefix.size(), prefix) == 0 &&
+                name.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+                numbers.push_back(std::stoull(name.substr(prefix.size())));
+            }
+        }
+        std::sort(numbers.begin(), numbers.end());
+        return numbers;
+    }
+
+
+    // continues after the newest file left over from a previous run, deleting all but the newest of them so
+    //   there are max_files once the first file is opened
+    void remove_old_files() {
+        auto numbers = this->find_existing_file_numbers();
+        this->file_number = numbers.empty() ? 0 : numbers.back() + 1;
+        for (size_t i = 0; i + this->options.max_files <= numbers.size(); i++) {
+            std::error_code error_code;
+            std::filesystem::remove(this->get_filename(numbers[i]), error_code);
+        }
+    }
+
+
+    void open_next_file() {
+        this->close_file();
+
+        auto filename = this->get_filename(this->file_number);
+        this->file_descriptor = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (this->file_descriptor.load() == -1) {
+            throw LogFileException("Could not open log file: " + filename);
+        }
+        this->file_bytes = 0;
+        this->file_opened_time = std::chrono::steady_clock::now();
+
+        if (this->file_number >= this->options.max_files) {
+            std::error_code error_code;
+            std::filesystem::remove(this->get_filename(this->file_number - this->options.max_files), error_code);
+        }
+        this->file_number++;
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->current_filename = std::move(filename);
+    }
+
+
+    void close_file() {
+        if (this->file_descriptor == -1) {
+            return;
+        }
+        if (this->options.fsync_policy != FsyncPolicy::NEVER) {
+            this->sync();
+        }
+        ::close(this->file_descriptor.exchange(-1));
+    }
+
+
+    void sync() {
+        auto start = std::chrono::steady_clock::now();
+        ::fsync(this->file_descriptor);
+        this->last_fsync_time = std::chrono::steady_clock::now();
+        this->fsync_latency.record(this->last_fsync_time - start);
+        this->bytes_since_fsync = 0;
+    }
+
+
+    bool should_rotate(size_t batch_bytes) const {
+        if (this->file_bytes == 0) {
+            return false;
+        }
+        if (this->options.rotate_size != 0 && this->file_bytes + batch_bytes > this->options.rotate_size) {
+            return true;
+        }
+        return this->options.rotate_interval.count() != 0 &&
+               std::chrono::steady_clock::now() - this->file_opened_time >= this->options.rotate_interval;
+    }
+
+
+    // writes all of iovecs, retrying after partial writes
+    bool write_all() {
+        size_t first = 0;
+        while (first < this->iovecs.size()) {
+            auto count = std::min<size_t>(this->iovecs.size() - first, IOV_MAX);
+            auto result = ::writev(this->file_descriptor, &this->iovecs[first], static_cast<int>(count));
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            auto written = static_cast<size_t>(result);
+            while (first < this->iovecs.size() && written >= this->iovecs[first].iov_len) {
+                written -= this->iovecs[first].iov_len;
+                first++;
+            }
+            if (written > 0) {
+                this->iovecs[first].iov_base = static_cast<char *>(this->iovecs[first].iov_base) + written;
+                this->iovecs[first].iov_len -= written;
+            }
+        }
+        return true;
+    }
+
+
+    void write_batch(std::vector<Buffer *> const & batch) {
+        size_t batch_bytes = 0;
+        this->iovecs.clear();
+        for (auto buffer : batch) {
+            auto length = buffer->length.load(std::memory_order_relaxed);
+            this->iovecs.push_back(iovec{buffer->data.get(), length});
+            batch_bytes += length;
+        }
+
+        if (this->should_rotate(batch_bytes)) {
+            try {
+                this->open_next_file();
+            } catch (LogFileException const &) {
+                this->write_error_count++;
+                return;
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (!this->write_all()) {
+            this->write_error_count++;
+            return;
+        }
+        this->write_latency.record(std::chrono::steady_clock::now() - start);
+
+        this->file_bytes += batch_bytes;
+        this->bytes_since_fsync += batch_bytes;
+        this->bytes_written += batch_bytes;
+        this->batch_count++;
+    }
+
+
+    void apply_fsync_policy(bool flushing) {
+        if (this->bytes_since_fsync == 0 || this->options.fsync_policy == FsyncPolicy::NEVER) {
+            return;
+        }
+        if (flushing ||
+            (this->options.fsync_policy == FsyncPolicy::BYTES && this->bytes_since_fsync >= this->options.fsync_bytes) ||
+            (this->options.fsync_policy == FsyncPolicy::INTERVAL &&
+             std::chrono::steady_clock::now() - this->last_fsync_time >= this->options.fsync_interval)) {
+            this->sync();
+        }
+    }
+
+
+    void write_loop() {
+        std::vector<Buffer *> batch;
+        batch.reserve(this->buffers.size());
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while (true) {
+            this->writer_condition.wait_for(lock, this->options.flush_interval, [this] {
+                return !this->full_buffers.empty() || this->flush_requested != this->flush_completed || this->stopping;
+            });
+
+            // everything filled so far goes in the same write, including the buffer still being filled if there's
+            //   a free one to replace it with
+            batch.swap(this->full_buffers);
+            bool includes_everything = true;
+            if (this->current != nullptr && this->current->length.load(std::memory_order_relaxed) > 0) {
+                if (this->free_buffers.empty()) {
+                    includes_everything = false;
+                } else {
+                    batch.push_back(this->current);
+                    this->start_buffer(this->free_buffers.back());
+                    this->free_buffers.pop_back();
+                }
+            }
+            auto flush_target = this->flush_requested;
+            bool flushing = includes_everything && flush_target != this->flush_completed;
+            bool stop = includes_everything && this->stopping;
+            lock.unlock();
+
+            if (!batch.empty()) {
+                this->write_batch(batch);
+
+                // emptied right away, before anything else can be done, so a crash drain doesn't repeat them
+                for (auto buffer : batch) {
+                    buffer->length.store(0, std::memory_order_release);
+                }
+            }
+            this->apply_fsync_policy(flushing);
+
+            lock.lock();
+            for (auto buffer : batch) {
+                this->free_buffers.push_back(buffer);
+            }
+            batch.clear();
+            if (includes_everything) {
+                this->flush_completed = flush_target;
+            }
+            this->buffer_condition.notify_all();
+            if (stop) {
+                break;
+            }
+        }
+    }
+
+
+public:
+
+    /**
+     * @param base_filename files are named this followed by a period and a number
+     * @throw LogFileException if the first file can't be opened
+     */
+    LogFileSink(std::string base_filename, LogFileSinkOptions options = {}) :
+        base_filename(std::move(base_filename)),
+        options(options)
+    {
+        this->options.buffer_size = (std::max<size_t>(this->options.buffer_size, 1) + alignment - 1) / alignment * alignment;
+        this->options.buffer_count = std::max<size_t>(this->options.buffer_count, 2);
+        this->options.max_files = std::max<size_t>(this->options.max_files, 1);
+
+        this->buffers = std::vector<Buffer>(this->options.buffer_count);
+        for (auto & buffer : this->buffers) {
+            buffer.data.reset(static_cast<char *>(std::aligned_alloc(alignment, this->options.buffer_size)));
+            if (!buffer.data) {
+                throw LogFileException("Could not allocate log file buffers");
+            }
+            this->free_buffers.push_back(&buffer);
+        }
+        this->start_buffer(this->free_buffers.back());
+        this->free_buffers.pop_back();
+
+        this->remove_old_files();
+        this->open_next_file();
+        this->last_fsync_time = std::chrono::steady_clock::now();
+
+        this->writer_thread = std::thread([this] {
+            this->write_loop();
+        });
+
+        if (this->options.drain_on_crash) {
+            this->crash_drain_id = LogCrashHandler::add_drain(&LogFileSink::crash_drain, this);
+        }
+    }
+
+    LogFileSink(LogFileSink const &) = delete;
+    LogFileSink & operator=(LogFileSink const &) = delete;
+
+
+    /**
+     * Writes everything logged so far before returning
+     */
+    ~LogFileSink() {
+        if (this->options.drain_on_crash) {
+            LogCrashHandler::remove_drain(this->crash_drain_id);
+        }
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->writer_condition.notify_one();
+        this->writer_thread.join();
+        this->close_file();
+    }
+
+
+    void operator()(LogMessage const & message) {
+        char time_string[LogTimestampFormatter::max_length];
+        auto time_length = message.get_time_string(time_string, sizeof(time_string));
+        std::string_view subject_name = message.get_subject_name();
+        std::string_view string = message.string;
+
+        // context and fields that don't fit at all are dropped rather than truncated
+        auto context = message.context;
+        auto context_length = LogContext::get_length(context);
+        if (time_length + subject_name.length() + 5 + context_length > this->options.buffer_size) {
+            context = nullptr;
+            context_length = 0;
+        }
+        thread_local std::string field_text;
+        field_text.clear();
+        message.fields.append_text(field_text);
+        if (time_length + subject_name.length() + 5 + context_length + field_text.length() > this->options.buffer_size) {
+            field_text.clear();
+        }
+
+        // [time] subject key=value message key=value\n
+        auto overhead = time_length + subject_name.length() + 5 + context_length + field_text.length();
+        if (overhead + string.length() > this->options.buffer_size) {
+            string = string.substr(0, this->options.buffer_size - std::min(overhead, this->options.buffer_size));
+        }
+        auto length = overhead + string.length();
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while (this->current == nullptr ||
+               this->current->length.load(std::memory_order_relaxed) + length > this->options.buffer_size) {
+            // hand the full buffer to the writer thread and replace it with a free one, waiting if there isn't one
+            if (this->current != nullptr) {
+                this->full_buffers.push_back(this->current);
+                this->current = nullptr;
+                this->writer_condition.notify_one();
+            }
+            if (this->free_buffers.empty()) {
+                this->buffer_condition.wait(lock);
+            } else {
+                this->start_buffer(this->free_buffers.back());
+                this->free_buffers.pop_back();
+            }
+        }
+
+        auto current_length = this->current->length.load(std::memory_order_relaxed);
+        char * position = this->current->data.get() + current_length;
+        *position++ = '[';
+        std::memcpy(position, time_string, time_length);
+        position += time_length;
+        *position++ = ']';
+        *position++ = ' ';
+        std::memcpy(position, subject_name.data(), subject_name.length());
+        position += subject_name.length();
+        *position++ = ' ';
+        position = LogContext::write(context, position);
+        std::memcpy(position, string.data(), string.length());
+        position += string.length();
+        std::memcpy(position, field_text.data(), field_text.length());
+        position += field_text.length();
+        *position++ = '\n';
+
+        // release so a crash drain seeing the new length also sees the text
+        this->current->length.store(current_length + length, std::memory_order_release);
+    }
+
+
+    /**
+     * Blocks until everything logged before this call has been written to the file - and synced to disk, unless
+     *   the fsync policy is NEVER
+     */
+    void flush() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        auto target = ++this->flush_requested;
+        this->writer_condition.notify_one();
+        this->buffer_condition.wait(lock, [this, target] {
+            return this->flush_completed >= target;
+        });
+    }
+
+
+    std::string get_current_filename() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->current_filename;
+    }
+
+
+    /**
+     * How long each batch took to write
+     */
+    LogLatencyHistogram const & get_write_latency() const {
+        return this->write_latency;
+    }
+
+
+    LogLatencyHistogram const & get_fsync_latency() const {
+        return this->fsync_latency;
+    }
+
+
+    uint64_t get_bytes_written() const {
+        return this->bytes_written.load();
+    }
+
+
+    /**
+     * Number of batches written - bytes written divided by this is the average batch size
+     */
+    uint64_t get_batch_count() const {
+        return this->batch_count.load();
+    }
+
+
+    /**
+     * Number of batches which couldn't be written and were discarded
+     */
+    uint64_t get_write_error_count() const {
+        return this->write_error_count.load();
+    }
+};
+
+
+} // end namespace xl::log
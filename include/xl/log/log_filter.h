@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cctype>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../regexer.h"
+
+namespace xl::log {
+
+
+/**
+ * Decides whether a message is sent to the callbacks based on its text.  A message passes if it matches any of the
+ *   include patterns (or there are none) and matches none of the exclude patterns.
+ *
+ * All the include patterns are compiled into a single regex and all the exclude patterns into another, so each
+ *   message is checked with at most two matches no matter how many patterns there are.  Matching only answers
+ *   whether there was a match, so nothing is allocated and the message isn't copied.  Since capture groups are
+ *   numbered across the joined patterns, a pattern which refers to a group by number can only be used on its own -
+ *   refer to a named group instead.
+ */
+class LogFilter {
+
+    std::vector<std::string> include_patterns;
+    std::vector<std::string> exclude_patterns;
+
+    // null if there are no patterns of that kind
+    std::unique_ptr<xl::Regex const> include_regex;
+    std::unique_ptr<xl::Regex const> exclude_regex;
+
+
+    // whether pattern refers to a capture group by its number - a backreference, recursion or condition - which
+    //   would point at a different group once the patterns are joined.  Relative and named references still work.
+    static bool has_numbered_group_reference(std::string_view pattern) {
+        auto is_digit = [](std::string_view rest, size_t index) {
+            return index < rest.length() && std::isdigit(static_cast<unsigned char>(rest[index]));
+        };
+        bool in_class = false;
+        for (size_t i = 0; i < pattern.length(); i++) {
+            auto rest = pattern.substr(i + 1);
+            if (pattern[i] == '\\' && !rest.empty()) {
+                i++;
+                if (rest[0] == 'Q') {
+                    // everything up to \E is literal
+                    auto end = pattern.find("\\E", i);
+                    if (end == std::string_view::npos) {
+                        return false;
+                    }
+                    i = end + 1;
+                } else if (!in_class && (is_digit(rest, 0) && rest[0] != '0' ||
+                                         rest[0] == 'g' && (is_digit(rest, 1) || rest.substr(1, 1) == "{" && is_digit(rest, 2)))) {
+                    return true;
+                }
+            } else if (in_class) {
+                if (rest.substr(0, 1) == ":" && pattern[i] == '[') {
+                    // a POSIX class like [:alpha:] has its own closing bracket
+                    auto end = pattern.find(":]", i);
+                    i = end == std::string_view::npos ? pattern.length() : end + 1;
+                } else if (pattern[i] == ']') {
+                    in_class = false;
+                }
+            } else if (pattern[i] == '[') {
+                in_class = true;
+                // a ] right at the start is part of the class
+                if (rest.substr(0, 1) == "^") {
+                    i++;
+                    rest.remove_prefix(1);
+                }
+                if (rest.substr(0, 1) == "]") {
+                    i++;
+                }
+            } else if (pattern[i] == '(' && rest.substr(0, 1) == "?") {
+                // (?1), (?R) and (?(1)...)
+                if (is_digit(rest, 1) || rest.substr(1, 1) == "R" || rest.substr(1, 1) == "(" && is_digit(rest, 2)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+
+    static std::unique_ptr<xl::Regex const> make_regex(std::vector<std::string> const & patterns) {
+        if (patterns.empty()) {
+            return {};
+        }
+
+        // compile each pattern on its own first so an invalid one is reported by itself and can't change the
+        //   meaning of the others once they're joined
+        std::string combined_pattern;
+        for (auto const & pattern : patterns) {
+            xl::Regex(pattern, xl::NONE);
+            if (patterns.size() > 1 && has_numbered_group_reference(pattern)) {
+                throw xl::RegexException("Filter pattern refers to a capture group by number, which can't be joined "
+                                         "with other patterns - use a named group instead: " + pattern);
+            }
+            if (!combined_pattern.empty()) {
+                combined_pattern += '|';
+            }
+            combined_pattern += "(?:" + pattern + ")";
+        }
+        // the filter runs on every message, so it's worth compiling to machine code where PCRE can
+        return std::make_unique<xl::Regex const>(combined_pattern, xl::JIT);
+    }
+
+
+public:
+
+    /**
+     * @param include_patterns if not empty, messages must match at least one of these
+     * @param exclude_patterns messages matching any of these are dropped
+     * @throw xl::RegexException if any of the patterns is invalid, or refers to a capture group by number when
+     *   there's more than one pattern of its kind
+     */
+    LogFilter(std::vector<std::string> include_patterns, std::vector<std::string> exclude_patterns = {}) :
+        include_patterns(std::move(include_patterns)),
+        exclude_patterns(std::move(exclude_patterns)),
+        include_regex(make_regex(this->include_patterns)),
+        exclude_regex(make_regex(this->exclude_patterns))
+    {}
+
+    LogFilter(LogFilter const &) = delete;
+    LogFilter & operator=(LogFilter const &) = delete;
+
+
+    /**
+     * @return whether a message with this text should be sent to the callbacks
+     */
+    bool operator()(std::string_view message) const {
+        if (this->include_regex && !this->include_regex->matches(message)) {
+            return false;
+        }
+        if (this->exclude_regex && this->exclude_regex->matches(message)) {
+            return false;
+        }
+        return true;
+    }
+
+
+    /**
+     * @return whether this filter lets every message through
+     */
+    bool empty() const {
+        return !this->include_regex && !this->exclude_regex;
+    }
+
+
+    std::vector<std::string> const & get_include_patterns() const {
+        return this->include_patterns;
+    }
+
+
+    std::vector<std::string> const & get_exclude_patterns() const {
+        return this->exclude_patterns;
+    }
+};
+
+
+} // end namespace xl::log
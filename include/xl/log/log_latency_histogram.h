@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace xl::log {
+
+
+/**
+ * Counts how many times each latency was seen, using buckets whose width grows with the latency so any value from a
+ *   nanosecond to hundreds of years fits while staying within 12.5% of the value recorded.  Recording is lock-free
+ *   and may happen from any number of threads at once.
+ */
+class LogLatencyHistogram {
+
+public:
+
+    // each power of two is split into this many equal width buckets
+    static constexpr size_t sub_bucket_count = 8;
+    static constexpr size_t sub_bucket_bits = 3;
+
+    // values below sub_bucket_count get a bucket each, then sub_bucket_count buckets for each remaining power of two
+    static constexpr size_t bucket_count = sub_bucket_count + (64 - sub_bucket_bits) * sub_bucket_count;
+
+private:
+
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> max_nanoseconds{0};
+
+
+    static int get_highest_bit(uint64_t value) {
+        int bit = 0;
+        while (value >>= 1) {
+            bit++;
+        }
+        return bit;
+    }
+
+
+public:
+
+    static size_t get_bucket_index(uint64_t nanoseconds) {
+        if (nanoseconds < sub_bucket_count) {
+            return nanoseconds;
+        }
+        auto highest_bit = get_highest_bit(nanoseconds);
+        auto sub_bucket = (nanoseconds >> (highest_bit - sub_bucket_bits)) & (sub_bucket_count - 1);
+        return (highest_bit - sub_bucket_bits + 1) * sub_bucket_count + sub_bucket;
+    }
+
+
+    /**
+     * @return smallest latency in nanoseconds which goes in the bucket at the given index
+     */
+    static uint64_t get_bucket_lower_bound(size_t index) {
+        if (index < sub_bucket_count) {
+            return index;
+        }
+        auto highest_bit = index / sub_bucket_count + sub_bucket_bits - 1;
+        auto sub_bucket = index % sub_bucket_count;
+        return (sub_bucket_count + sub_bucket) << (highest_bit - sub_bucket_bits);
+    }
+
+
+    /**
+     * @return largest latency in nanoseconds which goes in the bucket at the given index
+     */
+    static uint64_t get_bucket_upper_bound(size_t index) {
+        return index + 1 < bucket_count ? get_bucket_lower_bound(index + 1) - 1 : UINT64_MAX;
+    }
+
+
+    template<class Rep, class Period>
+    void record(std::chrono::duration<Rep, Period> latency) {
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+        auto value = static_cast<uint64_t>(std::max<decltype(nanoseconds)>(nanoseconds, 0));
+
+        this->buckets[get_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        this->count.fetch_add(1, std::memory_order_relaxed);
+
+        auto max = this->max_nanoseconds.load(std::memory_order_relaxed);
+        while (value > max && !this->max_nanoseconds.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+
+    uint64_t get_count() const {
+        return this->count.load(std::memory_order_relaxed);
+    }
+
+
+    uint64_t get_bucket_count(size_t index) const {
+        return this->buckets[index].load(std::memory_order_relaxed);
+    }
+
+
+    std::chrono::nanoseconds get_max() const {
+        return std::chrono::nanoseconds(this->max_nanoseconds.load(std::memory_order_relaxed));
+    }
+
+
+    /**
+     * @param percentile between 0 and 100 - 99.9 for p999
+     * @return latency which at least this percentage of the recorded latencies are at or below, rounded up to the
+     *   top of its bucket but never more than the largest latency recorded.  0 if nothing has been recorded.
+     */
+    std::chrono::nanoseconds get_percentile(double percentile) const {
+        auto total = this->get_count();
+        if (total == 0) {
+            return {};
+        }
+        auto target = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(total * percentile / 100)), 1);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            seen += this->get_bucket_count(i);
+            if (seen >= target) {
+                auto max = static_cast<uint64_t>(this->get_max().count());
+                return std::chrono::nanoseconds(std::min(get_bucket_upper_bound(i), max));
+            }
+        }
+        return this->get_max();
+    }
+
+
+    /**
+     * Adds everything recorded in other to this histogram
+     */
+    void merge(LogLatencyHistogram const & other) {
+        for (size_t i = 0; i < bucket_count; i++) {
+            if (auto other_count = other.get_bucket_count(i)) {
+                this->buckets[i].fetch_add(other_count, std::memory_order_relaxed);
+            }
+        }
+        this->count.fetch_add(other.get_count(), std::memory_order_relaxed);
+        auto other_max = static_cast<uint64_t>(other.get_max().count());
+        auto max = this->max_nanoseconds.load(std::memory_order_relaxed);
+        while (other_max > max && !this->max_nanoseconds.compare_exchange_weak(max, other_max, std::memory_order_relaxed)) {}
+    }
+
+
+    void reset() {
+        for (auto & bucket : this->buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        this->count.store(0, std::memory_order_relaxed);
+        this->max_nanoseconds.store(0, std::memory_order_relaxed);
+    }
+};
+
+
+} // end namespace xl::log
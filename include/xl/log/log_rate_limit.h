@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+namespace xl::log {
+
+
+/**
+ * Limits on how many messages of a single level and subject are sent to the callbacks
+ */
+struct LogRateLimit {
+
+    // sustained number of messages per second allowed through - 0 means no limit
+    double messages_per_second = 0;
+
+    // how many messages may go through back to back after a quiet period
+    uint32_t burst = 1;
+
+    // only 1 out of every sample_every messages is kept - 1 keeps every message
+    uint32_t sample_every = 1;
+
+
+    bool is_limited() const {
+        return this->messages_per_second > 0 || this->sample_every > 1;
+    }
+
+    bool operator==(LogRateLimit const & other) const {
+        return this->messages_per_second == other.messages_per_second &&
+               this->burst == other.burst &&
+               this->sample_every == other.sample_every;
+    }
+
+    bool operator!=(LogRateLimit const & other) const {
+        return !(*this == other);
+    }
+};
+
+
+/**
+ * How much of its LogRateLimit a single level and subject has used up.  The token bucket is kept as the time at
+ * which the bucket will be full again (generic cell rate algorithm), so taking a token is a single compare and
+ * swap and no lock is needed.
+ */
+class alignas(64) LogRateLimitState {
+
+    // nanoseconds on the caller's monotonic clock
+    std::atomic<int64_t> theoretical_arrival_time{std::numeric_limits<int64_t>::min()};
+    std::atomic<uint64_t> sample_count{0};
+    std::atomic<uint64_t> suppressed_since_summary{0};
+    std::atomic<uint64_t> suppressed_total{0};
+
+
+    void suppress() {
+        this->suppressed_since_summary.fetch_add(1, std::memory_order_relaxed);
+        this->suppressed_total.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+public:
+
+    /**
+     * Decides whether a message gets through and counts it as suppressed if it doesn't
+     * @param limit the limit currently in effect
+     * @param now current time in nanoseconds from a monotonic clock
+     * @return whether the message should be sent to the callbacks
+     */
+    bool admit(LogRateLimit const & limit, int64_t now) {
+        if (limit.sample_every > 1 &&
+            this->sample_count.fetch_add(1, std::memory_order_relaxed) % limit.sample_every != 0) {
+            this->suppress();
+            return false;
+        }
+
+        if (limit.messages_per_second > 0) {
+            auto interval = static_cast<int64_t>(1'000'000'000 / limit.messages_per_second);
+            auto tolerance = interval * (std::max<int64_t>(limit.burst, 1) - 1);
+
+            auto arrival_time = this->theoretical_arrival_time.load(std::memory_order_relaxed);
+            while (true) {
+                auto start = std::max(arrival_time, now);
+                if (start - now > tolerance) {
+                    this->suppress();
+                    return false;
+                }
+                if (this->theoretical_arrival_time.compare_exchange_weak(arrival_time, start + interval,
+                                                                         std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+
+    /**
+     * @return number of messages suppressed since the last call
+     */
+    uint64_t take_suppressed_count() {
+        // avoids writing to the shared cache line in the common case of nothing having been suppressed
+        if (this->suppressed_since_summary.load(std::memory_order_relaxed) == 0) {
+            return 0;
+        }
+        return this->suppressed_since_summary.exchange(0, std::memory_order_relaxed);
+    }
+
+
+    uint64_t get_suppressed_total() const {
+        return this->suppressed_total.load(std::memory_order_relaxed);
+    }
+};
+
+
+} // end namespace xl::log
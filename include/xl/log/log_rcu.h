@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xl::log {
+
+
+/**
+ * Holds a pointer to an immutable T which may be read from any number of threads while other threads publish
+ * new versions of it (read-copy-update).  Readers never block: entering a read section is an increment of a
+ * per-thread counter and a pointer load.  Writers build a new T, publish it with exchange(), and then retire()
+ * the previous version, which waits until every reader that might still be looking at it has finished.
+ *
+ * Readers are counted in one of two sets of counters chosen by the low bit of an epoch number.  A grace period
+ * flips the epoch and waits for the set in use before the flip to drain, twice, so that readers which started
+ * before a version was replaced are waited for no matter which set they were counted in.
+ * @tparam T type of the published object
+ */
+template<class T>
+class RcuPointer {
+
+    // threads are spread over this many counters so readers on different cores don't share cache lines
+    static constexpr size_t stripe_count = 64;
+
+    struct alignas(64) ReaderCount {
+        std::atomic<std::ptrdiff_t> count{0};
+    };
+
+    std::atomic<T const *> current;
+    std::atomic<size_t> epoch{0};
+    mutable ReaderCount reader_counts[2][stripe_count];
+
+    // only one grace period runs at a time
+    std::mutex grace_period_mutex;
+
+    // versions retired from inside a read section, freed by the next full grace period
+    std::mutex deferred_mutex;
+    std::vector<std::unique_ptr<T const>> deferred;
+
+    // number of read sections the current thread is inside of, across all RcuPointer<T> objects
+    static inline thread_local int read_depth = 0;
+
+
+    static size_t get_stripe() {
+        static std::atomic<size_t> next_stripe{0};
+        thread_local size_t stripe = next_stripe++ % stripe_count;
+        return stripe;
+    }
+
+
+    void wait_for_readers(size_t parity) {
+        for (auto & reader_count : this->reader_counts[parity]) {
+            for (int attempt = 0; reader_count.count.load() != 0; attempt++) {
+                // a reader which was preempted inside its read section needs cpu time to leave it
+                if (attempt < 100) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+        }
+    }
+
+
+    void synchronize() {
+        for (int i = 0; i < 2; i++) {
+            auto previous_epoch = this->epoch.fetch_add(1);
+            this->wait_for_readers(previous_epoch & 1);
+        }
+    }
+
+
+public:
+
+    /**
+     * Keeps the version of T current when it was created alive until it is destroyed
+     */
+    class ReadGuard {
+        friend class RcuPointer;
+
+        ReaderCount * reader_count;
+        T const * value;
+
+        ReadGuard(ReaderCount & reader_count, T const * value) :
+            reader_count(&reader_count),
+            value(value)
+        {}
+
+    public:
+        ReadGuard(ReadGuard const &) = delete;
+        ReadGuard & operator=(ReadGuard const &) = delete;
+
+        // the moved-from guard no longer ends the read section
+        ReadGuard(ReadGuard && other) :
+            reader_count(other.reader_count),
+            value(other.value)
+        {
+            other.reader_count = nullptr;
+        }
+
+        ~ReadGuard() {
+            if (this->reader_count != nullptr) {
+                this->reader_count->count.fetch_sub(1, std::memory_order_release);
+                read_depth--;
+            }
+        }
+
+        T const * operator->() const {
+            return this->value;
+        }
+
+        T const & operator*() const {
+            return *this->value;
+        }
+    };
+
+
+    explicit RcuPointer(std::unique_ptr<T const> initial_value) :
+        current(initial_value.release())
+    {}
+
+    RcuPointer(RcuPointer const &) = delete;
+    RcuPointer & operator=(RcuPointer const &) = delete;
+
+    ~RcuPointer() {
+        delete this->current.load();
+    }
+
+
+    /**
+     * Enters a read section.  The returned object must not outlive this RcuPointer.
+     */
+    ReadGuard read() const {
+        read_depth++;
+        auto & reader_count = this->reader_counts[this->epoch.load(std::memory_order_relaxed) & 1][get_stripe()];
+
+        // must be ordered before loading the pointer so a grace period either sees this reader or this reader
+        //   sees the newly published version
+        reader_count.count.fetch_add(1);
+        return ReadGuard(reader_count, this->current.load());
+    }
+
+
+    /**
+     * Only for use by writers while they hold whatever lock serializes writers
+     */
+    T const * get_for_writer() const {
+        return this->current.load(std::memory_order_relaxed);
+    }
+
+
+    /**
+     * Publishes a new version.  Readers entering a read section from now on will see it.
+     * @return the previous version, which must be passed to retire()
+     */
+    std::unique_ptr<T const> exchange(std::unique_ptr<T const> new_value) {
+        return std::unique_ptr<T const>(this->current.exchange(new_value.release()));
+    }
+
+
+    /**
+     * Frees a version returned by exchange() once no reader can still be using it.  Waits for a grace period,
+     * unless the calling thread is itself inside a read section, in which case waiting would never finish and the
+     * version is instead freed after a later grace period.  Must not be called while holding a lock which a
+     * reader might try to take.
+     */
+    void retire(std::unique_ptr<T const> previous_value) {
+        if (read_depth > 0) {
+            std::lock_guard<std::mutex> lock(this->deferred_mutex);
+            this->deferred.push_back(std::move(previous_value));
+            return;
+        }
+
+        std::vector<std::unique_ptr<T const>> deferred_values;
+        {
+            std::lock_guard<std::mutex> grace_period_lock(this->grace_period_mutex);
+            {
+                std::lock_guard<std::mutex> lock(this->deferred_mutex);
+                deferred_values.swap(this->deferred);
+            }
+            this->synchronize();
+        }
+        // previous_value and deferred_values are destroyed here, after the grace period
+    }
+};
+
+
+} // end namespace xl::log
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace xl::log {
+
+
+/**
+ * Bounded queue with a fixed number of preallocated slots which may be pushed to and popped from by any number
+ * of threads without taking a lock.  Each slot carries a sequence number telling producers and consumers whether
+ * it is currently writable or readable (Dmitry Vyukov's bounded MPMC queue).
+ *
+ * Slot values are assigned to, not reconstructed, so types which own memory (like std::string) keep their
+ * capacity from one use of a slot to the next.
+ * @tparam T type stored in the queue - must be default constructible
+ */
+template<class T>
+class LogRingBuffer {
+
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t const mask;
+    std::unique_ptr<Slot[]> slots;
+
+    // separate cache lines so producers and consumers don't contend on the same line
+    alignas(64) std::atomic<size_t> enqueue_position{0};
+    alignas(64) std::atomic<size_t> dequeue_position{0};
+
+
+    static size_t round_up_to_power_of_two(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+
+public:
+
+    /**
+     * @param requested_capacity minimum number of slots - rounded up to the next power of two
+     */
+    explicit LogRingBuffer(size_t requested_capacity) :
+        mask(round_up_to_power_of_two(requested_capacity) - 1),
+        slots(std::make_unique<Slot[]>(mask + 1))
+    {
+        for (size_t i = 0; i <= this->mask; i++) {
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LogRingBuffer(LogRingBuffer const &) = delete;
+    LogRingBuffer & operator=(LogRingBuffer const &) = delete;
+
+
+    size_t capacity() const {
+        return this->mask + 1;
+    }
+
+
+    /**
+     * Claims a slot and calls writer(T &) on its value in place
+     * @param writer callable which fills in the claimed slot
+     * @return false if the queue was full and writer was not called
+     */
+    template<class WriterT>
+    bool try_push_with(WriterT && writer) {
+        size_t position = this->enqueue_position.load(std::memory_order_relaxed);
+        while (true) {
+            Slot & slot = this->slots[position & this->mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (this->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    writer(slot.value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                // slot still holds a value from the previous lap - queue is full
+                return false;
+            } else {
+                position = this->enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+
+    template<class U>
+    bool try_push(U && value) {
+        return this->try_push_with([&value](T & slot_value) {
+            slot_value = std::forward<U>(value);
+        });
+    }
+
+
+    /**
+     * Claims the oldest readable slot and calls reader(T &) on its value in place
+     * @param reader callable which consumes the claimed slot
+     * @return false if the queue was empty and reader was not called
+     */
+    template<class ReaderT>
+    bool try_pop_with(ReaderT && reader) {
+        size_t position = this->dequeue_position.load(std::memory_order_relaxed);
+        while (true) {
+            Slot & slot = this->slots[position & this->mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0) {
+                if (this->dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    reader(slot.value);
+                    slot.sequence.store(position + this->mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = this->dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+
+    bool try_pop(T & value) {
+        return this->try_pop_with([&value](T & slot_value) {
+            value = std::move(slot_value);
+        });
+    }
+
+
+    /**
+     * Calls visitor(T const &) on each value pushed but not yet popped, oldest first, without claiming any slots.
+     *   Only for reading what's left in the queue once nothing else can be relied on (e.g. from a crash signal
+     *   handler) - values pushed or popped while this runs may be skipped.
+     */
+    template<class VisitorT>
+    void visit_unread(VisitorT && visitor) const {
+        auto start = this->dequeue_position.load(std::memory_order_acquire);
+        auto end = this->enqueue_position.load(std::memory_order_acquire);
+        for (auto position = start; position != end && position - start <= this->mask; position++) {
+            Slot const & slot = this->slots[position & this->mask];
+            if (slot.sequence.load(std::memory_order_acquire) == position + 1) {
+                visitor(slot.value);
+            }
+        }
+    }
+
+
+    /**
+     * Only a hint when other threads are pushing or popping concurrently
+     */
+    bool empty() const {
+        return this->dequeue_position.load(std::memory_order_acquire) ==
+               this->enqueue_position.load(std::memory_order_acquire);
+    }
+};
+
+
+} // end namespace xl::log
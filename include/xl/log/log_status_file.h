@@ -7,9 +7,13 @@
 #include <fmt/ostream.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <variant>
 
+#include <unistd.h>
+
 #include "../exceptions.h"
 
 // Make sure json include before regexer include so PCRE is used
@@ -17,6 +21,8 @@
 #include "../regexer.h"
 
 #include "log_enum_bases.h"
+#include "log_rate_limit.h"
+#include "log_subject_registry.h"
 
 
 namespace xl::log {
@@ -40,7 +46,7 @@ public:
 };
 
 
-template<class LevelsT, class SubjectsT, class Clock>
+template<class LevelsT, class SubjectsT, class Clock, class... Sinks>
 class Log;
 
 class LogStatusFile {
@@ -53,16 +59,43 @@ private:
     std::string filename;
     decltype(std::chrono::system_clock::now()) last_file_change_check_time;
     std::filesystem::path status_file;
-    file_clock_type::time_point last_seen_write_time_for_status_file;
+    file_clock_type::time_point last_seen_write_time_for_status_file = file_clock_type::time_point::min();
 
 public:
 
-    std::string regex_filter;
+    // regexes for the messages to show and to hide - see LogFilter
+    std::vector<std::string> include_filters;
+    std::vector<std::string> exclude_filters;
+
     using StatusPair = std::pair<std::string, bool>;
     using Statuses = std::vector<StatusPair>;
     std::variant<bool, Statuses> levels = true;
     std::variant<bool, Statuses> subjects = true;
 
+    /**
+     * Rate limit for messages with the given level and subject names.  An empty name applies to every level
+     *   or subject.
+     */
+    struct RateLimitEntry {
+        std::string level;
+        std::string subject;
+        LogRateLimit limit;
+    };
+    std::vector<RateLimitEntry> rate_limits;
+
+    /**
+     * Levels and subjects sent to the callback with the given name
+     */
+    struct CallbackStatuses {
+        std::string name;
+        Statuses levels;
+        Statuses subjects;
+    };
+    std::vector<CallbackStatuses> callbacks;
+
+    // path of the log's LogControlBlock, if it has one, so a controller can find its message count
+    std::string control_block;
+
     Statuses & level_vector() {
         if (auto level_vector = std::get_if<Statuses>(&this->levels)) {
             return *level_vector;
@@ -90,8 +123,8 @@ public:
         }
     }
 
-    template<typename LevelsT, typename SubjectsT, typename Clock>
-    LogStatusFile(Log<LevelsT, SubjectsT, Clock> const & log, std::string filename, StatusFile status_file_flag) :
+    template<typename LevelsT, typename SubjectsT, typename Clock, typename... Sinks>
+    LogStatusFile(Log<LevelsT, SubjectsT, Clock, Sinks...> const & log, std::string filename, StatusFile status_file_flag) :
         LogStatusFile(filename, status_file_flag)
     {
         // If the file doesn't exist or user specified not to use it then write out the current state of the log
@@ -105,31 +138,104 @@ public:
     ~LogStatusFile() {}
 
 
-    template<typename LevelsT, typename SubjectsT, typename Clock>
-    void initialize_from_log(Log<LevelsT, SubjectsT, Clock> const & log) {
+    template<typename LevelsT, typename SubjectsT, typename Clock, typename... Sinks>
+    void initialize_from_log(Log<LevelsT, SubjectsT, Clock, Sinks...> const & log) {
         this->levels = Statuses{};
         for(size_t i = 0; i < LogLevelsBase<LevelsT>::get(LevelsT::Levels::LOG_LAST_LEVEL); i++) {
             typename LevelsT::Levels level = static_cast<typename LevelsT::Levels>(i);
             std::get<std::vector<std::pair<std::string, bool>>>(this->levels).emplace_back(std::pair(log.get_name(level), log.get_status(level)));
         }
 
+        auto previous_subjects = std::move(this->subjects);
         this->subjects = Statuses{};
         for(size_t i = 0; i < LogSubjectsBase<SubjectsT>::get(SubjectsT::Subjects::LOG_LAST_SUBJECT); i++) {
             typename SubjectsT::Subjects subject = static_cast<typename SubjectsT::Subjects>(i);
             auto pair = std::pair(log.get_name(subject), log.get_status(subject));
             std::get<std::vector<std::pair<std::string, bool>>>(this->subjects).emplace_back(std::pair(log.get_name(subject), log.get_status(subject)));
         }
-        this->write();
+
+        // subjects added with add_subject() follow the ones in the enum, and those which haven't been added yet
+        //   keep what was loaded for them
+        log.for_each_dynamic_subject([&](LogDynamicSubject const & subject) {
+            std::get<Statuses>(this->subjects).emplace_back(subject.name, log.get_status(subject));
+        });
+        if (auto previous_subject_vector = std::get_if<Statuses>(&previous_subjects)) {
+            for (size_t i = LogSubjectsBase<SubjectsT>::get(SubjectsT::Subjects::LOG_LAST_SUBJECT); i < previous_subject_vector->size(); i++) {
+                auto & name = (*previous_subject_vector)[i].first;
+                if (log.find_subject(name) == nullptr) {
+                    std::get<Statuses>(this->subjects).push_back((*previous_subject_vector)[i]);
+                }
+            }
+        }
+
+        // callbacks which haven't been added to the log yet keep what was loaded for them
+        for (auto const & [name, statuses] : log.get_named_callback_statuses()) {
+            auto callback_statuses = std::find_if(this->callbacks.begin(), this->callbacks.end(),
+                                                  [&name = name](auto const & entry) { return entry.name == name; });
+            if (callback_statuses == this->callbacks.end()) {
+                callback_statuses = this->callbacks.insert(this->callbacks.end(), CallbackStatuses{name, {}, {}});
+            }
+            callback_statuses->levels.clear();
+            for(size_t i = 0; i < LogLevelsBase<LevelsT>::get(LevelsT::Levels::LOG_LAST_LEVEL); i++) {
+                typename LevelsT::Levels level = static_cast<typename LevelsT::Levels>(i);
+                callback_statuses->levels.emplace_back(log.get_name(level), statuses[i]);
+            }
+            callback_statuses->subjects.clear();
+            for(size_t i = 0; i < LogSubjectsBase<SubjectsT>::get(SubjectsT::Subjects::LOG_LAST_SUBJECT); i++) {
+                typename SubjectsT::Subjects subject = static_cast<typename SubjectsT::Subjects>(i);
+                callback_statuses->subjects.emplace_back(log.get_name(subject),
+                    statuses[LogLevelsBase<LevelsT>::get(LevelsT::Levels::LOG_LAST_LEVEL) + i]);
+            }
+        }
+
+        this->rate_limits.clear();
+        for(size_t i = 0; i < LogLevelsBase<LevelsT>::get(LevelsT::Levels::LOG_LAST_LEVEL); i++) {
+            typename LevelsT::Levels level = static_cast<typename LevelsT::Levels>(i);
+            for(size_t j = 0; j < LogSubjectsBase<SubjectsT>::get(SubjectsT::Subjects::LOG_LAST_SUBJECT); j++) {
+                typename SubjectsT::Subjects subject = static_cast<typename SubjectsT::Subjects>(j);
+                if (auto limit = log.get_rate_limit(level, subject); limit.is_limited()) {
+                    this->rate_limits.push_back(RateLimitEntry{log.get_name(level), log.get_name(subject), limit});
+                }
+            }
+        }
     }
 
 
 
 
 
+    /**
+     * Replaces the contents of this object with what's in the file
+     * @throw LogStatusFileException, xl::json::JsonException if the file isn't valid - this object is left as it
+     *   was and the file isn't read again by reload_if_changed() until it's written again
+     */
     void read() {
+        // taken before reading so a write landing while the file is read is newer and gets read next time
+        std::error_code error;
+        auto write_time = fs::last_write_time(this->status_file, error);
+
+        auto previous = *this;
+        try {
+            this->read_contents();
+        } catch (...) {
+            *this = std::move(previous);
+            this->last_seen_write_time_for_status_file = write_time;
+            throw;
+        }
+        this->last_seen_write_time_for_status_file = write_time;
+    }
+
+
+private:
+
+    void read_contents() {
         this->levels   = true; // default back to showing everything
         this->subjects = true; // default back to showing everything
-        this->regex_filter.clear();
+        this->include_filters.clear();
+        this->exclude_filters.clear();
+        this->rate_limits.clear();
+        this->callbacks.clear();
+        this->control_block.clear();
 
         std::ifstream file(filename);
         if (!file) {
@@ -140,8 +246,19 @@ public:
 //        std::cerr << fmt::format("Just loaded log status file contents: {}", log_status_file_contents) << std::endl;
         xl::json::Json log_status(log_status_file_contents);
 
+        // single regex filter from before include and exclude filters existed
         if (auto regex = log_status["regex"].get_string()) {
-            this->regex_filter = *regex;
+            this->include_filters.push_back(*regex);
+        }
+        if (log_status["include"].get_array()) {
+            for (auto pattern : log_status["include"].as_array()) {
+                this->include_filters.push_back(pattern.get_string(std::string()).value());
+            }
+        }
+        if (log_status["exclude"].get_array()) {
+            for (auto pattern : log_status["exclude"].as_array()) {
+                this->exclude_filters.push_back(pattern.get_string(std::string()).value());
+            }
         }
         if (auto all_level_status = log_status["all_level_status"].get_boolean()) {
             this->levels = *all_level_status;
@@ -174,26 +291,151 @@ public:
             }
         }
 
-        this->last_seen_write_time_for_status_file = fs::last_write_time(this->status_file);
+        if (log_status["rate_limits"].get_array()) {
+            for (auto rate_limit : log_status["rate_limits"].as_array()) {
+                auto entry = rate_limit.as_object();
+                RateLimitEntry rate_limit_entry;
+                rate_limit_entry.level = entry["level"].get_string(std::string()).value();
+                rate_limit_entry.subject = entry["subject"].get_string(std::string()).value();
+                rate_limit_entry.limit.messages_per_second = entry["messages_per_second"].get_number(0).value();
+                rate_limit_entry.limit.burst = static_cast<uint32_t>(entry["burst"].get_number(1).value());
+                rate_limit_entry.limit.sample_every = static_cast<uint32_t>(entry["sample_every"].get_number(1).value());
+                if (rate_limit_entry.limit.messages_per_second < 0 || rate_limit_entry.limit.sample_every < 1) {
+                    throw LogStatusFileException(std::string("Invalid rate limit configuration: ") + rate_limit.get_source());
+                }
+                this->rate_limits.push_back(std::move(rate_limit_entry));
+            }
+        }
+
+        if (log_status["callbacks"].get_array()) {
+            for (auto callback : log_status["callbacks"].as_array()) {
+                auto entry = callback.as_object();
+                auto name = entry["name"].get_string();
+                if (!name) {
+                    throw LogStatusFileException(std::string("Invalid callback configuration: ") + callback.get_source());
+                }
+                this->callbacks.push_back(CallbackStatuses{*name, read_statuses(entry["levels"]), read_statuses(entry["subjects"])});
+            }
+        }
+
+        this->control_block = log_status["control_block"].get_string(std::string()).value();
+
+        // checked here so a bad pattern rejects the whole file, rather than the log finding out when it builds its
+        //   filter from a file it has already taken in
+        for (auto const * patterns : {&this->include_filters, &this->exclude_filters}) {
+            for (auto const & pattern : *patterns) {
+                try {
+                    xl::Regex(pattern, xl::NONE);
+                } catch (xl::RegexException const & e) {
+                    throw LogStatusFileException(std::string("Invalid filter: ") + e.what());
+                }
+            }
+        }
+    }
+
+
+public:
+
+    static Statuses read_statuses(xl::json::Json const & statuses_json) {
+        Statuses statuses;
+        if (statuses_json.get_array()) {
+            for (auto status_json : statuses_json.as_array()) {
+                auto name = status_json.as_object()["name"].get_string();
+                auto status = status_json.as_object()["status"].get_boolean();
+                if (!name || !status) {
+                    throw LogStatusFileException(std::string("Invalid status configuration: ") + status_json.get_source());
+                }
+                statuses.emplace_back(*name, *status);
+            }
+        }
+        return statuses;
     }
 
 
-    template<typename LevelsT, typename SubjectsT, typename Clock>
-    void write(Log<LevelsT, SubjectsT, Clock> const & log) {
+    static void write_statuses(std::ostream & file, Statuses const & statuses) {
+        file << "[";
+        for (auto const & [name, status] : statuses) {
+            file << "{\"name\": \"" << escape(name) << "\", \"status\": " << (status ? "true" : "false") << "}, ";
+        }
+        file << "]";
+    }
+
+
+    /**
+     * Backslash escapes the characters which would end or change a JSON string
+     */
+    static std::string escape(std::string_view string) {
+        std::string result;
+        for (auto c : string) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result;
+    }
+
+
+    template<typename LevelsT, typename SubjectsT, typename Clock, typename... Sinks>
+    void write(Log<LevelsT, SubjectsT, Clock, Sinks...> const & log) {
         this->initialize_from_log(log);
         this->write();
     };
 
 
+    /**
+     * Writes the whole file to a temporary file next to it and renames that over the status file, so other
+     *   processes reading the status file see either the old contents or the new ones, never a partial write.
+     *   What's written isn't read back by reload_if_changed(), since it's what this object already holds.
+     */
     void write() {
-        std::ofstream file(this->filename);
-        if (!file) {
-            return;
+        // unique within the process too, since more than one object may write the same file at once
+        static std::atomic<uint64_t> temporary_file_count{0};
+        auto temporary_file = this->filename + ".tmp." + std::to_string(::getpid()) + "." +
+                              std::to_string(temporary_file_count.fetch_add(1, std::memory_order_relaxed));
+        {
+            std::ofstream file(temporary_file);
+            if (!file) {
+                return;
+            }
+            this->write_contents(file);
+            file.close();
+            if (!file) {
+                std::error_code error;
+                fs::remove(temporary_file, error);
+                return;
+            }
+        }
+        // renaming keeps the time, and taking it before means a write by someone else right after is still newer
+        std::error_code error;
+        auto write_time = fs::last_write_time(temporary_file, error);
+        fs::rename(temporary_file, this->status_file, error);
+        if (error) {
+            fs::remove(temporary_file, error);
+        } else {
+            this->last_seen_write_time_for_status_file = write_time;
         }
+    }
+
 
+    void write_contents(std::ostream & file) const {
         file << "{\n";
-        if (!this->regex_filter.empty()) {
-            file << "\"regex\": \"" << this->regex_filter << "\",\n";
+        if (!this->include_filters.empty()) {
+            file << "    \"include\": [";
+            for (auto const & pattern : this->include_filters) {
+                file << "\"" << escape(pattern) << "\", ";
+            }
+            file << "],\n";
+        }
+        if (!this->control_block.empty()) {
+            file << "    \"control_block\": \"" << escape(this->control_block) << "\",\n";
+        }
+        if (!this->exclude_filters.empty()) {
+            file << "    \"exclude\": [";
+            for (auto const & pattern : this->exclude_filters) {
+                file << "\"" << escape(pattern) << "\", ";
+            }
+            file << "],\n";
         }
         if (auto all_level_status = std::get_if<bool>(&this->levels)) {
             file << "\"all_level_status\": " << (*all_level_status ? "true" : "false") << ",\n";
@@ -204,29 +446,61 @@ public:
         if (auto levels = std::get_if<Statuses>(&this->levels)) {
             file << "    \"levels\": [\n";
             for (auto const & [name, status] : *levels) {
-                file << "{\"name\": \"" << name << "\", \"status\": " << (status ? "true" : "false") << "},\n";
+                file << "{\"name\": \"" << escape(name) << "\", \"status\": " << (status ? "true" : "false") << "},\n";
             }
             file << "    ],\n";
         }
         if (auto subjects = std::get_if<Statuses>(&this->subjects)) {
             file << "    \"subjects\": [\n";
             for (auto const &[name, status] : *subjects) {
-                file << "{\"name\": \"" << name << "\", \"status\": " << (status ? "true" : "false") << "},\n";
+                file << "{\"name\": \"" << escape(name) << "\", \"status\": " << (status ? "true" : "false") << "},\n";
+            }
+            file << "    ],\n";
+        }
+        if (!this->rate_limits.empty()) {
+            file << "    \"rate_limits\": [\n";
+            for (auto const & rate_limit : this->rate_limits) {
+                file << "{\"level\": \"" << escape(rate_limit.level) << "\", \"subject\": \"" << escape(rate_limit.subject) << "\", "
+                     << "\"messages_per_second\": " << rate_limit.limit.messages_per_second << ", "
+                     << "\"burst\": " << rate_limit.limit.burst << ", "
+                     << "\"sample_every\": " << rate_limit.limit.sample_every << "},\n";
+            }
+            file << "    ],\n";
+        }
+        if (!this->callbacks.empty()) {
+            file << "    \"callbacks\": [\n";
+            for (auto const & callback : this->callbacks) {
+                file << "{\"name\": \"" << escape(callback.name) << "\", \"levels\": ";
+                write_statuses(file, callback.levels);
+                file << ", \"subjects\": ";
+                write_statuses(file, callback.subjects);
+                file << "},\n";
             }
             file << "    ],\n";
         }
         file << "}\n";
-
     }
 
 
+    /**
+     * Calls reload_if_changed() at most once a second
+     * @return whether the file was reloaded
+     */
     bool check() {
         // check to see if the timestamp on the status file has been updated
         if (std::chrono::system_clock::now() - this->last_file_change_check_time < 1000ms) {
             return false;
         }
         this->last_file_change_check_time = std::chrono::system_clock::now();
+        return this->reload_if_changed();
+    }
+
 
+    /**
+     * Rereads the file if it has been written since it was last read
+     * @return whether the file was reloaded
+     */
+    bool reload_if_changed() {
         if (std::filesystem::exists(this->status_file)) {
             auto last_write_time = fs::last_write_time(this->status_file);
             if (last_write_time > this->last_seen_write_time_for_status_file) {
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "log_file_change_notifier.h"
+#include "log_timer.h"
+
+namespace xl::log {
+
+
+/**
+ * Calls a function on a background thread when a log status file may have been changed by another process, so
+ * checking for changes happens off of the threads doing the logging.  Given a filename, the thread sleeps until
+ * the file is written, so changes are seen right away and nothing runs while the file isn't changing.  Where
+ * files can't be watched, it checks at a fixed interval instead.
+ */
+class LogStatusFileWatcher {
+
+    std::chrono::milliseconds interval;
+
+    // null when checking at the interval
+    std::unique_ptr<LogFileChangeNotifier> notifier;
+
+    // written to wake the notifier thread up from poll() to stop
+    int stop_pipe[2] = {-1, -1};
+
+    // makes the checks - woken by the notifier thread when the file changes, otherwise run every interval
+    std::unique_ptr<LogTimer> timer;
+
+    std::thread notifier_thread;
+
+
+    // returns when stopping, or if poll() stops working so the interval has to be used instead
+    void watch_notifier() {
+        pollfd descriptors[2] = {{this->notifier->get_file_descriptor(), POLLIN, 0}, {this->stop_pipe[0], POLLIN, 0}};
+        while (true) {
+            if (::poll(descriptors, 2, -1) == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                this->timer->set_interval(this->interval);
+                return;
+            }
+            if (descriptors[1].revents != 0) {
+                return;
+            }
+            if (this->notifier->read_events()) {
+                this->timer->wake();
+            }
+        }
+    }
+
+
+public:
+
+    /**
+     * @param filename file to watch for changes
+     * @param interval how long to wait between checks if the file can't be watched
+     * @param check_callback called on the watcher thread when the file may have changed, and once right away
+     */
+    LogStatusFileWatcher(std::string const & filename, std::chrono::milliseconds interval, std::function<void()> check_callback) :
+        interval(interval),
+        notifier(std::make_unique<LogFileChangeNotifier>(filename))
+    {
+        if (!this->notifier->is_available() || ::pipe(this->stop_pipe) != 0) {
+            this->notifier.reset();
+        }
+        this->timer = std::make_unique<LogTimer>(this->notifier ? std::chrono::milliseconds(0) : interval,
+                                                 std::move(check_callback));
+        if (this->notifier) {
+            // a write between the file last being read and the watch being made would otherwise go unnoticed
+            this->timer->wake();
+            this->notifier_thread = std::thread([this]{this->watch_notifier();});
+        }
+    }
+
+    LogStatusFileWatcher(LogStatusFileWatcher const &) = delete;
+    LogStatusFileWatcher & operator=(LogStatusFileWatcher const &) = delete;
+
+
+    /**
+     * Waits for a check in progress to finish, then stops the watcher threads
+     */
+    ~LogStatusFileWatcher() {
+        if (this->stop_pipe[1] != -1) {
+            [[maybe_unused]] auto result = ::write(this->stop_pipe[1], "", 1);
+        }
+        if (this->notifier_thread.joinable()) {
+            this->notifier_thread.join();
+        }
+        this->timer.reset();
+        for (auto descriptor : this->stop_pipe) {
+            if (descriptor != -1) {
+                ::close(descriptor);
+            }
+        }
+    }
+
+
+    std::chrono::milliseconds get_interval() const {
+        return this->interval;
+    }
+
+
+    /**
+     * @return whether the file is watched for changes rather than checked every interval
+     */
+    bool is_event_driven() const {
+        return this->notifier != nullptr;
+    }
+};
+
+
+} // end namespace xl::log
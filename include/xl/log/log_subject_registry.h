@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../exceptions.h"
+
+namespace xl::log {
+
+
+class LogSubjectRegistryException : public xl::FormattedException {
+
+public:
+
+    using xl::FormattedException::FormattedException;
+};
+
+
+/**
+ * A subject added while the program is running with Log::add_subject(), for code (like plugins) which can't add
+ *   to the compile-time Subjects enum.  Owned by the log's LogSubjectRegistry and never moved, so references to it
+ *   stay valid for as long as the log.
+ */
+struct LogDynamicSubject {
+    std::string name;
+
+    // position of its status bit in the registry
+    uint32_t id;
+
+    // underlying value of the compile-time subject whose statuses, callbacks and rate limits also apply to it
+    uint32_t parent;
+};
+
+
+/**
+ * Interned names and enabled/disabled statuses of the subjects added at runtime.  Adding a name already added
+ *   returns the existing subject.  Statuses are bits in 64 byte aligned blocks which are allocated as subjects are
+ *   added and never moved afterwards, so reading a status takes no lock and a block is only shared between threads
+ *   whose subjects are in the same block.
+ */
+class LogSubjectRegistry {
+
+public:
+
+    static constexpr size_t subjects_per_block = 512;
+    static constexpr size_t max_blocks = 2048;
+    static constexpr size_t max_subjects = subjects_per_block * max_blocks;
+
+private:
+
+    struct alignas(64) StatusBlock {
+        std::atomic<uint64_t> words[subjects_per_block / 64];
+    };
+
+    // only taken when adding subjects and changing statuses, never to read a status
+    mutable std::mutex mutex;
+
+    std::deque<LogDynamicSubject> subjects;
+
+    // keys are views of the names in subjects
+    std::unordered_map<std::string_view, LogDynamicSubject *> subjects_by_name;
+
+    std::atomic<StatusBlock *> blocks[max_blocks] = {};
+
+
+    std::atomic<uint64_t> & get_word(uint32_t id) const {
+        auto block = this->blocks[id / subjects_per_block].load(std::memory_order_acquire);
+        return block->words[id % subjects_per_block / 64];
+    }
+
+
+public:
+
+    LogSubjectRegistry() = default;
+    LogSubjectRegistry(LogSubjectRegistry const &) = delete;
+    LogSubjectRegistry & operator=(LogSubjectRegistry const &) = delete;
+
+    ~LogSubjectRegistry() {
+        for (auto & block : this->blocks) {
+            delete block.load();
+        }
+    }
+
+
+    /**
+     * @param name name of the subject - if it has already been added, the existing subject is returned
+     * @param parent underlying value of the compile-time subject it's logged under.  Ignored if name already exists.
+     * @return the subject with this name, enabled if it's new
+     * @throw LogSubjectRegistryException if there are already max_subjects subjects
+     */
+    LogDynamicSubject const & add(std::string_view name, uint32_t parent) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (auto existing = this->subjects_by_name.find(name); existing != this->subjects_by_name.end()) {
+            return *existing->second;
+        }
+        if (this->subjects.size() == max_subjects) {
+            throw LogSubjectRegistryException("Too many subjects added to log: " + std::string(name));
+        }
+
+        auto id = static_cast<uint32_t>(this->subjects.size());
+        if (id % subjects_per_block == 0) {
+            auto block = new StatusBlock;
+            for (auto & word : block->words) {
+                word.store(0, std::memory_order_relaxed);
+            }
+            this->blocks[id / subjects_per_block].store(block, std::memory_order_release);
+        }
+        this->get_word(id).fetch_or(uint64_t(1) << (id % 64), std::memory_order_relaxed);
+
+        auto & subject = this->subjects.emplace_back(LogDynamicSubject{std::string(name), id, parent});
+        this->subjects_by_name.emplace(subject.name, &subject);
+        return subject;
+    }
+
+
+    /**
+     * @return the subject with the given name, or null if it hasn't been added
+     */
+    LogDynamicSubject const * find(std::string_view name) const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto subject = this->subjects_by_name.find(name);
+        return subject == this->subjects_by_name.end() ? nullptr : subject->second;
+    }
+
+
+    bool get_status(LogDynamicSubject const & subject) const {
+        return (this->get_word(subject.id).load(std::memory_order_relaxed) >> (subject.id % 64)) & 1;
+    }
+
+
+    /**
+     * @return the previous status
+     */
+    bool set_status(LogDynamicSubject const & subject, bool new_status) {
+        auto bit = uint64_t(1) << (subject.id % 64);
+        auto previous = new_status ?
+            this->get_word(subject.id).fetch_or(bit, std::memory_order_relaxed) :
+            this->get_word(subject.id).fetch_and(~bit, std::memory_order_relaxed);
+        return (previous & bit) != 0;
+    }
+
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->subjects.size();
+    }
+
+
+    /**
+     * Calls callback(LogDynamicSubject const &) on each subject in the order they were added.  Subjects can't be
+     *   added from inside the callback.
+     */
+    template<class CallbackT>
+    void for_each(CallbackT && callback) const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto const & subject : this->subjects) {
+            callback(subject);
+        }
+    }
+};
+
+
+} // end namespace xl::log
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace xl::log {
+
+
+/**
+ * Calls a function on a background thread every interval and whenever it's woken up, so the work happens off of
+ * the threads doing the logging.  The timer may be destroyed from inside its own callback - the thread is left to
+ * finish that call on its own instead of being waited on.
+ */
+class LogTimer {
+
+    // owned by the thread as well, so it outlives a timer destroyed from its own callback
+    struct State {
+        std::chrono::milliseconds interval;
+        std::function<void()> callback;
+
+        // set by wake() - checked before taking the mutex so waking a timer which is already awake is one load
+        std::atomic<bool> woken{false};
+
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        bool stopping = false;
+        bool interval_changed = false;
+
+        State(std::chrono::milliseconds interval, std::function<void()> callback) :
+            interval(interval),
+            callback(std::move(callback))
+        {}
+    };
+
+    std::shared_ptr<State> state;
+    std::thread timer_thread;
+
+
+    static void run(std::shared_ptr<State> state) {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        auto ready = [&state]{return state->stopping || state->interval_changed || state->woken.load();};
+        while (true) {
+            bool timed_out = false;
+            if (state->interval.count() > 0) {
+                timed_out = !state->wakeup.wait_for(lock, state->interval, ready);
+            } else {
+                state->wakeup.wait(lock, ready);
+            }
+            if (state->stopping) {
+                return;
+            }
+
+            // a new interval starts a new wait
+            state->interval_changed = false;
+            if (!timed_out && !state->woken.load()) {
+                continue;
+            }
+            state->woken.store(false);
+            lock.unlock();
+            state->callback();
+            lock.lock();
+        }
+    }
+
+
+public:
+
+    /**
+     * @param interval how long to wait between calls - 0 only calls callback when woken up
+     * @param callback called on the timer thread
+     */
+    LogTimer(std::chrono::milliseconds interval, std::function<void()> callback) :
+        state(std::make_shared<State>(interval, std::move(callback))),
+        timer_thread(run, state)
+    {}
+
+    LogTimer(LogTimer const &) = delete;
+    LogTimer & operator=(LogTimer const &) = delete;
+
+
+    /**
+     * Waits for a call in progress to finish, then stops the timer thread.  From inside the callback, the thread
+     *   is stopped once the callback returns.
+     */
+    ~LogTimer() {
+        {
+            std::lock_guard<std::mutex> lock(this->state->mutex);
+            this->state->stopping = true;
+        }
+        this->state->wakeup.notify_one();
+        if (std::this_thread::get_id() == this->timer_thread.get_id()) {
+            this->timer_thread.detach();
+        } else {
+            this->timer_thread.join();
+        }
+    }
+
+
+    /**
+     * Calls the callback as soon as the timer thread is free, without waiting for it.  Wakes made while a call
+     *   is waiting to start are combined into that call.
+     */
+    void wake() {
+        if (this->state->woken.load(std::memory_order_relaxed) || this->state->woken.exchange(true)) {
+            return;
+        }
+        // taking the lock makes sure the thread is either waiting or will see the flag before it waits
+        std::lock_guard<std::mutex> lock(this->state->mutex);
+        this->state->wakeup.notify_one();
+    }
+
+
+    /**
+     * @param interval how long to wait between calls from now on - 0 only calls the callback when woken up
+     */
+    void set_interval(std::chrono::milliseconds interval) {
+        {
+            std::lock_guard<std::mutex> lock(this->state->mutex);
+            this->state->interval = interval;
+            this->state->interval_changed = true;
+        }
+        this->state->wakeup.notify_one();
+    }
+
+
+    std::chrono::milliseconds get_interval() const {
+        std::lock_guard<std::mutex> lock(this->state->mutex);
+        return this->state->interval;
+    }
+};
+
+
+} // end namespace xl::log
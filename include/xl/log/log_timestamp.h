@@ -0,0 +1,187 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "../date.h"
+
+namespace xl::log {
+
+
+/**
+ * How many digits of fractional seconds a timestamp has
+ */
+enum class TimestampPrecision {
+    SECONDS = 0,  // HH:MM:SS
+    MILLISECONDS, // HH:MM:SS.mmm
+    MICROSECONDS, // HH:MM:SS.uuuuuu
+    NANOSECONDS   // HH:MM:SS.nnnnnnnnn
+};
+
+
+enum class TimestampFormat {
+    TIME_OF_DAY = 0, // HH:MM:SS - the same as date::format("%H:%M:%S", time)
+    ISO_8601         // YYYY-MM-DDTHH:MM:SSZ (UTC)
+};
+
+
+/**
+ * Formats system_clock times without going through ostreams or allocating.  The part of the timestamp up to and
+ * including the seconds is cached, so messages logged within the same second only have their fractional digits
+ * written.
+ *
+ * Not safe to share between threads, since formatting updates the cache - use one per thread.
+ */
+class LogTimestampFormatter {
+
+public:
+
+    // longest possible timestamp: YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ
+    static constexpr size_t max_length = 32;
+
+private:
+
+    TimestampFormat timestamp_format;
+    TimestampPrecision precision;
+
+    int64_t cached_second = std::numeric_limits<int64_t>::min();
+    char cached_prefix[max_length];
+    size_t cached_prefix_length = 0;
+
+
+    static char * write_digits(char * buffer, int64_t value, int digit_count) {
+        for (int i = digit_count - 1; i >= 0; i--) {
+            buffer[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        return buffer + digit_count;
+    }
+
+
+    void update_prefix(int64_t second) {
+        auto time = date::sys_seconds(std::chrono::seconds(second));
+        auto day = date::floor<date::days>(time);
+        auto seconds_into_day = (time - day).count();
+
+        char * position = this->cached_prefix;
+        if (this->timestamp_format == TimestampFormat::ISO_8601) {
+            date::year_month_day date(day);
+            position = write_digits(position, static_cast<int>(date.year()), 4);
+            *position++ = '-';
+            position = write_digits(position, static_cast<unsigned>(date.month()), 2);
+            *position++ = '-';
+            position = write_digits(position, static_cast<unsigned>(date.day()), 2);
+            *position++ = 'T';
+        }
+        position = write_digits(position, seconds_into_day / 3600, 2);
+        *position++ = ':';
+        position = write_digits(position, seconds_into_day / 60 % 60, 2);
+        *position++ = ':';
+        position = write_digits(position, seconds_into_day % 60, 2);
+
+        this->cached_prefix_length = position - this->cached_prefix;
+        this->cached_second = second;
+    }
+
+
+public:
+
+    LogTimestampFormatter(TimestampFormat timestamp_format = TimestampFormat::TIME_OF_DAY,
+                          TimestampPrecision precision = TimestampPrecision::SECONDS) :
+        timestamp_format(timestamp_format),
+        precision(precision)
+    {}
+
+
+    /**
+     * The precision date::format uses for times with the given duration type
+     */
+    template<class Duration>
+    static constexpr TimestampPrecision precision_for() {
+        using Period = typename Duration::period;
+        if constexpr(Period::num != 1 || Period::den == 1) {
+            return TimestampPrecision::SECONDS;
+        } else if constexpr(Period::den <= 1'000) {
+            return TimestampPrecision::MILLISECONDS;
+        } else if constexpr(Period::den <= 1'000'000) {
+            return TimestampPrecision::MICROSECONDS;
+        } else {
+            return TimestampPrecision::NANOSECONDS;
+        }
+    }
+
+
+    /**
+     * Writes the timestamp into buffer.  Nothing is allocated and no null terminator is written.
+     * @param buffer where to write the timestamp
+     * @param buffer_size the timestamp is truncated to this many characters - max_length is always enough
+     * @return number of characters written
+     */
+    template<class Duration>
+    size_t format(std::chrono::time_point<std::chrono::system_clock, Duration> time, char * buffer, size_t buffer_size) {
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+
+        // round toward negative infinity so times before the epoch still have a positive fraction
+        auto second = nanoseconds / 1'000'000'000;
+        auto fraction = nanoseconds % 1'000'000'000;
+        if (fraction < 0) {
+            second--;
+            fraction += 1'000'000'000;
+        }
+
+        if (second != this->cached_second) {
+            this->update_prefix(second);
+        }
+
+        char timestamp[max_length];
+        std::memcpy(timestamp, this->cached_prefix, this->cached_prefix_length);
+        char * position = timestamp + this->cached_prefix_length;
+
+        switch (this->precision) {
+            case TimestampPrecision::SECONDS:
+                break;
+            case TimestampPrecision::MILLISECONDS:
+                *position++ = '.';
+                position = write_digits(position, fraction / 1'000'000, 3);
+                break;
+            case TimestampPrecision::MICROSECONDS:
+                *position++ = '.';
+                position = write_digits(position, fraction / 1'000, 6);
+                break;
+            case TimestampPrecision::NANOSECONDS:
+                *position++ = '.';
+                position = write_digits(position, fraction, 9);
+                break;
+        }
+        if (this->timestamp_format == TimestampFormat::ISO_8601) {
+            *position++ = 'Z';
+        }
+
+        size_t length = std::min<size_t>(position - timestamp, buffer_size);
+        std::memcpy(buffer, timestamp, length);
+        return length;
+    }
+
+
+    template<class Duration>
+    std::string format(std::chrono::time_point<std::chrono::system_clock, Duration> time) {
+        char buffer[max_length];
+        return std::string(buffer, this->format(time, buffer, sizeof(buffer)));
+    }
+
+
+    TimestampFormat get_format() const {
+        return this->timestamp_format;
+    }
+
+
+    TimestampPrecision get_precision() const {
+        return this->precision;
+    }
+};
+
+
+} // end namespace xl::log
@@ -4,9 +4,11 @@
 
 
 
+#include <memory>
 #include <sstream>
 #include <string_view>
 #include <string>
+#include <vector>
 
 #ifdef XL_USE_PCRE
 #include <pcre.h>
@@ -29,6 +31,20 @@ inline pcre_ptr make_pcre_shared_ptr(pcre * compiled_pattern) {
     return pcre_ptr(compiled_pattern, [](pcre * compiled_pattern){pcre_free(compiled_pattern);});
 }
 
+using pcre_extra_ptr = std::shared_ptr<pcre_extra>;
+
+/**
+ * Study data has to be freed with pcre_free_study, not pcre_free, so JIT compiled code is freed along with it
+ * @param extra result of pcre_study, may be null
+ * @return shared pointer owning extra
+ */
+inline pcre_extra_ptr make_pcre_extra_shared_ptr(pcre_extra * extra) {
+    if (extra == nullptr) {
+        return {};
+    }
+    return pcre_extra_ptr(extra, [](pcre_extra * extra){pcre_free_study(extra);});
+}
+
 class RegexResultPcre {
     friend class RegexPcre;
 private:
@@ -308,10 +324,157 @@ public:
 
 
 
+/**
+ * Results of RegexPcre::match(data, match_data), for matching in a loop without touching the heap.  Unlike
+ *   RegexResultPcre, nothing is copied: the results are views into the string that was matched, so they're only
+ *   valid as long as that string is, and the regex has to outlive them as well.
+ *
+ * The space for the capture offsets grows to fit the regex with the most captures it's been used with and is then
+ *   reused, so matching again with the same object - on the same thread, since it can't be shared - allocates nothing.
+ */
+class RegexMatchDataPcre {
+    friend class RegexPcre;
+
+    pcre const * compiled_pattern = nullptr;
+
+    /// string matched against, not copied
+    std::string_view source;
+
+    /// number of actual captures from running the regex
+    size_t results = 0;
+
+    /// buffer for storing submatch offsets (3 for each capture), kept between matches
+    std::vector<int> captures;
+
+
+    // index of the first named capture with that name which matched, or -1
+    int get_index(char const * name) const {
+        char * begin = nullptr;
+        char * end = nullptr;
+        auto size = pcre_get_stringtable_entries(this->compiled_pattern, name, &begin, &end);
+        if (size <= 0) {
+            return -1;
+        }
+        for (; begin != end + size; begin += size) {
+            auto index = RegexResultPcre::get_index_from_stringtable_at(begin);
+            if (this->length(index) > 0) {
+                return index;
+            }
+        }
+        return -1;
+    }
+
+
+public:
+
+    RegexMatchDataPcre() = default;
+
+
+    /**
+     * @param capture_count most captures any regex this will be used with has, to allocate space for them up front
+     */
+    explicit RegexMatchDataPcre(size_t capture_count) :
+        captures((capture_count + 1) * 3)
+    {}
+
+
+    /**
+     * Whether the last match was successful
+     */
+    operator bool() const {
+        return this->results > 0;
+    }
+
+
+    /**
+     * Number of results from the last match - the full match plus each capture up to the last one which matched
+     */
+    size_t size() const {
+        return this->results;
+    }
+
+
+    /**
+     * Part of the source string from before the regex matched, or all of it if it didn't
+     */
+    std::string_view prefix() const {
+        return *this ? this->source.substr(0, this->captures[0]) : this->source;
+    }
+
+
+    /**
+     * Part of the source string from after the regex matched, or all of it if it didn't
+     */
+    std::string_view suffix() const {
+        return *this ? this->source.substr(this->captures[1]) : this->source;
+    }
+
+
+    /**
+     * Length of the match at the specified position
+     * @param index position to get length for
+     * @return length of the match at the specified position, 0 if it didn't match
+     */
+    size_t length(size_t index) const {
+        if (index >= this->results) {
+            return 0;
+        }
+        return this->captures[index * 2 + 1] - this->captures[index * 2];
+    }
+
+
+    bool has(size_t index) const {
+        return this->length(index) > 0;
+    }
+
+
+    bool has(xl::zstring_view name) const {
+        return *this && this->get_index(name.c_str()) != -1;
+    }
+
+
+    /**
+     * Returns the string captured by the capturing pattern at the specified index
+     * @param index index to return captured string for pattern
+     * @return view into the source string, empty if the pattern didn't match
+     */
+    std::string_view operator[](size_t index) const {
+        if (index >= this->results || this->captures[index * 2] < 0) {
+            return {};
+        }
+        return this->source.substr(this->captures[index * 2], this->length(index));
+    }
+
+
+    std::string_view operator[](int index) const {
+        return this->operator[](static_cast<size_t>(index));
+    }
+
+
+    /**
+     * Returns the string captured by the named capturing pattern
+     * @param name name of the pattern to return the value for
+     * @return view into the source string, empty if the pattern didn't match
+     */
+    std::string_view operator[](xl::zstring_view name) const {
+        if (!*this) {
+            return {};
+        }
+        auto index = this->get_index(name.c_str());
+        return index == -1 ? std::string_view() : this->operator[](index);
+    }
+
+
+    std::string_view operator[](char const * name) const {
+        return this->operator[](xl::zstring_view(name));
+    }
+};
+
+
 class RegexPcre : public RegexBase<RegexPcre, RegexResultPcre> {
 
     pcre_ptr compiled_regex;
-    pcre_extra * extra = nullptr;
+    pcre_extra_ptr extra;
     int capture_count;
 
     auto make_pcre_regex_flags(xl::RegexFlagsT flags) {
@@ -325,6 +488,59 @@ class RegexPcre : public RegexBase<RegexPcre, RegexResultPcre> {
         return result;
     }
 
+
+    // JIT code runs on a stack of its own - the default 32K one is too small for some patterns, so each thread
+    //   allocates a bigger one the first time it runs a JIT compiled regex and reuses it for every one after that.
+    //   A match which runs out of that is retried on a much bigger one, only allocated by threads which need it.
+    struct JitStacks {
+        using StackPtr = std::unique_ptr<pcre_jit_stack, void(*)(pcre_jit_stack *)>;
+        StackPtr normal{pcre_jit_stack_alloc(32 * 1024, 1024 * 1024), pcre_jit_stack_free};
+        StackPtr large{nullptr, pcre_jit_stack_free};
+        bool use_large = false;
+    };
+
+    static JitStacks & get_jit_stacks() {
+        static thread_local JitStacks jit_stacks;
+        return jit_stacks;
+    }
+
+    static pcre_jit_stack * get_jit_stack(void *) {
+        auto & jit_stacks = get_jit_stacks();
+
+        // null falls back to the default stack
+        return jit_stacks.use_large ? jit_stacks.large.get() : jit_stacks.normal.get();
+    }
+
+
+    // pcre_exec, except running out of JIT stack - a recursive regex over a long subject, like json_regex over a
+    //   big document - isn't the end of the match.  It's retried on the large JIT stack and if that isn't enough
+    //   either, without the JIT code, which gets the same answer without a JIT stack.  Errors other than not
+    //   matching throw rather than look like no match.
+    int execute(char const * data, size_t length, int * captures, int captures_length) const {
+        auto result = pcre_exec(this->compiled_regex.get(), this->extra.get(), data, static_cast<int>(length),
+                                0, 0, captures, captures_length);
+        if (result == PCRE_ERROR_JIT_STACKLIMIT) {
+            auto & jit_stacks = get_jit_stacks();
+            if (!jit_stacks.large) {
+                jit_stacks.large.reset(pcre_jit_stack_alloc(1024 * 1024, 64 * 1024 * 1024));
+            }
+            if (jit_stacks.large) {
+                jit_stacks.use_large = true;
+                result = pcre_exec(this->compiled_regex.get(), this->extra.get(), data, static_cast<int>(length),
+                                   0, 0, captures, captures_length);
+                jit_stacks.use_large = false;
+            }
+        }
+        if (result == PCRE_ERROR_JIT_STACKLIMIT) {
+            result = pcre_exec(this->compiled_regex.get(), nullptr, data, static_cast<int>(length),
+                               0, 0, captures, captures_length);
+        }
+        if (result < 0 && result != PCRE_ERROR_NOMATCH) {
+            throw RegexException(std::string("Error matching regex: PCRE error ") + std::to_string(result));
+        }
+        return result;
+    }
+
 public:
 
     using ResultT = RegexResultPcre;
@@ -352,17 +568,19 @@ public:
             throw RegexException(std::string("Invalid regex: ") + error_string + "-" + regex_string.c_str());
         }
 
-        if (flags & OPTIMIZE) {
+        if (flags & (OPTIMIZE | JIT)) {
             char const * pcre_study_error_message;
-            this->extra = pcre_study(compiled_regex.get(), 0, &pcre_study_error_message);
-//            std::cerr << fmt::format("study result: {}", (void*)this->extra) << std::endl;
+            this->extra = make_pcre_extra_shared_ptr(
+                pcre_study(compiled_regex.get(), flags & JIT ? PCRE_STUDY_JIT_COMPILE : 0, &pcre_study_error_message));
             if (this->extra == nullptr) {
-                // this is ok
+                // this is ok - study found nothing to speed up and, if asked for JIT, it isn't available
+            } else if (this->is_jit_compiled()) {
+                pcre_assign_jit_stack(this->extra.get(), &RegexPcre::get_jit_stack, nullptr);
             }
         }
 
         // inspect the regex to find out how much space to allocate for results
-        pcre_fullinfo(this->compiled_regex.get(), this->extra, PCRE_INFO_CAPTURECOUNT, &this->capture_count);
+        pcre_fullinfo(this->compiled_regex.get(), this->extra.get(), PCRE_INFO_CAPTURECOUNT, &this->capture_count);
         this->capture_count++; // plus one for full match
     }
 
@@ -376,33 +594,73 @@ public:
     }
 
 
+    /**
+     * Whether the PCRE library was built with JIT support - without it, the JIT flag only studies the regex
+     * @return whether JIT compilation is available
+     */
+    static bool is_jit_available() {
+        int available = 0;
+        return pcre_config(PCRE_CONFIG_JIT, &available) == 0 && available;
+    }
+
+
+    /**
+     * Whether this regex was created with the JIT flag and compiled to machine code successfully
+     * @return whether matching runs JIT compiled code
+     */
+    bool is_jit_compiled() const {
+        return this->extra && (this->extra->flags & PCRE_EXTRA_EXECUTABLE_JIT);
+    }
+
+
     /**
      * Attempts to match this regular expression against the given string
      * @param data string to match this regular expression against
      * @return results from attempting the match
+     * @throw RegexException if PCRE fails for a reason other than not matching, such as reaching its match limit
      */
     RegexResultPcre match(xl::zstring_view data) const {
         auto buffer_length = this->capture_count * 3;
         std::vector<int> buffer;
         buffer.resize(buffer_length);
-        auto results = pcre_exec(this->compiled_regex.get(),
-                                         this->extra,
-                                         data.c_str(),
-                                         data.length(),  // length of string
-                                         0,              // Start looking at this point
-                                         0,              // OPTIONS
-                                         buffer.data(),
-                                         buffer_length); // Length of subStrVec
+        auto results = this->execute(data.c_str(), data.length(), buffer.data(), buffer_length);
 
         return RegexResultPcre(this->compiled_regex, data, results < 0 ? 0 : results, std::move(buffer), *this);
     }
 
 
-    ~RegexPcre() {
-        pcre_free(this->extra);
+    /**
+     * Attempts to match this regular expression against the given string, storing the results in match_data
+     *   instead of a newly allocated result.  The string is neither copied nor required to be null terminated and,
+     *   once match_data has room for this regex's captures, nothing is allocated.
+     * @param data string to match this regular expression against - must outlive the use of match_data
+     * @param match_data where to store the results, replacing those of any previous match
+     * @return match_data
+     * @throw RegexException if PCRE fails for a reason other than not matching
+     */
+    RegexMatchDataPcre & match(std::string_view data, RegexMatchDataPcre & match_data) const {
+        size_t buffer_length = this->capture_count * 3;
+        if (match_data.captures.size() < buffer_length) {
+            match_data.captures.resize(buffer_length);
+        }
+        auto results = this->execute(data.data(), data.length(), match_data.captures.data(), static_cast<int>(buffer_length));
+
+        match_data.compiled_pattern = this->compiled_regex.get();
+        match_data.source = data;
+        match_data.results = results < 0 ? 0 : results;
+        return match_data;
+    }
+
 
-        // this is only used with the JIT compiler
-        // pcre_free_study(this->extra);
+    /**
+     * Checks whether this regular expression matches anywhere in the given string without recording where.  Nothing
+     *   is allocated and the string is neither copied nor required to be null terminated.
+     * @param data string to match this regular expression against
+     * @return whether the regular expression matched
+     * @throw RegexException if PCRE fails for a reason other than not matching
+     */
+    bool matches(std::string_view data) const {
+        return this->execute(data.data(), data.length(), nullptr, 0) >= 0;
     }
 
 
@@ -88,7 +88,7 @@ class RegexStd : public RegexBase<RegexStd, RegexResultStd> {
             throw RegexException("Not sure if this is even a change in behavior for std::regex");
         }
 
-        result |= (flags & OPTIMIZE ? std::regex_constants::optimize : 0);
+        result |= (flags & (OPTIMIZE | JIT) ? std::regex_constants::optimize : 0);
 
         // not supported in clang 5
 //        result |= flags & MULTILINE ? std::regex_constants::multiline : 0;
@@ -121,6 +121,17 @@ public:
     }
 
 
+    /**
+     * Checks whether this regular expression matches anywhere in the given string without copying the string or
+     *   recording where it matched
+     * @param input_text string to match this regular expression against
+     * @return whether the regular expression matched
+     */
+    bool matches(std::string_view input_text) const {
+        return std::regex_search(input_text.data(), input_text.data() + input_text.length(), this->regex);
+    }
+
+
     std::string replace(xl::zstring_view replace_source, xl::zstring_view result) {
         return std::regex_replace(replace_source.c_str(), this->regex, result.c_str());
     }
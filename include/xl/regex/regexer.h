@@ -27,7 +27,10 @@ namespace xl {
         DOTALL    = 1 << 3,
         MULTILINE = 1 << 4,
         DOLLAR_END_ONLY = 1 << 5,
-        ALLOW_DUPLICATE_SUBPATTERN_NAMES = 1 << 6
+        ALLOW_DUPLICATE_SUBPATTERN_NAMES = 1 << 6,
+
+        // PCRE only: compiles the regex to machine code, implies OPTIMIZE
+        JIT       = 1 << 7
     };
     using RegexFlagsT = std::underlying_type_t<RegexFlags>;
 
@@ -0,0 +1,30 @@
+#include <iostream>
+
+#include "log/log_binary_sink.h"
+
+using namespace xl::log;
+
+
+/**
+ * Prints the contents of binary log files written by xl::log::LogBinarySink as text, in the same format as the
+ * ostream log callback:  [HH:MM:SS] subject message
+ */
+int main(int argc, char * argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " binary_log_file..." << std::endl;
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        try {
+            LogBinaryReader reader(argv[i]);
+            while (auto record = reader.next()) {
+                std::cout << reader.to_text(*record) << "\n";
+            }
+        } catch (LogBinaryFileException const & e) {
+            std::cerr << argv[i] << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "logdashboard.h"
+#include "ui_logdashboard.h"
+
+
+LogDashboard::LogDashboard(QString const & directory, QWidget *parent) :
+    QWidget(parent),
+    ui(std::make_unique<Ui::LogDashboard>()),
+    model(directory)
+{
+    ui->setupUi(this);
+
+    this->ui->processTable->setModel(&this->model);
+    this->ui->processTable->resizeColumnsToContents();
+
+    QObject::connect(this->ui->kindComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int) {
+        this->update_names();
+    });
+    QObject::connect(this->ui->enableButton, &QPushButton::clicked, [this] {
+        this->set_status(true);
+    });
+    QObject::connect(this->ui->disableButton, &QPushButton::clicked, [this] {
+        this->set_status(false);
+    });
+    QObject::connect(this->ui->processTable, &QTableView::doubleClicked, [this](QModelIndex const & index) {
+        emit this->open_requested(this->model.get_filename(index.row()));
+    });
+
+    // processes started later may have names the others don't
+    QObject::connect(&this->model, &QAbstractItemModel::rowsInserted, [this] {
+        this->update_names();
+    });
+
+    this->update_names();
+}
+
+LogDashboard::~LogDashboard() = default;
+
+
+LogDashboardModel::Kind LogDashboard::get_kind() const {
+    return this->ui->kindComboBox->currentIndex() == 0 ? LogDashboardModel::Kind::SUBJECT : LogDashboardModel::Kind::LEVEL;
+}
+
+
+void LogDashboard::update_names() {
+    auto text = this->ui->nameComboBox->currentText();
+    this->ui->nameComboBox->clear();
+    this->ui->nameComboBox->addItems(this->model.get_names(this->get_kind()));
+    this->ui->nameComboBox->setCurrentText(text);
+}
+
+
+void LogDashboard::set_status(bool status) {
+    QStringList names;
+    for (auto const & name : this->ui->nameComboBox->currentText().split(',', QString::SkipEmptyParts)) {
+        names.push_back(name.trimmed());
+    }
+    if (names.empty()) {
+        return;
+    }
+
+    std::vector<int> rows;
+    for (auto const & index : this->ui->processTable->selectionModel()->selectedRows()) {
+        rows.push_back(index.row());
+    }
+
+    auto [changed_count, skipped_count] = this->model.set_status(this->get_kind(), names, status, rows);
+    auto message = QString("Changed %1 file(s)").arg(changed_count);
+    if (skipped_count > 0) {
+        message += QString(", %1 don't list every name").arg(skipped_count);
+    }
+    this->ui->statusLabel->setText(message);
+}
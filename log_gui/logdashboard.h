@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+
+#include <QWidget>
+
+#include "logdashboardmodel.h"
+
+namespace Ui {
+class LogDashboard;
+}
+
+
+/**
+ * Every log status file in a directory in one table, for changing levels and subjects across many processes at
+ * once.  Changes apply to the selected processes, or all of them if none are selected.
+ */
+class LogDashboard : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit LogDashboard(QString const & directory, QWidget *parent = 0);
+    ~LogDashboard();
+
+signals:
+
+    // a process was double clicked to see everything in its status file
+    void open_requested(QString const & filename);
+
+private:
+    std::unique_ptr<Ui::LogDashboard> ui;
+
+    LogDashboardModel model;
+
+    LogDashboardModel::Kind get_kind() const;
+    void update_names();
+    void set_status(bool status);
+};
@@ -0,0 +1,313 @@
+#include "logdashboardmodel.h"
+
+#include <set>
+
+#include <QDir>
+#include <QFileInfo>
+
+using namespace xl::log;
+
+
+namespace {
+
+// "3 of 5 on", with the ones which are off as the tooltip
+QString summarize(std::variant<bool, LogStatusFile::Statuses> const & statuses, int role) {
+    if (auto all = std::get_if<bool>(&statuses)) {
+        return role == Qt::DisplayRole ? (*all ? "all on" : "all off") : "";
+    }
+    auto & status_vector = std::get<LogStatusFile::Statuses>(statuses);
+    int on = 0;
+    QStringList off;
+    for (auto const & [name, status] : status_vector) {
+        if (status) {
+            on++;
+        } else {
+            off.push_back(QString::fromStdString(name));
+        }
+    }
+    if (role == Qt::DisplayRole) {
+        return QString("%1 of %2 on").arg(on).arg(status_vector.size());
+    }
+    return off.empty() ? "" : "off: " + off.join(", ");
+}
+
+} // end anonymous namespace
+
+
+LogDashboardModel::LogDashboardModel(QString const & directory, QObject * parent) :
+    QAbstractTableModel(parent),
+    directory(directory)
+{
+    for (auto const & entry : QDir(directory).entryInfoList({"*.log_status"}, QDir::Files, QDir::Name)) {
+        this->processes.push_back(Process{entry.filePath()});
+        this->load(this->processes.back());
+    }
+
+    // one watch for the whole directory, and each file is only reread when it's the one written
+    this->change_notifier = LogFileChangeNotifier::for_directory(directory.toStdString());
+    if (this->change_notifier->is_available()) {
+        this->socket_notifier = std::make_unique<QSocketNotifier>(this->change_notifier->get_file_descriptor(), QSocketNotifier::Read);
+        QObject::connect(this->socket_notifier.get(), &QSocketNotifier::activated, [this]{
+            for (auto const & name : this->change_notifier->read_changed_names()) {
+                if (name.empty()) {
+                    this->reload_all();
+                } else if (QString::fromStdString(name).endsWith(".log_status")) {
+                    this->reload(QString::fromStdString(name));
+                }
+            }
+        });
+    }
+
+    this->timer.connect(&this->timer, &QTimer::timeout, [this]{
+        if (!this->socket_notifier) {
+            this->reload_all();
+        }
+        this->sample_rates();
+    });
+    this->timer.start(1000);
+}
+
+
+void LogDashboardModel::load(Process & process) {
+    try {
+        if (!process.status_file) {
+            process.status_file = std::make_unique<LogStatusFile>(process.filename.toStdString(), StatusFile::USE_FILE_CONTENTS);
+        } else {
+            process.status_file->reload_if_changed();
+        }
+        process.error.clear();
+    } catch (std::exception const & e) {
+        process.status_file.reset();
+        process.error = e.what();
+        return;
+    }
+
+    auto & control_block_path = process.status_file->control_block;
+    if (control_block_path.empty()) {
+        process.control_block.reset();
+        process.messages_per_second = -1;
+    } else if (!process.control_block || process.control_block->get_path() != control_block_path) {
+        try {
+            process.control_block = std::make_unique<LogControlBlock>(control_block_path);
+            process.last_message_count = process.control_block->get_message_count();
+            process.last_sample_time = std::chrono::steady_clock::now();
+        } catch (LogControlBlockException const &) {
+            process.control_block.reset();
+        }
+        process.messages_per_second = -1;
+    }
+}
+
+
+void LogDashboardModel::reload(QString const & name) {
+    auto filename = QDir(this->directory).filePath(name);
+    bool exists = QFileInfo(filename).isFile();
+
+    auto process = std::find_if(this->processes.begin(), this->processes.end(), [&](Process const & process) {
+        return process.filename == filename;
+    });
+    int row = process - this->processes.begin();
+
+    if (process == this->processes.end()) {
+        if (!exists) {
+            return;
+        }
+        // kept sorted by name, the same as when the directory was first read
+        auto position = std::find_if(this->processes.begin(), this->processes.end(), [&](Process const & process) {
+            return filename < process.filename;
+        });
+        row = position - this->processes.begin();
+        this->beginInsertRows(QModelIndex(), row, row);
+        this->load(*this->processes.insert(position, Process{filename}));
+        this->endInsertRows();
+    } else if (!exists) {
+        this->beginRemoveRows(QModelIndex(), row, row);
+        this->processes.erase(process);
+        this->endRemoveRows();
+    } else {
+        this->load(*process);
+        emit this->dataChanged(this->index(row, 0), this->index(row, COLUMN_COUNT - 1));
+    }
+}
+
+
+void LogDashboardModel::reload_all() {
+    QStringList names;
+    for (auto const & entry : QDir(this->directory).entryInfoList({"*.log_status"}, QDir::Files)) {
+        names.push_back(entry.fileName());
+    }
+    for (auto const & process : this->processes) {
+        names.push_back(QFileInfo(process.filename).fileName());
+    }
+    names.removeDuplicates();
+    for (auto const & name : names) {
+        this->reload(name);
+    }
+}
+
+
+void LogDashboardModel::sample_rates() {
+    auto now = std::chrono::steady_clock::now();
+    for (size_t row = 0; row < this->processes.size(); row++) {
+        auto & process = this->processes[row];
+        if (!process.control_block) {
+            continue;
+        }
+        auto message_count = process.control_block->get_message_count();
+        std::chrono::duration<double> elapsed = now - process.last_sample_time;
+
+        // a count going backwards means the block was reset by a new process
+        process.messages_per_second = message_count < process.last_message_count ? 0 :
+            (message_count - process.last_message_count) / elapsed.count();
+        process.last_message_count = message_count;
+        process.last_sample_time = now;
+        emit this->dataChanged(this->index(row, RATE_COLUMN), this->index(row, RATE_COLUMN));
+    }
+}
+
+
+QVariant LogDashboardModel::data(const QModelIndex &index, int role) const {
+    auto & process = this->processes[index.row()];
+
+    if (role == Qt::TextAlignmentRole && index.column() == RATE_COLUMN) {
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    if (role != Qt::DisplayRole && role != Qt::ToolTipRole) {
+        return QVariant();
+    }
+
+    switch (index.column()) {
+        case PROCESS_COLUMN:
+            return role == Qt::DisplayRole ? QFileInfo(process.filename).completeBaseName() : process.filename;
+        case LEVELS_COLUMN:
+            if (!process.status_file) {
+                return process.error;
+            }
+            return summarize(process.status_file->levels, role);
+        case SUBJECTS_COLUMN:
+            return process.status_file ? summarize(process.status_file->subjects, role) : QString();
+        case FILTERS_COLUMN: {
+            if (!process.status_file) {
+                return QVariant();
+            }
+            QStringList filters;
+            for (auto const & pattern : process.status_file->include_filters) {
+                filters.push_back("+" + QString::fromStdString(pattern));
+            }
+            for (auto const & pattern : process.status_file->exclude_filters) {
+                filters.push_back("-" + QString::fromStdString(pattern));
+            }
+            return filters.join(" ");
+        }
+        case RATE_COLUMN:
+            if (role == Qt::ToolTipRole) {
+                return process.control_block ? "" : "only shown for processes with a control block";
+            }
+            return process.messages_per_second < 0 ? QString() : QString::number(process.messages_per_second, 'f', 1);
+    }
+    return QVariant();
+}
+
+
+QVariant LogDashboardModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    switch (section) {
+        case PROCESS_COLUMN: return "Process";
+        case LEVELS_COLUMN: return "Levels";
+        case SUBJECTS_COLUMN: return "Subjects";
+        case FILTERS_COLUMN: return "Filters";
+        case RATE_COLUMN: return "Messages/s";
+    }
+    return QVariant();
+}
+
+
+int LogDashboardModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : this->processes.size();
+}
+
+
+int LogDashboardModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : COLUMN_COUNT;
+}
+
+
+QString LogDashboardModel::get_filename(int row) const {
+    return this->processes[row].filename;
+}
+
+
+QStringList LogDashboardModel::get_names(Kind kind) const {
+    std::set<QString> names;
+    for (auto const & process : this->processes) {
+        if (!process.status_file) {
+            continue;
+        }
+        auto & statuses = kind == Kind::LEVEL ? process.status_file->levels : process.status_file->subjects;
+        if (auto status_vector = std::get_if<LogStatusFile::Statuses>(&statuses)) {
+            for (auto const & [name, status] : *status_vector) {
+                names.insert(QString::fromStdString(name));
+            }
+        }
+    }
+    QStringList result;
+    for (auto const & name : names) {
+        result.push_back(name);
+    }
+    return result;
+}
+
+
+std::pair<int, int> LogDashboardModel::set_status(Kind kind, QStringList const & names, bool status, std::vector<int> const & rows) {
+    std::vector<int> all_rows;
+    if (rows.empty()) {
+        for (size_t row = 0; row < this->processes.size(); row++) {
+            all_rows.push_back(row);
+        }
+    }
+
+    int changed_count = 0;
+    int skipped_count = 0;
+    for (auto row : rows.empty() ? all_rows : rows) {
+        auto & process = this->processes[row];
+        if (!process.status_file) {
+            skipped_count++;
+            continue;
+        }
+        auto & statuses = kind == Kind::LEVEL ? process.status_file->levels : process.status_file->subjects;
+
+        // a file with a single status for everything doesn't say which names it has
+        auto status_vector = std::get_if<LogStatusFile::Statuses>(&statuses);
+        if (status_vector == nullptr) {
+            if (std::get<bool>(statuses) != status) {
+                skipped_count++;
+            }
+            continue;
+        }
+
+        bool changed = false;
+        bool missing = false;
+        for (auto const & name : names) {
+            auto entry = std::find_if(status_vector->begin(), status_vector->end(), [&](LogStatusFile::StatusPair const & pair) {
+                return pair.first == name.toStdString();
+            });
+            if (entry == status_vector->end()) {
+                missing = true;
+            } else if (entry->second != status) {
+                entry->second = status;
+                changed = true;
+            }
+        }
+        skipped_count += missing;
+
+        // every change to this file goes out in one write
+        if (changed) {
+            process.status_file->write();
+            changed_count++;
+            emit this->dataChanged(this->index(row, 0), this->index(row, COLUMN_COUNT - 1));
+        }
+    }
+    return {changed_count, skipped_count};
+}
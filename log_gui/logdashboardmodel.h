@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "QAbstractTableModel"
+#include "QSocketNotifier"
+#include "QTimer"
+
+#include "../include/xl/log.h"
+
+
+/**
+ * Model with a row for each log status file in a directory - one per process.  Files are found as they're
+ * created and each is only reread when it's written.  Processes with a control block also get how many messages
+ * a second they're logging.
+ */
+class LogDashboardModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+
+    enum Column {
+        PROCESS_COLUMN,
+        LEVELS_COLUMN,
+        SUBJECTS_COLUMN,
+        FILTERS_COLUMN,
+        RATE_COLUMN,
+        COLUMN_COUNT
+    };
+
+    enum class Kind {LEVEL, SUBJECT};
+
+private:
+
+    struct Process {
+        QString filename;
+
+        // null if the file couldn't be read
+        std::unique_ptr<xl::log::LogStatusFile> status_file;
+        QString error;
+
+        // only when the status file names one
+        std::unique_ptr<xl::log::LogControlBlock> control_block;
+        uint64_t last_message_count = 0;
+        std::chrono::steady_clock::time_point last_sample_time;
+
+        // negative until there are two samples to compare
+        double messages_per_second = -1;
+    };
+
+    QString directory;
+    std::vector<Process> processes;
+
+    std::unique_ptr<xl::log::LogFileChangeNotifier> change_notifier;
+    std::unique_ptr<QSocketNotifier> socket_notifier;
+
+    // samples message counts, and checks for changed files where the directory can't be watched
+    QTimer timer;
+
+
+    void load(Process & process);
+    void reload(QString const & name);
+    void reload_all();
+    void sample_rates();
+
+
+public:
+
+    explicit LogDashboardModel(QString const & directory, QObject * parent = nullptr);
+
+    QVariant data(const QModelIndex &index, int role) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
+    int rowCount(const QModelIndex &parent) const override;
+    int columnCount(const QModelIndex &parent) const override;
+
+    QString get_filename(int row) const;
+
+    /**
+     * @return every level or subject name in any of the files, sorted
+     */
+    QStringList get_names(Kind kind) const;
+
+    /**
+     * Sets the status of the named levels or subjects in each of the files for rows, writing each file once
+     * @param rows rows to change, or every row if empty
+     * @return number of files changed, and number which don't list all the names - the names they do list are
+     *   still changed
+     */
+    std::pair<int, int> set_status(Kind kind, QStringList const & names, bool status, std::vector<int> const & rows);
+};
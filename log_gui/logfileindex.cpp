@@ -0,0 +1,258 @@
+#include "logfileindex.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace xl::log;
+
+
+namespace {
+
+// most lines indexed before the new ones are handed to the model, so they show up while a big file is indexed
+constexpr size_t lines_per_pass = 256 * 1024;
+
+// how often to look for more of the file when everything written so far is indexed
+constexpr auto growth_check_interval = std::chrono::milliseconds(250);
+
+} // end anonymous namespace
+
+
+LogFileIndex::LogFileIndex(std::string filename) :
+    filename(std::move(filename))
+{
+    this->file_descriptor = ::open(this->filename.c_str(), O_RDONLY);
+    if (this->file_descriptor == -1) {
+        this->error = "Could not open log file: " + this->filename;
+        return;
+    }
+
+    char magic[sizeof(LogBinaryFormat::magic)];
+    this->binary = ::pread(this->file_descriptor, magic, sizeof(magic), 0) == sizeof(magic) &&
+        std::memcmp(magic, LogBinaryFormat::magic, sizeof(magic)) == 0;
+
+    this->thread = std::thread([this]{
+        this->index();
+    });
+}
+
+
+LogFileIndex::~LogFileIndex() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->stopping_condition.notify_all();
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+    if (this->mapping != nullptr) {
+        ::munmap(const_cast<char *>(this->mapping), this->mapping_size);
+    }
+    if (this->file_descriptor != -1) {
+        ::close(this->file_descriptor);
+    }
+}
+
+
+bool LogFileIndex::remap(size_t size) {
+    void * new_mapping = nullptr;
+    if (size > 0) {
+        new_mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, this->file_descriptor, 0);
+        if (new_mapping == MAP_FAILED) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->error = "Could not map log file: " + this->filename;
+            return false;
+        }
+    }
+
+    // readers hold on to the old mapping, so they're replaced along with it
+    std::unique_ptr<LogBinaryReader> new_binary_reader, new_indexing_reader;
+    if (this->binary && size > 0) {
+        try {
+            new_binary_reader = std::make_unique<LogBinaryReader>(static_cast<char const *>(new_mapping), size);
+            new_indexing_reader = std::make_unique<LogBinaryReader>(static_cast<char const *>(new_mapping), size);
+        } catch (LogBinaryFileException const & e) {
+            ::munmap(new_mapping, size);
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->error = e.what();
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->mapping != nullptr) {
+        ::munmap(const_cast<char *>(this->mapping), this->mapping_size);
+    }
+    this->mapping = static_cast<char const *>(new_mapping);
+    this->mapping_size = size;
+    this->binary_reader = std::move(new_binary_reader);
+    this->indexing_reader = std::move(new_indexing_reader);
+    if (this->indexing_reader && this->indexed_end == 0) {
+        this->indexed_end = this->indexing_reader->get_offset();
+    }
+    return true;
+}
+
+
+void LogFileIndex::reset() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->checkpoints.clear();
+    this->line_count = 0;
+
+    // remapping the shorter file finds where the records of a binary file start again
+    this->indexed_end = 0;
+    this->generation++;
+}
+
+
+size_t LogFileIndex::index_text(size_t end, size_t & lines_found, std::vector<uint64_t> & checkpoints_found) {
+    auto position = this->indexed_end;
+    while (position < end && lines_found < lines_per_pass) {
+        auto newline = static_cast<char const *>(std::memchr(this->mapping + position, '\n', end - position));
+        if (newline == nullptr) {
+            break;
+        }
+        if ((this->line_count + lines_found) % checkpoint_interval == 0) {
+            checkpoints_found.push_back(position);
+        }
+        lines_found++;
+        position = newline - this->mapping + 1;
+    }
+    return position;
+}
+
+
+size_t LogFileIndex::index_binary(size_t & lines_found, std::vector<uint64_t> & checkpoints_found) {
+    auto & reader = *this->indexing_reader;
+    reader.seek(this->indexed_end);
+    while (lines_found < lines_per_pass) {
+        auto position = reader.get_offset();
+        if (!reader.skip()) {
+            break;
+        }
+        if ((this->line_count + lines_found) % checkpoint_interval == 0) {
+            checkpoints_found.push_back(position);
+        }
+        lines_found++;
+    }
+    return reader.get_offset();
+}
+
+
+void LogFileIndex::index() {
+    while (!this->stopping) {
+        struct stat file_status{};
+        if (::fstat(this->file_descriptor, &file_status) != 0) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->error = "Could not read size of log file: " + this->filename;
+            return;
+        }
+        auto size = static_cast<size_t>(file_status.st_size);
+
+        // a file shorter than what's been indexed was truncated, so start over
+        if (size < this->indexed_end) {
+            this->reset();
+        }
+        if (size != this->mapping_size && !this->remap(size)) {
+            return;
+        }
+
+        size_t lines_found = 0;
+        std::vector<uint64_t> checkpoints_found;
+        size_t new_end = this->indexed_end;
+        try {
+            if (!this->binary) {
+                new_end = this->index_text(size, lines_found, checkpoints_found);
+            } else if (this->indexing_reader) {
+                new_end = this->index_binary(lines_found, checkpoints_found);
+            }
+        } catch (LogBinaryFileException const & e) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->error = e.what();
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (lines_found > 0) {
+            this->checkpoints.insert(this->checkpoints.end(), checkpoints_found.begin(), checkpoints_found.end());
+            this->line_count += lines_found;
+            this->indexed_end = new_end;
+        }
+
+        // keep going right away if there's more to index, otherwise wait for the file to grow
+        if (lines_found < lines_per_pass) {
+            this->stopping_condition.wait_for(lock, growth_check_interval, [this]{return this->stopping.load();});
+        }
+    }
+}
+
+
+size_t LogFileIndex::get_line_count() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->line_count;
+}
+
+
+size_t LogFileIndex::get_generation() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->generation;
+}
+
+
+std::string LogFileIndex::get_error() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->error;
+}
+
+
+std::string LogFileIndex::get_line(size_t line) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (line >= this->line_count) {
+        return {};
+    }
+
+    // touching a page of the mapping past the end of a file which was truncated since it was mapped raises SIGBUS,
+    //   so lines aren't read until the indexing thread has caught up with the shorter file
+    struct stat file_status{};
+    if (::fstat(this->file_descriptor, &file_status) != 0 || static_cast<size_t>(file_status.st_size) < this->mapping_size) {
+        return {};
+    }
+    size_t position = this->checkpoints[line / checkpoint_interval];
+
+    if (this->binary) {
+        try {
+            this->binary_reader->seek(position);
+            for (size_t i = 0; i < line % checkpoint_interval; i++) {
+                this->binary_reader->skip();
+            }
+            if (auto record = this->binary_reader->next()) {
+                auto text = this->binary_reader->to_text(*record);
+                text.resize(std::min(text.length(), max_line_length));
+                return text;
+            }
+            return {};
+        } catch (LogBinaryFileException const & e) {
+            return std::string("<invalid record: ") + e.what() + ">";
+        }
+    }
+
+    // every counted line ended with a newline when it was indexed, but the file may have been rewritten in place
+    //   since, so the newlines may be gone
+    for (size_t i = 0; i < line % checkpoint_interval; i++) {
+        auto newline = static_cast<char const *>(std::memchr(this->mapping + position, '\n', this->mapping_size - position));
+        if (newline == nullptr) {
+            return {};
+        }
+        position = newline - this->mapping + 1;
+    }
+    auto newline = static_cast<char const *>(std::memchr(this->mapping + position, '\n', this->mapping_size - position));
+    size_t end = newline == nullptr ? this->mapping_size : newline - this->mapping;
+    if (end > position && this->mapping[end - 1] == '\r') {
+        end--;
+    }
+    return std::string(this->mapping + position, std::min(end - position, max_line_length));
+}
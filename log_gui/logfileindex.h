@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/xl/log/log_binary_sink.h"
+
+
+/**
+ * Memory maps a log file - text, or binary written by LogBinarySink - and finds where its lines (or binary records)
+ * start on a background thread, so the beginning of even a very large file can be shown right away.
+ *
+ * Only every checkpoint_interval'th line start is kept and the rest are found by scanning forward from the
+ * nearest checkpoint, which keeps the index to a few megabytes for files of many gigabytes.  The file is
+ * watched for growth, so lines appended after it's opened keep being indexed.  A text line is only counted
+ * once its newline has been written.
+ */
+class LogFileIndex {
+
+public:
+
+    static constexpr size_t checkpoint_interval = 64;
+
+    // longer lines are cut off when returned by get_line
+    static constexpr size_t max_line_length = 4096;
+
+private:
+
+    std::string filename;
+    int file_descriptor = -1;
+    bool binary = false;
+
+    // guards everything below it which both threads use
+    mutable std::mutex mutex;
+
+    // replaced only by the indexing thread, which is why it can read these without the mutex
+    char const * mapping = nullptr;
+    size_t mapping_size = 0;
+
+    // reads records for get_line - needs the mutex since reading a record changes its offset
+    mutable std::unique_ptr<xl::log::LogBinaryReader> binary_reader;
+
+    std::vector<uint64_t> checkpoints;
+    size_t line_count = 0;
+
+    // changes when the file is truncated or replaced, since lines already indexed no longer mean anything
+    size_t generation = 0;
+
+    std::string error;
+
+    // only used by the indexing thread
+    size_t indexed_end = 0;
+    std::unique_ptr<xl::log::LogBinaryReader> indexing_reader;
+
+    std::atomic<bool> stopping = false;
+    std::condition_variable stopping_condition;
+    std::thread thread;
+
+
+    void index();
+    bool remap(size_t size);
+    void reset();
+    size_t index_text(size_t end, size_t & lines_found, std::vector<uint64_t> & checkpoints_found);
+    size_t index_binary(size_t & lines_found, std::vector<uint64_t> & checkpoints_found);
+
+
+public:
+
+    /**
+     * Starts indexing filename in the background
+     * @param filename file to show
+     */
+    explicit LogFileIndex(std::string filename);
+    LogFileIndex(LogFileIndex const &) = delete;
+    LogFileIndex & operator=(LogFileIndex const &) = delete;
+    ~LogFileIndex();
+
+
+    std::string const & get_filename() const {
+        return this->filename;
+    }
+
+
+    bool is_binary() const {
+        return this->binary;
+    }
+
+
+    /**
+     * @return number of lines indexed so far
+     */
+    size_t get_line_count() const;
+
+
+    /**
+     * @return changes when the file is truncated or replaced and lines previously returned are gone
+     */
+    size_t get_generation() const;
+
+
+    /**
+     * @return what went wrong if the file can't be indexed, otherwise empty
+     */
+    std::string get_error() const;
+
+
+    /**
+     * @param line line number - must be less than get_line_count()
+     * @return text of the line, or of the binary record formatted the same way as the ostream callback
+     */
+    std::string get_line(size_t line) const;
+};
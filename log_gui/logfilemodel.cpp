@@ -0,0 +1,62 @@
+#include "logfilemodel.h"
+
+#include <limits>
+
+
+LogFileModel::LogFileModel(QString const & filename, QObject * parent) :
+    QAbstractListModel(parent),
+    file_index(filename.toStdString())
+{
+    this->timer.connect(&this->timer, &QTimer::timeout, [this]{
+        this->update();
+    });
+    this->timer.start(100);
+}
+
+
+void LogFileModel::update() {
+    if (auto generation = this->file_index.get_generation(); generation != this->generation) {
+        this->beginResetModel();
+        this->generation = generation;
+        this->row_count = 0;
+        this->endResetModel();
+        emit this->lines_changed(this->row_count);
+    }
+
+    // rows are ints in Qt, so anything past that can't be shown
+    auto line_count = static_cast<int>(std::min<size_t>(this->file_index.get_line_count(), std::numeric_limits<int>::max()));
+    if (line_count > this->row_count) {
+        this->beginInsertRows(QModelIndex(), this->row_count, line_count - 1);
+        this->row_count = line_count;
+        this->endInsertRows();
+        emit this->lines_changed(this->row_count);
+    }
+
+    if (auto error = QString::fromStdString(this->file_index.get_error()); error != this->error) {
+        this->error = error;
+        emit this->lines_changed(this->row_count);
+    }
+}
+
+
+QVariant LogFileModel::data(const QModelIndex &index, int role) const {
+    if (role == Qt::DisplayRole && index.row() < this->row_count) {
+        return QString::fromStdString(this->file_index.get_line(index.row()));
+    }
+    return QVariant();
+}
+
+
+int LogFileModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : this->row_count;
+}
+
+
+bool LogFileModel::is_binary() const {
+    return this->file_index.is_binary();
+}
+
+
+QString LogFileModel::get_error() const {
+    return this->error;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+
+#include "QAbstractListModel"
+#include "QTimer"
+
+#include "logfileindex.h"
+
+
+/**
+ * Model with one row per line (or binary record) of a log file.  Rows are only read from the file when the view
+ * asks for them, so the view should be given uniform item sizes to keep it from asking for every row.  Rows are
+ * added as the file is indexed and as it grows.
+ */
+class LogFileModel : public QAbstractListModel {
+    Q_OBJECT
+
+    LogFileIndex file_index;
+
+    // rows the view has been told about - the index may already have more
+    int row_count = 0;
+    size_t generation = 0;
+    QString error;
+
+    QTimer timer;
+
+public:
+
+    explicit LogFileModel(QString const & filename, QObject * parent = nullptr);
+
+    QVariant data(const QModelIndex &index, int role) const override;
+    int rowCount(const QModelIndex &parent) const override;
+
+    bool is_binary() const;
+
+    // empty unless the file can't be shown
+    QString get_error() const;
+
+    // tells the view about lines indexed since the last call
+    void update();
+
+signals:
+
+    // after update() adds rows, the file is truncated or it can't be indexed any further
+    void lines_changed(int line_count);
+};
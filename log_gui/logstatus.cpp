@@ -29,9 +29,10 @@ void update_master_checkbox(QCheckBox * checkbox, std::variant<bool, std::vector
 LogStatus::LogStatus(QString const & filename, QWidget *parent) :
     QWidget(parent),
     ui(new Ui::LogStatus),
-    status_file(std::make_unique<xl::log::LogStatusFile>(filename.toStdString())),
+    status_file(std::make_unique<xl::log::LogStatusFile>(filename.toStdString(), xl::log::StatusFile::USE_FILE_CONTENTS)),
     level_model(status_file->levels),
-    subject_model(status_file->subjects)
+    subject_model(status_file->subjects),
+    change_notifier(filename.toStdString())
 {
     ui->setupUi(this);
 
@@ -39,7 +40,8 @@ LogStatus::LogStatus(QString const & filename, QWidget *parent) :
     this->ui->subjectList->setModel(&this->subject_model);
 
     QObject::connect(this->ui->regexEdit, &QLineEdit::editingFinished, [this]() {
-        this->status_file->regex_filter = this->ui->regexEdit->text().toStdString();
+        auto regex = this->ui->regexEdit->text().toStdString();
+        this->status_file->include_filters = regex.empty() ? std::vector<std::string>{} : std::vector<std::string>{regex};
         this->status_file->write();
     });
 
@@ -95,14 +97,20 @@ LogStatus::LogStatus(QString const & filename, QWidget *parent) :
         this->subject_model.data_changed();
 
     });
-    this->timer.connect(&this->timer, &QTimer::timeout, [this]{
-        if (this->status_file->check()) {
-            this->subject_model.data_changed();
-            this->level_model.data_changed();
-            this->ui->regexEdit->setText(this->status_file->regex_filter.c_str());
-        }
-    });
-    this->timer.start(1000);
+    if (this->change_notifier.is_available()) {
+        this->socket_notifier = std::make_unique<QSocketNotifier>(this->change_notifier.get_file_descriptor(), QSocketNotifier::Read);
+        QObject::connect(this->socket_notifier.get(), &QSocketNotifier::activated, [this]{
+            if (this->change_notifier.read_events()) {
+                this->reload();
+            }
+        });
+    } else {
+        this->timer.connect(&this->timer, &QTimer::timeout, [this]{
+            this->reload();
+        });
+        this->timer.start(1000);
+    }
+    this->ui->regexEdit->setText(this->status_file->include_filters.empty() ? "" : this->status_file->include_filters.front().c_str());
 
     update_master_checkbox(this->ui->allLevels, this->status_file->levels);
     update_master_checkbox(this->ui->allSubjects, this->status_file->subjects);
@@ -116,3 +124,14 @@ LogStatus::~LogStatus()
 }
 
 
+void LogStatus::reload() {
+    if (this->status_file->reload_if_changed()) {
+        this->subject_model.data_changed();
+        this->level_model.data_changed();
+        this->ui->regexEdit->setText(this->status_file->include_filters.empty() ? "" : this->status_file->include_filters.front().c_str());
+        update_master_checkbox(this->ui->allLevels, this->status_file->levels);
+        update_master_checkbox(this->ui->allSubjects, this->status_file->subjects);
+    }
+}
+
+
@@ -2,6 +2,7 @@
 #define LOGSTATUS_H
 
 #include <QWidget>
+#include <QSocketNotifier>
 #include <QTimer>
 
 #include "../include/xl/log.h"
@@ -28,8 +29,16 @@ private:
     LogElementListModel level_model;
     LogElementListModel subject_model;
 
+    // tells about changes to the status file as they're written, so nothing runs while it isn't changing
+    xl::log::LogFileChangeNotifier change_notifier;
+    std::unique_ptr<QSocketNotifier> socket_notifier;
+
+    // only used where the status file can't be watched
     QTimer timer;
 
+    // reloads the status file and updates everything showing it if another process changed it
+    void reload();
+
 
 };
 
@@ -0,0 +1,50 @@
+#include "logviewer.h"
+#include "ui_logviewer.h"
+
+#include <QFontDatabase>
+#include <QScrollBar>
+
+
+LogViewer::LogViewer(QString const & filename, QWidget *parent) :
+    QWidget(parent),
+    ui(std::make_unique<Ui::LogViewer>()),
+    model(filename)
+{
+    ui->setupUi(this);
+
+    this->ui->logView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    this->ui->logView->setModel(&this->model);
+
+    QObject::connect(&this->model, &LogFileModel::lines_changed, [this](int line_count) {
+        this->update_status(line_count);
+        if (this->ui->followCheckBox->isChecked()) {
+            this->ui->logView->scrollToBottom();
+        }
+    });
+
+    QObject::connect(this->ui->followCheckBox, &QCheckBox::toggled, [this](bool checked) {
+        if (checked) {
+            this->ui->logView->scrollToBottom();
+        }
+    });
+
+    // scrolling up to read something stops following, scrolling back to the end starts it again
+    QObject::connect(this->ui->logView->verticalScrollBar(), &QScrollBar::actionTriggered, [this](int) {
+        auto scroll_bar = this->ui->logView->verticalScrollBar();
+        this->ui->followCheckBox->setChecked(scroll_bar->sliderPosition() == scroll_bar->maximum());
+    });
+
+    this->update_status(0);
+}
+
+LogViewer::~LogViewer() = default;
+
+
+void LogViewer::update_status(int line_count) {
+    auto error = this->model.get_error();
+    if (!error.isEmpty()) {
+        this->ui->statusLabel->setText(error);
+        return;
+    }
+    this->ui->statusLabel->setText(QString("%1 %2").arg(line_count).arg(this->model.is_binary() ? "records" : "lines"));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+
+#include <QWidget>
+
+#include "logfilemodel.h"
+
+namespace Ui {
+class LogViewer;
+}
+
+
+/**
+ * Shows a log file, text or binary, a screenful at a time.  With follow checked, the view stays scrolled to the
+ * end as lines are added to the file.
+ */
+class LogViewer : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit LogViewer(QString const & filename, QWidget *parent = 0);
+    ~LogViewer();
+
+private:
+    std::unique_ptr<Ui::LogViewer> ui;
+
+    LogFileModel model;
+
+    void update_status(int line_count);
+};
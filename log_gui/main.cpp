@@ -9,6 +9,7 @@
 
 int main(int argc, char *argv[])
 {
+    bool dashboard = false;
     {
         QCoreApplication application(argc, argv);
         application.setApplicationName("xl_log_tool");
@@ -34,10 +35,14 @@ int main(int argc, char *argv[])
                               {"all-subject-status",
                                   "Sets the status of all subjects to this value",
                                   "on|off"
+                              },
+                              {"dashboard",
+                                  "Shows all the status files in each directory in one table instead of a tab each"
                               }
                           });
 
         parser.process(application);
+        dashboard = parser.isSet("dashboard");
         bool command_line_only = false;
         std::optional<bool> all_level_status{};
         std::optional<bool> all_subject_status{};
@@ -57,7 +62,7 @@ int main(int argc, char *argv[])
 //                std::cerr << fmt::format("Must specify a filename in order to set level or subject statuses") << std::endl;
                 exit(1);
             }
-            xl::log::LogStatusFile status_file(filename, true);
+            xl::log::LogStatusFile status_file(filename, xl::log::StatusFile::USE_FILE_CONTENTS);
             if (all_level_status) {
                 status_file.levels = *all_level_status;
             }
@@ -75,12 +80,14 @@ int main(int argc, char *argv[])
 
     QStringList args;
     for(int i = 1; i < argc; i++) {
-        args.push_back(argv[i]);
+        if (QString(argv[i]) != "--dashboard") {
+            args.push_back(argv[i]);
+        }
     }
     if (args.empty()) {
         args.push_back("./");
     }
-    MainWindow w(args);
+    MainWindow w(args, dashboard);
     w.show();
 
     return application.exec();
@@ -3,14 +3,17 @@
 
 #include <qfiledialog.h>
 #include <QDir>
+#include <QFileInfo>
 
+#include "logdashboard.h"
 #include "logstatus.h"
+#include "logviewer.h"
 #include "../include/xl/log.h"
 using namespace xl::log;
 
 
 
-MainWindow::MainWindow(QStringList filenames, QWidget *parent) :
+MainWindow::MainWindow(QStringList filenames, bool dashboard, QWidget *parent) :
     QMainWindow(parent),
     ui(std::make_unique<Ui::MainWindow>())
 {
@@ -26,12 +29,14 @@ MainWindow::MainWindow(QStringList filenames, QWidget *parent) :
     for(auto const & filename : filenames) {
         // if it's a directory, then load up all the .log_status files in it
         QDir dir(filename);
-        if (dir.exists()) {
+        if (dir.exists() && dashboard) {
+            this->open_dashboard(filename);
+        } else if (dir.exists()) {
             for (auto entry : dir.entryInfoList({"*.log_status"})) {
                 tabs->addTab(new LogStatus(entry.canonicalFilePath()), entry.fileName());
             }
         } else {
-            tabs->addTab(new LogStatus(filename), filename);
+            this->open_file(filename);
         }
     }
 }
@@ -40,14 +45,44 @@ MainWindow::~MainWindow() = default;
 
 
 
+void MainWindow::open_file(QString const & filename) {
+    // anything other than a status file is a log to view
+    if (filename.endsWith(".log_status")) {
+        this->ui->logStatusTabs->addTab(new LogStatus(filename), filename);
+    } else {
+        this->ui->logStatusTabs->addTab(new LogViewer(filename), QFileInfo(filename).fileName());
+    }
+}
+
+
+void MainWindow::open_dashboard(QString const & directory) {
+    auto dashboard = new LogDashboard(directory);
+    QObject::connect(dashboard, &LogDashboard::open_requested, this, &MainWindow::open_file);
+    this->ui->logStatusTabs->addTab(dashboard, "Dashboard: " + QDir(directory).dirName());
+}
+
+
 void MainWindow::on_action_Open_triggered()
 {
     auto filename = QFileDialog::getOpenFileName(this,
-        tr("Open Status File"), ".", tr("Image Files (*.log_status)")
+        tr("Open Status or Log File"), ".", tr("Status Files (*.log_status);;Log Files (*)")
     );
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    this->open_file(filename);
+}
 
-    this->ui->logStatusTabs->addTab(new LogStatus(filename), filename);
 
+void MainWindow::on_action_Open_Dashboard_triggered()
+{
+    auto directory = QFileDialog::getExistingDirectory(this, tr("Open Directory of Status Files"), ".");
+    if (directory.isEmpty()) {
+        return;
+    }
+
+    this->open_dashboard(directory);
 }
 
 
@@ -24,15 +24,25 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit MainWindow(QStringList filenames, QWidget *parent = 0);
+    /**
+     * @param dashboard whether directories in filenames are shown as a dashboard instead of a tab per status file
+     */
+    explicit MainWindow(QStringList filenames, bool dashboard = false, QWidget *parent = 0);
     ~MainWindow();
 
 private:
     std::unique_ptr<Ui::MainWindow> ui;
 
+    // status files get a LogStatus tab, anything else a LogViewer tab
+    void open_file(QString const & filename);
+
+    // every status file in the directory in one tab
+    void open_dashboard(QString const & directory);
+
 private slots:
 
     void on_action_Open_triggered();
+    void on_action_Open_Dashboard_triggered();
     void onTabCloseRequested(int index);
 };
 
@@ -2,6 +2,9 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include <optional>
+#include <thread>
+
 #include "regex/regexer.h"
 
 using namespace xl;
@@ -179,5 +182,100 @@ TEST(Regexer, all) {
     }
 }
 
-#endif
 
+TEST(Regexer, matches) {
+    std::string text = "abc def";
+    for (auto length : {3ul, 7ul}) {
+        // matches doesn't need a null terminated string
+        std::string_view view(text.data(), length);
+        EXPECT_EQ(RegexStd("def").matches(view), length == 7);
+        EXPECT_EQ(RegexPcre("def").matches(view), length == 7);
+        EXPECT_TRUE(RegexStd("^abc").matches(view));
+        EXPECT_TRUE(RegexPcre("^abc").matches(view));
+    }
+    EXPECT_FALSE(RegexPcre("x", xl::OPTIMIZE).matches("abc"));
+    EXPECT_TRUE(RegexPcre("", xl::OPTIMIZE).matches(""));
+}
+
+
+TEST(RegexPcre, Jit) {
+    RegexPcre interpreted("^(\\w+)\\.(\\w+)$", xl::OPTIMIZE);
+    RegexPcre jit("^(\\w+)\\.(\\w+)$", xl::JIT);
+    EXPECT_FALSE(interpreted.is_jit_compiled());
+    EXPECT_EQ(jit.is_jit_compiled(), RegexPcre::is_jit_available());
+
+    for (auto text : {"part1.part2", "part1part2", "part1.part2."}) {
+        auto expected = interpreted.match(text);
+        auto result = jit.match(text);
+        EXPECT_EQ((bool)result, (bool)expected);
+        EXPECT_EQ(result[1], expected[1]);
+        EXPECT_EQ(result[2], expected[2]);
+        EXPECT_EQ(jit.matches(text), interpreted.matches(text));
+    }
+
+    // copies share the study data, which is freed once, after the last one is gone
+    std::optional<RegexPcre> original(std::in_place, "b+", xl::JIT);
+    auto copy = *original;
+    original.reset();
+    EXPECT_EQ(copy.match("abbbc")[0], "bbb");
+
+    // each thread gets its own JIT stack
+    std::thread([&]{
+        EXPECT_EQ(copy.match("abbc")[0], "bb");
+    }).join();
+
+    EXPECT_TRUE(RegexStd("b+", xl::JIT).matches("abc"));
+}
+
+
+TEST(RegexPcre, MatchErrorsThrow) {
+    // nested repeats which can't match try every way of splitting the a's until PCRE's match limit stops them -
+    //   that's an error, not an answer, so it isn't reported as no match
+    std::string text(40, 'a');
+    text += 'b';
+    for (auto flags : {xl::NONE, xl::JIT}) {
+        RegexPcre regex("^(a+)+$", flags);
+        RegexMatchDataPcre match_data;
+        EXPECT_THROW(regex.match(text), RegexException);
+        EXPECT_THROW(regex.match(text, match_data), RegexException);
+        EXPECT_THROW(regex.matches(text), RegexException);
+        EXPECT_FALSE(regex.matches("aab"));
+    }
+}
+
+
+TEST(RegexPcre, MatchWithMatchData) {
+    RegexPcre regex("(?<first>[^:]*):(?<second>[^:]*)(x)?");
+    RegexMatchDataPcre match_data;
+
+    // the string doesn't need to be null terminated and the results are views into it
+    std::string text = "part1:part2:part3";
+    std::string_view view(text.data(), 11);
+    auto & result = regex.match(view, match_data);
+    EXPECT_EQ(&result, &match_data);
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result.size(), 3ul);
+    EXPECT_EQ(result[0], "part1:part2");
+    EXPECT_EQ(result[1].data(), text.data());
+    EXPECT_EQ(result["second"], "part2");
+    EXPECT_TRUE(result.has("first"));
+    EXPECT_FALSE(result.has(3));
+    EXPECT_EQ(result[3], "");
+    EXPECT_EQ(result.prefix(), "");
+    EXPECT_EQ(result.suffix(), "");
+
+    // each match replaces the results of the last one
+    EXPECT_TRUE(regex.match("a:b:c", match_data));
+    EXPECT_EQ(match_data[2], "b");
+    EXPECT_EQ(match_data.suffix(), ":c");
+
+    EXPECT_FALSE(regex.match("no colon", match_data));
+    EXPECT_EQ(match_data[0], "");
+    EXPECT_EQ(match_data["first"], "");
+    EXPECT_EQ(match_data.suffix(), "no colon");
+
+    // a regex with more captures than the last one grows the space for them
+    EXPECT_EQ(RegexPcre("(a)(b)(c)(d)", xl::JIT).match("abcd", match_data)[4], "d");
+}
+
+#endif
@@ -141,6 +141,22 @@ TEST(json, array) {
 }
 
 
+TEST(json, LargeDocument) {
+    // the size of a status file for a log with many subjects - deep enough into the recursive regex to run out
+    //   of the JIT stack, which has to be reported as anything but "no match"
+    std::string document = "{\"subjects\": [\n";
+    for (int i = 0; i < 1000; i++) {
+        document += "{\"name\": \"subject" + std::to_string(i) + "\", \"status\": true},\n";
+    }
+    document += "]}";
+
+    auto subjects = Json(document)["subjects"].get_array();
+    ASSERT_TRUE(subjects.has_value());
+    EXPECT_EQ(subjects->size(), 1000u);
+    EXPECT_EQ((*subjects)[999]["name"].get_string(), "subject999");
+}
+
+
 TEST(json, WalkingNonexistantElements) {
     EXPECT_FALSE(Json()["Foo"]);
     EXPECT_FALSE(Json()[100]);
@@ -1,10 +1,21 @@
 
+#include <algorithm>
 #include <sstream>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <csignal>
+
+#include <fcntl.h>
+#include <sys/wait.h>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
 #include "log.h"
+#include "log/log_binary_sink.h"
+#include "log/log_file_sink.h"
 #include "templates.h"
 
 using namespace xl;
@@ -398,7 +409,7 @@ TEST(log, LogStatusFileFromFileAllStatusesSetToFalseIndividually) {
     for (auto subject : TestLogT::subjects()) {
         other_log.set_status(subject, false);
     }
-    other_log.log_status_file->write();
+    other_log.write_status_file();
     
 
     log.enable_status_file(status_file_filename, StatusFile::USE_FILE_CONTENTS); // do not force status reset - load what was just written
@@ -435,7 +446,7 @@ TEST(log, LogStatusFileFromFileSomeStatusesTrueSomeFalse) {
     for (auto subject : TestLogT::subjects()) {
         other_log.set_status(subject, subject == TestLogT::Subjects::CustomSubject3);
     }
-    other_log.log_status_file->write();
+    other_log.write_status_file();
 
 
     log.enable_status_file(status_file_filename, StatusFile::USE_FILE_CONTENTS); // do not force status reset - load what was just written
@@ -454,6 +465,218 @@ TEST(log, LogStatusFileFromFileSomeStatusesTrueSomeFalse) {
 }
 
 
+TEST(log, LogStatusFileBatchedWrites) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    auto status_file_filename = "LogStatusFileBatchedWrites";
+    log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS);
+
+    auto warn_status_in_file = [&] {
+        ::xl::log::LogStatusFile other(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+        return other.level_vector().at(1).second;
+    };
+
+    {
+        auto batch = log.batch_status_file_writes();
+        {
+            auto nested = log.batch_status_file_writes();
+            log.set_status(LogT::Levels::Warn, false);
+        }
+
+        // the change is live, but the file isn't written until the outermost batch ends
+        EXPECT_FALSE(log.get_status(LogT::Levels::Warn));
+        EXPECT_TRUE(warn_status_in_file());
+        log.set_all_subjects(false);
+    }
+    EXPECT_FALSE(warn_status_in_file());
+    ::xl::log::LogStatusFile other(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    EXPECT_FALSE(other.subject_vector().at(0).second);
+
+    // written through a temporary file which is renamed over the status file
+    for (auto const & entry : std::filesystem::directory_iterator(".")) {
+        EXPECT_EQ(entry.path().filename().string().find(std::string(status_file_filename) + ".tmp"), std::string::npos);
+    }
+
+    // threads in the same process writing at once each use their own temporary file, so every rename leaves a
+    //   whole file behind
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([status_file_filename] {
+            ::xl::log::LogStatusFile writer(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+            for (int j = 0; j < 50; j++) {
+                writer.write();
+            }
+        });
+    }
+    for (auto & thread : threads) {
+        thread.join();
+    }
+    EXPECT_NO_THROW(::xl::log::LogStatusFile(status_file_filename, StatusFile::USE_FILE_CONTENTS));
+    for (auto const & entry : std::filesystem::directory_iterator(".")) {
+        EXPECT_EQ(entry.path().filename().string().find(std::string(status_file_filename) + ".tmp"), std::string::npos);
+    }
+}
+
+
+TEST(log, ControlBlock) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto control_block_filename = "LogControlBlock.control";
+    LogT log;
+    std::vector<std::string> messages;
+    log.add_callback([&messages](LogT::LogMessage const & message) {
+        messages.push_back(message.string.c_str());
+    });
+    log.enable_control_block(control_block_filename, StatusFile::RESET_FILE_CONTENTS);
+    EXPECT_TRUE(log.is_control_block_enabled());
+
+    // another process would open it the same way
+    LogControlBlock controller(control_block_filename);
+    EXPECT_THAT(controller.get_level_names(), ::testing::ElementsAre("info", "warn", "error"));
+    EXPECT_THAT(controller.get_subject_names(), ::testing::ElementsAre("default"));
+    EXPECT_TRUE(controller.get_status(1));
+
+    auto generation = controller.get_generation();
+    controller.set_status(1, false);
+    EXPECT_GT(controller.get_generation(), generation);
+
+    // logging wakes a background thread to pick up the change
+    log.info("shown");
+    for (int i = 0; i < 500 && log.get_status(LogT::Levels::Warn); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(log.get_status(LogT::Levels::Warn));
+    log.warn("hidden");
+
+    controller.set_filters({"keep"}, {"drop"});
+    log.refresh_control_block();
+    log.info("keep this");
+    log.info("skip this");
+    log.info("keep but drop this");
+    controller.set_filters({"(unclosed"}, {});
+    log.refresh_control_block();
+    log.info("keep after invalid filter");
+
+    // the log's own changes are written to the block
+    log.set_status(LogT::Levels::Warn, true);
+    log.set_status(LogT::Subjects::Default, false);
+    EXPECT_TRUE(controller.get_status(1));
+    EXPECT_FALSE(controller.get_status(LogT::level_count));
+    std::vector<std::string> include_patterns, exclude_patterns;
+    EXPECT_TRUE(controller.get_filters(include_patterns, exclude_patterns));
+    EXPECT_THAT(include_patterns, ::testing::ElementsAre("keep"));
+    EXPECT_THAT(exclude_patterns, ::testing::ElementsAre("drop"));
+
+    EXPECT_THAT(messages, ::testing::ElementsAre("shown", "keep this", "keep after invalid filter"));
+
+    // a log made for the same levels and subjects takes over what's in the block
+    LogT restarted;
+    restarted.enable_control_block(control_block_filename);
+    EXPECT_FALSE(restarted.get_status(LogT::Subjects::Default));
+    EXPECT_TRUE(restarted.get_status(LogT::Levels::Warn));
+
+    log.disable_control_block();
+    EXPECT_FALSE(log.is_control_block_enabled());
+    EXPECT_THROW(LogControlBlock("LogControlBlock.missing"), LogControlBlockException);
+}
+
+
+TEST(log, ControlBlockMessageCount) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto control_block_filename = "LogControlBlockMessageCount";
+    auto status_file_filename = "LogControlBlockMessageCount.log_status";
+    std::filesystem::remove(control_block_filename);
+
+    LogT log;
+    log.add_callback([](LogT::LogMessage const &) {});
+    log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS);
+    log.enable_control_block(control_block_filename);
+
+    // the status file says where the block is, so a dashboard can find it
+    LogStatusFile status_file(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    EXPECT_EQ(status_file.control_block, control_block_filename);
+
+    LogControlBlock controller(status_file.control_block);
+    EXPECT_EQ(controller.get_message_count(), 0);
+    log.info("one");
+    log.info("two");
+    log.set_status(LogT::Levels::Info, false);
+    log.info("not counted");
+    EXPECT_EQ(controller.get_message_count(), 2);
+
+    // messages queued to be formatted on the consumer thread are counted too
+    log.set_status(LogT::Levels::Info, true);
+    log.enable_async(16, AsyncOverflowPolicy::BLOCK, AsyncFormatting::DEFERRED);
+    log.info("{}", "three");
+    log.flush();
+    EXPECT_EQ(controller.get_message_count(), 3);
+    log.disable_async();
+
+    log.disable_control_block();
+    status_file.read();
+    EXPECT_TRUE(status_file.control_block.empty());
+    log.disable_status_file();
+}
+
+
+TEST(log, ControlBlockAbandonedFilterWrite) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto control_block_filename = "LogControlBlockAbandonedFilterWrite";
+    LogT log;
+    std::vector<std::string> messages;
+    log.add_callback([&messages](LogT::LogMessage const & message) {
+        messages.push_back(message.string.c_str());
+    });
+    log.enable_control_block(control_block_filename, StatusFile::RESET_FILE_CONTENTS);
+    LogControlBlock controller(control_block_filename);
+    controller.set_filters({"keep"}, {});
+    log.refresh_control_block();
+    log.info("keep this");
+    log.info("skip this");
+
+    // a controller dies partway through writing the patterns, leaving the sequence odd
+    auto child = ::fork();
+    ASSERT_NE(child, -1);
+    if (child == 0) {
+        LogControlBlock dying(control_block_filename);
+        dying.begin_filter_write(true);
+        ::_exit(0);
+    }
+    int child_status;
+    ASSERT_EQ(::waitpid(child, &child_status, 0), child);
+
+    // reading gives up instead of waiting for it forever
+    std::vector<std::string> include_patterns, exclude_patterns;
+    EXPECT_FALSE(controller.get_filters(include_patterns, exclude_patterns));
+    EXPECT_TRUE(include_patterns.empty());
+
+    // the log keeps the filter it had, and puts it back in the block since its writer is gone
+    controller.set_status(1, false);
+    log.refresh_control_block();
+    log.info("skip this too");
+    log.info("keep this too");
+    EXPECT_FALSE(log.get_status(LogT::Levels::Warn));
+    EXPECT_TRUE(controller.get_filters(include_patterns, exclude_patterns));
+    EXPECT_THAT(include_patterns, ::testing::ElementsAre("keep"));
+
+    // a stuck write is taken over by the next controller too
+    child = ::fork();
+    ASSERT_NE(child, -1);
+    if (child == 0) {
+        LogControlBlock dying(control_block_filename);
+        dying.begin_filter_write(true);
+        ::_exit(0);
+    }
+    ASSERT_EQ(::waitpid(child, &child_status, 0), child);
+    controller.set_filters({"again"}, {});
+    log.refresh_control_block();
+    log.info("keep this once more");
+    log.info("again");
+
+    EXPECT_THAT(messages, ::testing::ElementsAre("keep this", "keep this too", "again"));
+    log.disable_control_block();
+}
+
+
 TEST(log, templates) {
 //    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
 //    LogT log;
@@ -510,3 +733,1419 @@ TEST(log, xl_string_views) {
 
     logger(xl::make_string(xl::string_view("test xl stringview")));
 }
+
+
+
+TEST(log, AsyncDispatch) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::vector<std::string> messages;
+    std::thread::id callback_thread_id;
+    log.add_callback([&](LogT::LogMessage const & message) {
+        messages.push_back(message.string);
+        callback_thread_id = std::this_thread::get_id();
+    });
+    log.enable_async(16);
+    EXPECT_TRUE(log.is_async());
+
+    for (int i = 0; i < 100; i++) {
+        log.info(std::to_string(i));
+    }
+    log.flush();
+
+    ASSERT_EQ(messages.size(), 100);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(messages[i], std::to_string(i));
+    }
+    EXPECT_NE(callback_thread_id, std::this_thread::get_id());
+    EXPECT_EQ(log.get_dropped_count(), 0);
+
+    log.disable_async();
+    log.info("sync");
+    EXPECT_EQ(messages.back(), "sync");
+    EXPECT_EQ(callback_thread_id, std::this_thread::get_id());
+}
+
+
+TEST(log, AsyncDispatchOverflow) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+
+    for (auto policy : {AsyncOverflowPolicy::DROP_NEWEST, AsyncOverflowPolicy::DROP_OLDEST}) {
+        LogT log;
+        std::atomic<bool> callback_entered = false;
+        std::atomic<bool> release_callback = false;
+        std::vector<std::string> messages;
+        log.add_callback([&](LogT::LogMessage const & message) {
+            callback_entered = true;
+            while (!release_callback) {
+                std::this_thread::yield();
+            }
+            messages.push_back(message.string);
+        });
+        log.enable_async(4, policy);
+
+        // hold the consumer thread inside the callback so the queue fills up behind it
+        log.info("first");
+        while (!callback_entered) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < 7; i++) {
+            log.info(std::to_string(i));
+        }
+        EXPECT_EQ(log.get_dropped_count(), 3);
+
+        release_callback = true;
+        log.flush();
+
+        std::vector<std::string> expected = policy == AsyncOverflowPolicy::DROP_NEWEST ?
+                                            std::vector<std::string>{"first", "0", "1", "2", "3"} :
+                                            std::vector<std::string>{"first", "3", "4", "5", "6"};
+        EXPECT_EQ(messages, expected);
+    }
+}
+
+
+TEST(log, AsyncDispatchCallbackLogsToFullQueue) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::atomic<bool> callback_logged = false;
+    std::vector<std::string> messages;
+    log.add_callback([&](LogT::LogMessage const & message) {
+        messages.push_back(message.string);
+        if (message.string == "first") {
+            // only the consumer thread can free a slot, so this can't wait for one
+            for (int i = 0; i < 8; i++) {
+                log.info("from callback " + std::to_string(i));
+            }
+            callback_logged = true;
+        }
+    });
+    log.enable_async(4, AsyncOverflowPolicy::BLOCK);
+
+    log.info("first");
+    while (!callback_logged) {
+        std::this_thread::yield();
+    }
+    log.flush();
+    EXPECT_EQ(log.get_dropped_count(), 4);
+    EXPECT_THAT(messages, ::testing::ElementsAre("first", "from callback 0", "from callback 1", "from callback 2",
+                                                 "from callback 3"));
+}
+
+
+TEST(log, ThreadSafety) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::atomic<int> call_count = 0;
+    log.add_callback([&call_count](LogT::LogMessage const &) {
+        call_count++;
+    });
+
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> logging_threads;
+    for (int i = 0; i < 4; i++) {
+        logging_threads.emplace_back([&log, &stop] {
+            while (!stop) {
+                log.info("from logging thread");
+                log.warn("from logging thread");
+            }
+        });
+    }
+
+    while (call_count == 0) {
+        std::this_thread::yield();
+    }
+
+    // change settings while the other threads are logging
+    for (int i = 0; i < 50; i++) {
+        log.set_status(LogT::Levels::Warn, i % 2 == 0);
+        auto & callback = log.add_callback([](LogT::LogMessage const & message) {
+            EXPECT_EQ(message.string, "from logging thread");
+        });
+        log.set_regex_filter(i % 2 == 0 ? "logging" : "");
+        log.remove_callback(callback);
+    }
+
+    stop = true;
+    for (auto & thread : logging_threads) {
+        thread.join();
+    }
+
+    // once remove_callback returns, the callback is never called again
+    log.clear_callbacks();
+    call_count = 0;
+    log.info("no callbacks");
+    EXPECT_EQ(call_count, 0);
+}
+
+
+TEST(log, CompileTimeMinimumLevel) {
+    using LevelsT = LevelsWithMinimum<DefaultLevels, DefaultLevels::Levels::Warn>;
+    using LogT = xl::log::Log<LevelsT, xl::log::DefaultSubjects>;
+    static_assert(!LogT::is_compiled(LogT::Levels::Info));
+    static_assert(LogT::is_compiled(LogT::Levels::Warn));
+    static_assert(xl::log::Log<>::is_compiled(xl::log::Log<>::Levels::Info));
+
+    std::vector<std::string> messages;
+    LogT log([&messages](LogT::LogMessage const & message) {
+        messages.push_back(message.string);
+    });
+    EXPECT_EQ(log.get_name(LogT::Levels::Info), "info");
+
+    log.info("info");
+    log.log(LogT::Levels::Info, LogT::Subjects::Default, "info");
+    log.warn("warn");
+    log.error("error");
+    EXPECT_EQ(messages, (std::vector<std::string>{"warn", "error"}));
+
+    int evaluation_count = 0;
+    auto count_evaluation = [&evaluation_count] {
+        evaluation_count++;
+        return std::string("evaluated");
+    };
+    XL_LOG(log, LogT::Levels::Info, LogT::Subjects::Default, count_evaluation());
+    EXPECT_EQ(evaluation_count, 0);
+
+    // runtime-disabled levels don't evaluate their arguments either
+    log.set_status(LogT::Levels::Warn, false);
+    XL_LOG(log, LogT::Levels::Warn, LogT::Subjects::Default, count_evaluation());
+    EXPECT_EQ(evaluation_count, 0);
+
+    XL_LOG(log, LogT::Levels::Error, LogT::Subjects::Default, count_evaluation());
+    EXPECT_EQ(evaluation_count, 1);
+    EXPECT_EQ(messages.back(), "evaluated");
+}
+
+
+TEST(log, LogStatusFileChangesPickedUpInBackground) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    auto status_file_filename = "LogStatusFileChangesPickedUpInBackground";
+    log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS, std::chrono::milliseconds(10));
+    EXPECT_TRUE(log.get_status(LogT::Levels::Warn));
+
+    // another process changing the status file
+    ::xl::log::LogStatusFile other(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    for (auto & [name, status] : other.level_vector()) {
+        status = name != "warn";
+    }
+    other.write();
+
+    // nothing needs to be logged for the change to be seen
+    for (int i = 0; i < 500 && log.get_status(LogT::Levels::Warn); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(log.get_status(LogT::Levels::Warn));
+    EXPECT_TRUE(log.get_status(LogT::Levels::Info));
+
+    log.disable_status_file();
+    EXPECT_FALSE(log.is_status_file_enabled());
+}
+
+
+#ifdef __linux__
+TEST(log, LogStatusFileChangesSeenWithoutPolling) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    auto status_file_filename = "LogStatusFileChangesSeenWithoutPolling";
+
+    // long enough that the change can only be seen by being told about it
+    log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS, std::chrono::hours(1));
+
+    // another process changing the status file
+    ::xl::log::LogStatusFile other(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    for (auto & [name, status] : other.subject_vector()) {
+        status = false;
+    }
+    other.write();
+
+    for (int i = 0; i < 500 && log.get_status(LogT::Subjects::Default); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(log.get_status(LogT::Subjects::Default));
+
+    // files next to it being written aren't mistaken for it
+    xl::log::LogFileChangeNotifier notifier(status_file_filename);
+    ASSERT_TRUE(notifier.is_available());
+    std::ofstream(std::string(status_file_filename) + ".other") << "not the status file";
+    EXPECT_FALSE(notifier.read_events());
+    other.write();
+    EXPECT_TRUE(notifier.read_events());
+    EXPECT_FALSE(notifier.read_events());
+
+    // watching the whole directory names each file once
+    auto directory_notifier = xl::log::LogFileChangeNotifier::for_directory(".");
+    other.write();
+    other.write();
+    std::ofstream(std::string(status_file_filename) + ".other") << "also changed";
+    auto names = directory_notifier->read_changed_names();
+    EXPECT_EQ(std::count(names.begin(), names.end(), status_file_filename), 1);
+    EXPECT_EQ(std::count(names.begin(), names.end(), std::string(status_file_filename) + ".other"), 1);
+
+    log.disable_status_file();
+}
+#endif
+
+
+TEST(log, InvalidStatusFileKeepsSettings) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    auto status_file_filename = "InvalidStatusFileKeepsSettings";
+    std::atomic<int> message_count{0};
+    log.add_callback([&](LogT::LogMessage const &) {
+        message_count++;
+    });
+
+    std::mutex mutex;
+    std::vector<std::string> errors;
+    log.set_status_file_error_callback([&](std::string const & error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        errors.push_back(error);
+    });
+    log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS, std::chrono::milliseconds(10));
+    log.set_status(LogT::Levels::Warn, false);
+
+    auto wait_for_errors = [&](size_t count) {
+        for (int i = 0; i < 500; i++) {
+            log.info("logging while the file is bad");
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (errors.size() >= count) {
+                    return;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    };
+
+    // another process writing files the log can't use - each is reported once, on the watcher thread
+    std::ofstream(status_file_filename) << R"({"levels": [{"name": "info"}]})";
+    wait_for_errors(1u);
+    std::ofstream(status_file_filename) << R"({"include": ["(unclosed"]})";
+    wait_for_errors(2u);
+    std::ofstream(status_file_filename) << "not json";
+    wait_for_errors(3u);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(errors.size(), 3u);
+    }
+    EXPECT_TRUE(log.get_status(LogT::Levels::Info));
+    EXPECT_FALSE(log.get_status(LogT::Levels::Warn));
+    EXPECT_GE(message_count.load(), 3);
+
+    // a good file after a bad one is picked up
+    ::xl::log::LogStatusFile other(status_file_filename, StatusFile::RESET_FILE_CONTENTS);
+    other.levels = false;
+    other.write();
+    for (int i = 0; i < 500 && log.get_status(LogT::Levels::Info); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(log.get_status(LogT::Levels::Info));
+
+    log.disable_status_file();
+}
+
+
+#ifdef XL_USE_LIB_FMT
+TEST(log, AsyncDeferredFormatting) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::vector<std::string> messages;
+    log.add_callback([&messages](LogT::LogMessage const & message) {
+        messages.push_back(message.string);
+    });
+    log.enable_async(16, AsyncOverflowPolicy::BLOCK, AsyncFormatting::DEFERRED);
+
+    // arguments are copied, so changing them after the call doesn't change the message
+    char buffer[] = "before";
+    std::string string = "string";
+    log.info("{} {} {}", buffer, string, 5);
+    buffer[0] = 'X';
+    string = "changed";
+
+    log.info("no arguments");
+    log.warn("{:d}", "not a number");
+    log.flush();
+
+    ASSERT_EQ(messages.size(), 3);
+    EXPECT_EQ(messages[0], "before string 5");
+    EXPECT_EQ(messages[1], "no arguments");
+    EXPECT_THAT(messages[2], ::testing::HasSubstr("Error formatting log message"));
+
+    // the filter has to see the formatted message
+    log.set_regex_filter("match");
+    log.info("{}", "should match");
+    log.info("{}", "should not");
+    log.flush();
+    EXPECT_EQ(messages.size(), 4);
+    EXPECT_EQ(messages.back(), "should match");
+}
+#endif
+
+
+TEST(log, BinarySinkRoundTrip) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, CustomSubjects>;
+    auto base_filename = "BinarySinkRoundTrip";
+    for (size_t i = 0; std::filesystem::exists(base_filename + std::string(".") + std::to_string(i)); i++) {
+        std::filesystem::remove(base_filename + std::string(".") + std::to_string(i));
+    }
+
+    std::string text;
+    {
+        LogT log;
+        std::stringstream stream;
+        LogBinarySink<LogT> sink(base_filename);
+
+        // same format as the ostream callback, but for the same message object the sink sees
+        log.add_callback([&](LogT::LogMessage const & message) {
+            stream << "[" << message.get_time_string() << "] " << log.get_name(message.subject) << " " << message.string << "\n";
+            sink(message);
+        });
+
+        log.info(CustomSubjects::Subjects::CustomSubject1, "first message");
+        log.error(CustomSubjects::Subjects::CustomSubject3, "second message");
+        log.warn(CustomSubjects::Subjects::CustomSubject2, "");
+        text = stream.str();
+        log.clear_callbacks();
+    }
+
+    LogBinaryReader reader(base_filename + std::string(".0"));
+    EXPECT_EQ(reader.level_names, (std::vector<std::string>{"info", "warn", "error"}));
+    EXPECT_EQ(reader.subject_names.size(), 3u);
+
+    auto record = reader.next();
+    ASSERT_TRUE(record);
+    EXPECT_EQ(reader.level_names[record->level], "info");
+    EXPECT_EQ(record->string, "first message");
+
+    // decoded text is the same as what the ostream callback wrote
+    std::string decoded = reader.to_text(*record) + "\n";
+    while (auto record = reader.next()) {
+        decoded += reader.to_text(*record) + "\n";
+    }
+    EXPECT_EQ(decoded, text);
+}
+
+
+TEST(log, BinaryReaderSeekInMemory) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto base_filename = std::string("BinaryReaderSeekInMemory");
+    std::filesystem::remove(base_filename + ".0");
+
+    LogT log;
+    LogBinarySink<LogT> sink(base_filename, 4096);
+    log.add_callback([&](LogT::LogMessage const & message) {
+        sink(message);
+    });
+    log.info("first");
+    log.info("second");
+
+    // read the file while the sink still has it open, so it's zero filled past the records
+    std::ifstream file(base_filename + ".0", std::ios::binary);
+    std::string contents(std::istreambuf_iterator<char>(file), {});
+    EXPECT_EQ(contents.size(), 4096);
+
+    LogBinaryReader reader(contents.data(), contents.size());
+    std::vector<size_t> offsets;
+    do {
+        offsets.push_back(reader.get_offset());
+    } while (reader.skip());
+    EXPECT_EQ(offsets.size(), 3);
+
+    // no complete record at the end, so skipping leaves the offset alone
+    EXPECT_FALSE(reader.skip());
+    EXPECT_EQ(reader.get_offset(), offsets.back());
+
+    reader.seek(offsets[1]);
+    auto record = reader.next();
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->string, "second");
+    reader.seek(offsets[0]);
+    EXPECT_EQ(reader.next()->string, "first");
+
+    // a record whose end hasn't been written yet isn't skipped
+    LogBinaryReader partial_reader(contents.data(), offsets[1] + 5);
+    partial_reader.seek(offsets[1]);
+    EXPECT_FALSE(partial_reader.skip());
+    log.clear_callbacks();
+}
+
+
+TEST(log, BinarySinkRotation) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto base_filename = std::string("BinarySinkRotation");
+    for (size_t i = 0; i < 100; i++) {
+        std::filesystem::remove(base_filename + "." + std::to_string(i));
+    }
+
+    // left over from earlier runs, including files rotation wouldn't get to
+    for (auto number : {2, 7, 8}) {
+        std::ofstream(base_filename + "." + std::to_string(number)) << "old";
+    }
+
+    {
+        LogT log;
+        LogBinarySink<LogT> sink(base_filename, 1024, 3);
+        EXPECT_EQ(sink.get_current_filename(), base_filename + ".9");
+        EXPECT_FALSE(std::filesystem::exists(base_filename + ".2"));
+        EXPECT_TRUE(std::filesystem::exists(base_filename + ".7"));
+        log.add_callback(std::ref(sink));
+        for (int i = 0; i < 200; i++) {
+            log.info(std::to_string(i));
+        }
+        // longer than a whole file
+        log.info(std::string(2000, 'x'));
+        log.clear_callbacks();
+    }
+
+    // only the newest 3 files are kept
+    size_t file_count = 0;
+    for (size_t i = 0; i < 100; i++) {
+        file_count += std::filesystem::exists(base_filename + "." + std::to_string(i));
+    }
+    EXPECT_EQ(file_count, 3u);
+
+    // messages continue in order from one file to the next
+    std::vector<std::string> messages;
+    for (size_t i = 0; i < 100; i++) {
+        auto filename = base_filename + "." + std::to_string(i);
+        if (std::filesystem::exists(filename)) {
+            LogBinaryReader reader(filename);
+            while (auto record = reader.next()) {
+                messages.emplace_back(record->string);
+            }
+        }
+    }
+    ASSERT_GE(messages.size(), 2u);
+    EXPECT_EQ(messages[messages.size() - 2], "199");
+    EXPECT_EQ(messages.back(), std::string(messages.back().size(), 'x'));
+    EXPECT_GT(messages.back().size(), 900u);
+    EXPECT_LT(messages.back().size(), 1024u);
+    for (size_t i = 1; i < messages.size() - 1; i++) {
+        EXPECT_EQ(std::stoi(messages[i]), std::stoi(messages[i - 1]) + 1);
+    }
+}
+
+
+TEST(log, MessageSharedByCallbacks) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::vector<LogT::LogMessage const *> messages;
+    std::vector<decltype(LogT::LogMessage::time)> times;
+    for (int i = 0; i < 3; i++) {
+        log.add_callback([&](LogT::LogMessage const & message) {
+            messages.push_back(&message);
+            times.push_back(message.time);
+        });
+    }
+
+    std::string string = "message";
+    log.info(string);
+
+    // one message object with one timestamp, viewing the caller's string instead of copying it
+    ASSERT_EQ(messages.size(), 3);
+    EXPECT_EQ(messages[0], messages[1]);
+    EXPECT_EQ(messages[0], messages[2]);
+    EXPECT_EQ(times[0], times[1]);
+    EXPECT_EQ(times[0], times[2]);
+}
+
+
+TEST(log, TimestampFormatter) {
+    using namespace std::chrono;
+
+    // 2001-02-03 04:05:06.123456789 UTC
+    auto time = time_point<system_clock, nanoseconds>(seconds(981173106) + nanoseconds(123456789));
+
+    EXPECT_EQ(LogTimestampFormatter().format(time), "04:05:06");
+    EXPECT_EQ(LogTimestampFormatter(TimestampFormat::TIME_OF_DAY, TimestampPrecision::MILLISECONDS).format(time), "04:05:06.123");
+    EXPECT_EQ(LogTimestampFormatter(TimestampFormat::TIME_OF_DAY, TimestampPrecision::MICROSECONDS).format(time), "04:05:06.123456");
+    EXPECT_EQ(LogTimestampFormatter(TimestampFormat::TIME_OF_DAY, TimestampPrecision::NANOSECONDS).format(time), "04:05:06.123456789");
+    EXPECT_EQ(LogTimestampFormatter(TimestampFormat::ISO_8601).format(time), "2001-02-03T04:05:06Z");
+    EXPECT_EQ(LogTimestampFormatter(TimestampFormat::ISO_8601, TimestampPrecision::MILLISECONDS).format(time), "2001-02-03T04:05:06.123Z");
+
+    // writes into the caller's buffer, truncating if it's too small
+    LogTimestampFormatter formatter(TimestampFormat::ISO_8601, TimestampPrecision::NANOSECONDS);
+    char buffer[LogTimestampFormatter::max_length];
+    EXPECT_EQ(std::string(buffer, formatter.format(time, buffer, sizeof(buffer))), "2001-02-03T04:05:06.123456789Z");
+    EXPECT_EQ(std::string(buffer, formatter.format(time, buffer, 4)), "2001");
+
+    // same output as date::format, including when the cached second changes
+    LogTimestampFormatter same_as_date(TimestampFormat::TIME_OF_DAY, TimestampPrecision::MICROSECONDS);
+    auto now = time_point_cast<microseconds>(system_clock::now());
+    for (int i = 0; i < 100; i++) {
+        auto later = now + microseconds(i * 123457);
+        EXPECT_EQ(same_as_date.format(later), date::format("%H:%M:%S", later));
+    }
+
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT::LogMessage message(LogT::Levels::Info, LogT::Subjects::Default, "");
+    EXPECT_EQ(message.get_time_string(), date::format("%H:%M:%S", message.time));
+}
+
+
+TEST(log, RateLimitAndSampling) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::vector<std::string> messages;
+    log.add_callback([&messages](LogT::LogMessage const & message) {
+        messages.push_back(message.string);
+    });
+
+    // summaries only come from messages let through and flush() here
+    log.set_rate_limit_summary_interval(std::chrono::milliseconds(0));
+
+    // slow enough that no tokens are added back during the test
+    log.set_rate_limit(LogT::Levels::Info, LogT::Subjects::Default, LogRateLimit{0.001, 3});
+    for (int i = 0; i < 10; i++) {
+        log.info(std::to_string(i));
+    }
+    log.warn("other levels aren't limited");
+    EXPECT_EQ(messages, (std::vector<std::string>{"0", "1", "2", "other levels aren't limited"}));
+    EXPECT_EQ(log.get_suppressed_count(LogT::Levels::Info, LogT::Subjects::Default), 7);
+
+    log.flush();
+    EXPECT_EQ(messages.back(), "7 messages suppressed by rate limit");
+
+    messages.clear();
+    log.set_rate_limit(LogT::Levels::Warn, LogT::Subjects::Default, LogRateLimit{0, 1, 4});
+    for (int i = 0; i < 8; i++) {
+        log.warn(std::to_string(i));
+    }
+    EXPECT_EQ(messages, (std::vector<std::string>{"0", "3 messages suppressed by rate limit", "4"}));
+
+    // removing the limit lets everything through again
+    log.set_rate_limit(LogT::Levels::Warn, LogT::Subjects::Default, LogRateLimit{});
+    messages.clear();
+    log.warn("a");
+    log.warn("b");
+    EXPECT_EQ(messages, (std::vector<std::string>{"a", "b"}));
+
+    // the 3 suppressed after the last message let through
+    log.flush();
+    EXPECT_EQ(messages.back(), "3 messages suppressed by rate limit");
+}
+
+
+TEST(log, RateLimitSummaryTimer) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::mutex mutex;
+    std::vector<std::string> messages;
+    log.add_callback([&](LogT::LogMessage const & message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        messages.push_back(message.string);
+    });
+    log.set_rate_limit_summary_interval(std::chrono::milliseconds(10));
+    log.set_rate_limit(LogT::Levels::Info, LogT::Subjects::Default, LogRateLimit{0.001, 1});
+    for (int i = 0; i < 5; i++) {
+        log.info(std::to_string(i));
+    }
+
+    // nothing else is logged, so the summary comes from the timer
+    auto summary_sent = [&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return messages.size() == 2u;
+    };
+    for (int i = 0; i < 500 && !summary_sent(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(messages, (std::vector<std::string>{"0", "4 messages suppressed by rate limit"}));
+    }
+
+    // the summary callback runs on the timer thread, so changing the interval there replaces the timer it's on
+    std::atomic<int> summaries = 0;
+    LogT changes_interval;
+    changes_interval.add_callback([&](LogT::LogMessage const & message) {
+        if (message.string.find("suppressed") != std::string::npos) {
+            changes_interval.set_rate_limit_summary_interval(std::chrono::milliseconds(10 + summaries));
+            summaries++;
+        }
+    });
+    changes_interval.set_rate_limit_summary_interval(std::chrono::milliseconds(10));
+    changes_interval.set_rate_limit(LogT::Levels::Info, LogT::Subjects::Default, LogRateLimit{0.001, 1});
+    for (int round = 0; round < 3; round++) {
+        changes_interval.info("first");
+        changes_interval.info("suppressed");
+        for (int i = 0; i < 500 && summaries <= round; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    EXPECT_EQ(summaries, 3);
+}
+
+
+TEST(log, RateLimitInStatusFile) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, CustomSubjects>;
+    auto status_file_filename = "RateLimitInStatusFile";
+    {
+        LogT log;
+        log.set_rate_limit(LogT::Levels::Warn, CustomSubjects::Subjects::CustomSubject2, LogRateLimit{100, 10, 2});
+        log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS);
+    }
+
+    ::xl::log::LogStatusFile other(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    ASSERT_EQ(other.rate_limits.size(), 1);
+    EXPECT_EQ(other.rate_limits[0].level, "warn");
+    EXPECT_EQ(other.rate_limits[0].subject, "CustomSubject2");
+    EXPECT_EQ(other.rate_limits[0].limit, (LogRateLimit{100, 10, 2}));
+
+    // an empty subject applies to all subjects
+    other.rate_limits.push_back({"error", "", LogRateLimit{5, 1, 1}});
+    other.write();
+
+    LogT log(status_file_filename);
+    EXPECT_EQ(log.get_rate_limit(LogT::Levels::Warn, CustomSubjects::Subjects::CustomSubject2), (LogRateLimit{100, 10, 2}));
+    EXPECT_FALSE(log.get_rate_limit(LogT::Levels::Warn, CustomSubjects::Subjects::CustomSubject1).is_limited());
+    for (auto subject : LogT::subjects()) {
+        EXPECT_EQ(log.get_rate_limit(LogT::Levels::Error, subject), (LogRateLimit{5, 1, 1}));
+    }
+}
+
+
+TEST(log, LogStatusFileEscapesNames) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto status_file_filename = "LogStatusFileEscapesNames";
+    auto name = std::string(R"(say "hi" \ there)");
+    {
+        LogT log;
+        log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS);
+        log.set_status(log.add_subject(name), false);
+    }
+
+    LogStatusFile status_file(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    EXPECT_EQ(status_file.subject_vector(), (LogStatusFile::Statuses{{"default", true}, {name, false}}));
+    status_file.rate_limits.push_back({name, name, LogRateLimit{5, 1, 1}});
+    status_file.callbacks.push_back({name, {{name, true}}, {{name, false}}});
+    status_file.write();
+
+    LogStatusFile other(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    EXPECT_EQ(other.subject_vector(), status_file.subject_vector());
+    ASSERT_EQ(other.rate_limits.size(), 1u);
+    EXPECT_EQ(other.rate_limits[0].level, name);
+    EXPECT_EQ(other.rate_limits[0].subject, name);
+    ASSERT_EQ(other.callbacks.size(), 1u);
+    EXPECT_EQ(other.callbacks[0].levels, (LogStatusFile::Statuses{{name, true}}));
+    EXPECT_EQ(other.callbacks[0].subjects, (LogStatusFile::Statuses{{name, false}}));
+}
+
+
+TEST(log, IncludeAndExcludeFilters) {
+    LogFilter filter({"^net", "disk"}, {"debug", "trace"});
+    EXPECT_TRUE(filter("net up"));
+    EXPECT_TRUE(filter("slow disk"));
+    EXPECT_FALSE(filter("cpu busy"));
+    EXPECT_FALSE(filter("a net"));
+    EXPECT_FALSE(filter("net debug"));
+    EXPECT_FALSE(filter("disk trace"));
+
+    // no include patterns means everything not excluded passes
+    EXPECT_TRUE(LogFilter({}, {"debug"})("anything"));
+    EXPECT_TRUE(LogFilter({}, {}).empty());
+
+    // an invalid pattern can't be hidden by joining it with the others
+    EXPECT_THROW(LogFilter({"a", "b)|(c"}), xl::RegexException);
+
+    // group numbers change once patterns are joined, so numbered references only work in a pattern on its own
+    LogFilter repeated({"(\\w)\\1"});
+    EXPECT_TRUE(repeated("look"));
+    EXPECT_FALSE(repeated("lok"));
+    EXPECT_THROW(LogFilter({"(disk)", "(\\w)\\1"}), xl::RegexException);
+    EXPECT_THROW(LogFilter({}, {"(\\w)\\g{1}", "disk"}), xl::RegexException);
+#ifdef XL_USE_PCRE
+    EXPECT_NO_THROW(LogFilter({"(disk)", "[\\1]", "\\Q\\1\\E", "\\0"}));
+    LogFilter named({"(disk)", "(?<letter>\\w)\\k<letter>"});
+    EXPECT_TRUE(named("look"));
+    EXPECT_TRUE(named("disk"));
+    EXPECT_FALSE(named("lok"));
+#endif
+
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto status_file_filename = "IncludeAndExcludeFilters";
+    std::vector<std::string> messages;
+    {
+        LogT log;
+        log.add_callback([&messages](LogT::LogMessage const & message) {
+            messages.push_back(message.string);
+        });
+        log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS);
+        log.set_filters({"^\"quoted\"", "\\d+ bytes"}, {"ignore"});
+        log.info("\"quoted\" message");
+        log.info("read 10 bytes");
+        log.info("read 10 bytes - ignore");
+        log.info("unmatched");
+        EXPECT_EQ(messages, (std::vector<std::string>{"\"quoted\" message", "read 10 bytes"}));
+    }
+
+    // the filters are saved in the status file and picked up from it
+    ::xl::log::LogStatusFile other(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+    EXPECT_EQ(other.include_filters, (std::vector<std::string>{"^\"quoted\"", "\\d+ bytes"}));
+    EXPECT_EQ(other.exclude_filters, (std::vector<std::string>{"ignore"}));
+
+    messages.clear();
+    LogT log(status_file_filename);
+    log.add_callback([&messages](LogT::LogMessage const & message) {
+        messages.push_back(message.string);
+    });
+    log.info("read 5 bytes");
+    log.info("ignore 5 bytes");
+    EXPECT_EQ(messages, (std::vector<std::string>{"read 5 bytes"}));
+}
+
+
+namespace {
+
+struct CountingSink {
+    int count = 0;
+
+    template<class MessageT>
+    void operator()(MessageT const &) {
+        this->count++;
+    }
+};
+
+struct RecordingSink {
+    std::vector<std::string> & messages;
+
+    template<class MessageT>
+    void operator()(MessageT const & message) {
+        this->messages.push_back("sink: " + std::string(message.string));
+    }
+};
+
+}
+
+
+TEST(log, StaticSinks) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects, std::chrono::system_clock,
+        CountingSink, RecordingSink>;
+    std::vector<std::string> messages;
+    LogT log(std::tuple{CountingSink{}, RecordingSink{messages}});
+
+    // sinks alone are enough for messages to be sent
+    EXPECT_TRUE(log.is_live(LogT::Levels::Info, LogT::Subjects::Default));
+    log.info("first");
+
+    // sinks are called before the dynamic callbacks
+    log.add_callback([&messages](LogT::LogMessage const & message) {
+        messages.push_back("callback: " + std::string(message.string));
+    });
+    log.info("second");
+
+    log.set_status(LogT::Levels::Warn, false);
+    log.warn("disabled");
+
+    log.enable_async(16);
+    log.info("async");
+    log.flush();
+
+    EXPECT_EQ(messages, (std::vector<std::string>{"sink: first", "sink: second", "callback: second",
+                                                  "sink: async", "callback: async"}));
+    EXPECT_EQ(log.get_sink<CountingSink>().count, 3);
+    EXPECT_EQ(&log.get_sink<1>().messages, &messages);
+}
+
+
+TEST(log, PerCallbackStatuses) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, CustomSubjects>;
+    auto status_file_filename = "PerCallbackStatuses";
+    std::filesystem::remove(status_file_filename);
+
+    std::vector<std::string> remote_messages;
+    std::vector<std::string> local_messages;
+    {
+        LogT log(status_file_filename);
+        LogT::StatusesT errors_only;
+        errors_only[LogT::get(LogT::Levels::Error)] = true;
+        for (auto subject : LogT::subjects()) {
+            errors_only[LogT::level_count + LogT::get(subject)] = true;
+        }
+        auto & remote = log.add_callback([&](LogT::LogMessage const & message) {
+            remote_messages.push_back(message.string);
+        }, "remote", errors_only);
+        auto & local = log.add_callback([&](LogT::LogMessage const & message) {
+            local_messages.push_back(message.string);
+        });
+
+        log.info(CustomSubjects::Subjects::CustomSubject1, "info");
+        log.error(CustomSubjects::Subjects::CustomSubject1, "error");
+        EXPECT_EQ(remote_messages, (std::vector<std::string>{"error"}));
+        EXPECT_EQ(local_messages, (std::vector<std::string>{"info", "error"}));
+
+        // nothing wants info messages any more, so they're rejected before being built
+        log.set_callback_status(local, LogT::Levels::Info, false);
+        EXPECT_FALSE(log.is_live(LogT::Levels::Info, CustomSubjects::Subjects::CustomSubject1));
+        EXPECT_TRUE(log.is_live(LogT::Levels::Error, CustomSubjects::Subjects::CustomSubject1));
+
+        // the log's own statuses still apply on top of each callback's
+        log.set_status(CustomSubjects::Subjects::CustomSubject2, false);
+        EXPECT_FALSE(log.is_live(LogT::Levels::Error, CustomSubjects::Subjects::CustomSubject2));
+
+        log.set_callback_status(remote, CustomSubjects::Subjects::CustomSubject3, false);
+        log.error(CustomSubjects::Subjects::CustomSubject3, "local only");
+        EXPECT_EQ(remote_messages.back(), "error");
+        EXPECT_EQ(local_messages.back(), "local only");
+
+        LogT::CallbackT unregistered;
+        EXPECT_THROW(log.set_callback_status(unregistered, LogT::Levels::Info, false), LogException);
+    }
+
+    // statuses of named callbacks are restored from the status file when a callback with that name is added
+    LogT log(status_file_filename);
+    struct Counter {
+        int & count;
+        void operator()(LogT::LogMessage const &) {
+            this->count++;
+        }
+    };
+    int count = 0;
+    LogCallbackGuard<Counter, LogT> guard(log, Counter{count});
+    guard.set_name("remote");
+    auto statuses = guard.get_statuses();
+    EXPECT_FALSE(statuses[LogT::get(LogT::Levels::Info)]);
+    EXPECT_TRUE(statuses[LogT::get(LogT::Levels::Error)]);
+    EXPECT_FALSE(statuses[LogT::level_count + LogT::get(CustomSubjects::Subjects::CustomSubject3)]);
+
+    log.info(CustomSubjects::Subjects::CustomSubject1, "info");
+    log.error(CustomSubjects::Subjects::CustomSubject1, "error");
+    EXPECT_EQ(count, 1);
+
+    guard.set_status(LogT::Levels::Info, true);
+    log.info(CustomSubjects::Subjects::CustomSubject1, "info");
+    EXPECT_EQ(count, 2);
+}
+
+
+TEST(log, FileSink) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, CustomSubjects>;
+    auto base_filename = std::string("FileSink");
+    for (size_t i = 0; std::filesystem::exists(base_filename + "." + std::to_string(i)); i++) {
+        std::filesystem::remove(base_filename + "." + std::to_string(i));
+    }
+
+    LogT log;
+    std::mutex expected_mutex;
+    std::stringstream expected;
+    log.add_callback([&](LogT::LogMessage const & message) {
+        std::lock_guard<std::mutex> lock(expected_mutex);
+        expected << "[" << message.get_time_string() << "] " << log.get_name(message.subject) << " " << message.string << "\n";
+    });
+
+    LogFileSinkOptions options;
+    options.buffer_size = 4096;
+    options.buffer_count = 2;
+    options.fsync_policy = FsyncPolicy::BYTES;
+    options.fsync_bytes = 10000;
+    LogFileSink<LogT> sink(base_filename, options);
+    log.add_callback(std::ref(sink));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&log, t] {
+            for (int i = 0; i < 500; i++) {
+                log.info(CustomSubjects::Subjects::CustomSubject2, std::to_string(t) + " " + std::to_string(i));
+            }
+        });
+    }
+    for (auto & thread : threads) {
+        thread.join();
+    }
+    // longer than a whole buffer
+    log.warn(CustomSubjects::Subjects::CustomSubject1, std::string(5000, 'x'));
+    sink.flush();
+    log.clear_callbacks();
+
+    std::ifstream file(sink.get_current_filename());
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    ASSERT_EQ(lines.size(), 2001u);
+
+    // same text as the ostream callback would write, except for the truncated message
+    std::vector<std::string> expected_lines;
+    while (std::getline(expected, line)) {
+        expected_lines.push_back(line);
+    }
+    std::sort(lines.begin(), lines.end() - 1);
+    std::sort(expected_lines.begin(), expected_lines.end() - 1);
+    EXPECT_TRUE(std::equal(lines.begin(), lines.end() - 1, expected_lines.begin()));
+    EXPECT_EQ(lines.back().size(), 4095u);
+    EXPECT_TRUE(expected_lines.back().compare(0, lines.back().size(), lines.back()) == 0);
+
+    // messages are written many at a time
+    EXPECT_EQ(sink.get_write_latency().get_count(), sink.get_batch_count());
+    EXPECT_LT(sink.get_batch_count(), 100u);
+    EXPECT_EQ(sink.get_bytes_written(), std::filesystem::file_size(sink.get_current_filename()));
+    EXPECT_GE(sink.get_fsync_latency().get_count(), 1u);
+    EXPECT_EQ(sink.get_write_error_count(), 0u);
+}
+
+
+TEST(log, FileSinkRotation) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto base_filename = std::string("FileSinkRotation");
+    for (size_t i = 0; i < 100; i++) {
+        std::filesystem::remove(base_filename + "." + std::to_string(i));
+    }
+
+    // left over from earlier runs, including files rotation wouldn't get to
+    for (auto number : {2, 7, 8}) {
+        std::ofstream(base_filename + "." + std::to_string(number)) << "old\n";
+    }
+
+    {
+        LogT log;
+        LogFileSinkOptions options;
+        options.buffer_size = 4096;
+        options.rotate_size = 10000;
+        options.max_files = 3;
+        LogFileSink<LogT> sink(base_filename, options);
+        EXPECT_EQ(sink.get_current_filename(), base_filename + ".9");
+        EXPECT_FALSE(std::filesystem::exists(base_filename + ".2"));
+        EXPECT_TRUE(std::filesystem::exists(base_filename + ".7"));
+        log.add_callback(std::ref(sink));
+        for (int i = 0; i < 2000; i++) {
+            log.info(std::to_string(i));
+            if (i % 100 == 0) {
+                sink.flush();
+            }
+        }
+        log.clear_callbacks();
+    }
+
+    // only the newest 3 files are kept, each no bigger than the rotation size
+    std::vector<std::string> lines;
+    size_t file_count = 0;
+    for (size_t i = 0; i < 100; i++) {
+        auto filename = base_filename + "." + std::to_string(i);
+        if (std::filesystem::exists(filename)) {
+            file_count++;
+            EXPECT_LE(std::filesystem::file_size(filename), 10000u);
+            std::ifstream file(filename);
+            std::string line;
+            while (std::getline(file, line)) {
+                lines.push_back(line.substr(line.rfind(' ') + 1));
+            }
+        }
+    }
+    EXPECT_EQ(file_count, 3u);
+    ASSERT_FALSE(lines.empty());
+    EXPECT_EQ(lines.back(), "1999");
+    for (size_t i = 1; i < lines.size(); i++) {
+        EXPECT_EQ(std::stoi(lines[i]), std::stoi(lines[i - 1]) + 1);
+    }
+}
+
+
+TEST(log, CrashDrain) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto base_filename = std::string("CrashDrain");
+    auto queue_filename = base_filename + ".queue";
+    for (size_t i = 0; std::filesystem::exists(base_filename + "." + std::to_string(i)); i++) {
+        std::filesystem::remove(base_filename + "." + std::to_string(i));
+    }
+
+    EXPECT_EXIT({
+        LogT log;
+
+        // nothing is written by the writer thread before the crash
+        LogFileSinkOptions options;
+        options.flush_interval = std::chrono::hours(1);
+        auto sink = new LogFileSink<LogT>(base_filename, options);
+        log.add_callback(std::ref(*sink));
+        for (int i = 0; i < 10; i++) {
+            log.info("sink " + std::to_string(i));
+        }
+
+        // the consumer thread gets stuck on "block" so everything after it stays queued
+        std::atomic<bool> blocked{false};
+        log.add_callback([&blocked](LogT::LogMessage const & message) {
+            if (message.string == "block") {
+                blocked = true;
+                std::this_thread::sleep_for(std::chrono::hours(1));
+            }
+        });
+        log.enable_async();
+        log.enable_crash_drain(::open(queue_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+        log.info("block");
+        while (!blocked) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < 10; i++) {
+            log.info("queued " + std::to_string(i));
+        }
+        std::raise(SIGSEGV);
+    }, ::testing::KilledBySignal(SIGSEGV), "");
+
+    auto read_messages = [](std::string const & filename) {
+        std::vector<std::string> messages;
+        std::ifstream file(filename);
+        std::string line;
+        while (std::getline(file, line)) {
+            messages.push_back(line.substr(line.find(' ', line.find("] ") + 2) + 1));
+        }
+        return messages;
+    };
+
+    auto sink_messages = read_messages(base_filename + ".0");
+    ASSERT_EQ(sink_messages.size(), 11);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(sink_messages[i], "sink " + std::to_string(i));
+    }
+    EXPECT_EQ(sink_messages[10], "block");
+
+    auto queued_messages = read_messages(queue_filename);
+    ASSERT_EQ(queued_messages.size(), 10);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(queued_messages[i], "queued " + std::to_string(i));
+    }
+}
+
+
+TEST(log, Context) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::vector<std::string> contexts;
+    log.add_callback([&contexts](LogT::LogMessage const & message) {
+        contexts.push_back(message.context == nullptr ? "none" : message.get_context_string() + message.string.c_str());
+    });
+
+    log.info("plain");
+    {
+        LogContextGuard request("request", "abc");
+        {
+            LogContextGuard user("user", 7);
+            log.info("nested");
+
+            // other threads have their own context
+            std::thread([&log] {
+                log.info("other thread");
+            }).join();
+        }
+        log.info("outer");
+
+        // message prefixes are context without a key
+        log.to(LogT::Levels::Warn, LogT::Subjects::Default, "prefix")("prefixed");
+        log.info("after prefix");
+    }
+    log.info("plain again");
+
+    EXPECT_THAT(contexts, ::testing::ElementsAre(
+        "none",
+        "request=abc user=7 nested",
+        "none",
+        "request=abc outer",
+        "request=abc prefix prefixed",
+        "request=abc after prefix",
+        "none"));
+
+    // copied for the consumer thread in async mode
+    std::stringstream output;
+    log.clear_callbacks();
+    log.add_callback(output);
+    log.enable_async();
+    {
+        LogContextGuard request("request", "def");
+        log.info("queued");
+    }
+    log.flush();
+    EXPECT_THAT(output.str(), ::testing::EndsWith("default request=def queued\n"));
+    log.disable_async();
+
+    // binary log files keep the context, and the reader shows it the same way as the ostream callback
+    auto base_filename = std::string("ContextBinary");
+    std::filesystem::remove(base_filename + ".0");
+    {
+        LogBinarySink<LogT> sink(base_filename, 4096);
+        log.add_callback([&sink](LogT::LogMessage const & message) {
+            sink(message);
+        });
+        LogContextGuard request("request", "ghi");
+        log.to(LogT::Levels::Warn, LogT::Subjects::Default, "prefix")("stored");
+        log.clear_callbacks();
+    }
+    LogBinaryReader reader(base_filename + ".0");
+    auto record = reader.next();
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->context, (std::vector<std::pair<std::string_view, std::string_view>>{{"request", "ghi"}, {"", "prefix"}}));
+    EXPECT_THAT(reader.to_text(*record), ::testing::EndsWith("] default request=ghi prefix stored"));
+}
+
+
+#ifdef XL_USE_LIB_FMT
+TEST(log, Fields) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+
+    std::vector<std::string> field_text;
+    log.add_callback([&field_text](LogT::LogMessage const & message) {
+        EXPECT_EQ(message.string, "request done");
+        ASSERT_EQ(message.fields.size(), 5);
+        EXPECT_EQ(message.fields[0].get_key(), "latency_us");
+        EXPECT_EQ(message.fields[0].get_type(), LogFieldType::INT);
+        EXPECT_EQ(message.fields[0].get_int(), 123);
+        EXPECT_EQ(message.fields[1].get_type(), LogFieldType::UINT);
+        EXPECT_EQ(message.fields[2].get_type(), LogFieldType::DOUBLE);
+        EXPECT_EQ(message.fields[3].get_bool(), true);
+        EXPECT_EQ(message.fields[4].get_string(), "a \"quoted\" name");
+        std::string text;
+        message.fields.append_text(text);
+        field_text.push_back(text);
+    });
+    std::stringstream text_output;
+    log.add_callback(text_output);
+    std::stringstream json_output;
+    log.add_json_callback(json_output);
+
+    auto log_fields = [&log] {
+        std::string name = "a \"quoted\" name";
+        log.info("request done", kv("latency_us", 123), kv("shard", 7u), kv("ratio", 0.25), kv("ok", true), kv("name", name));
+    };
+
+    log_fields();
+    {
+        LogContextGuard request("request", "abc");
+        log_fields();
+    }
+    log.enable_async();
+    log_fields();
+    log.flush();
+    log.disable_async();
+
+    auto expected_text = std::string(" latency_us=123 shard=7 ratio=0.25 ok=true name=a \"quoted\" name");
+    EXPECT_THAT(field_text, ::testing::ElementsAre(expected_text, expected_text, expected_text));
+    EXPECT_THAT(text_output.str(), ::testing::EndsWith("] default request done" + expected_text + "\n"));
+
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(json_output, line)) {
+        lines.push_back(line);
+    }
+    ASSERT_EQ(lines.size(), 3);
+    auto expected_fields = std::string(R"("fields":{"latency_us":123,"shard":7,"ratio":0.25,"ok":true,"name":"a \"quoted\" name"}})");
+    EXPECT_THAT(lines[0], ::testing::EndsWith(R"("level":"info","subject":"default","message":"request done",)" + expected_fields));
+    EXPECT_THAT(lines[1], ::testing::EndsWith(R"("message":"request done","context":{"request":"abc"},)" + expected_fields));
+    EXPECT_THAT(lines[2], ::testing::EndsWith(expected_fields));
+
+    auto json = xl::json::Json(lines[1]).as_object();
+    EXPECT_EQ(json["level"].get_string(), "info");
+    auto fields = json["fields"].as_object();
+    EXPECT_EQ(fields["ok"].get_boolean(), true);
+    EXPECT_EQ(fields["name"].get_string(), "a \"quoted\" name");
+    log.clear_callbacks();
+
+    // written and read back as typed values by the binary sink
+    auto base_filename = std::string("Fields");
+    for (size_t i = 0; std::filesystem::exists(base_filename + "." + std::to_string(i)); i++) {
+        std::filesystem::remove(base_filename + "." + std::to_string(i));
+    }
+    {
+        LogBinarySink<LogT> sink(base_filename);
+        log.add_callback(std::ref(sink));
+        log_fields();
+        log.info("no fields");
+        log.clear_callbacks();
+    }
+    LogBinaryReader reader(base_filename + ".0");
+    auto record = reader.next();
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->string, "request done");
+    ASSERT_EQ(record->fields.size(), 5);
+    EXPECT_EQ(record->fields[0].get_int(), 123);
+    EXPECT_EQ(record->fields[1].get_uint(), 7);
+    EXPECT_EQ(record->fields[2].get_double(), 0.25);
+    EXPECT_EQ(record->fields[3].get_bool(), true);
+    EXPECT_EQ(record->fields[4].get_string(), "a \"quoted\" name");
+    EXPECT_THAT(reader.to_text(*record), ::testing::EndsWith("request done" + expected_text));
+    record = reader.next();
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->string, "no fields");
+    EXPECT_TRUE(record->fields.empty());
+}
+#endif
+
+
+TEST(log, LatencyHistogram) {
+    LogLatencyHistogram histogram;
+    EXPECT_EQ(histogram.get_percentile(50).count(), 0);
+
+    for (int i = 1; i <= 1000; i++) {
+        histogram.record(std::chrono::microseconds(i));
+    }
+    EXPECT_EQ(histogram.get_count(), 1000u);
+    EXPECT_EQ(histogram.get_max(), std::chrono::microseconds(1000));
+
+    // within the 12.5% bucket width of the exact answer, never below it
+    auto p50 = histogram.get_percentile(50).count();
+    EXPECT_GE(p50, 500'000);
+    EXPECT_LE(p50, 562'500);
+    auto p99 = histogram.get_percentile(99).count();
+    EXPECT_GE(p99, 990'000);
+    EXPECT_LE(p99, 1'000'000);
+    EXPECT_EQ(histogram.get_percentile(100), std::chrono::microseconds(1000));
+
+    for (uint64_t value : {0ull, 7ull, 8ull, 1000ull, 123456789ull, ~0ull}) {
+        auto index = LogLatencyHistogram::get_bucket_index(value);
+        EXPECT_LT(index, LogLatencyHistogram::bucket_count);
+        EXPECT_LE(LogLatencyHistogram::get_bucket_lower_bound(index), value);
+        EXPECT_GE(LogLatencyHistogram::get_bucket_upper_bound(index), value);
+    }
+
+    LogLatencyHistogram other;
+    other.record(std::chrono::seconds(1));
+    histogram.merge(other);
+    EXPECT_EQ(histogram.get_count(), 1001u);
+    EXPECT_EQ(histogram.get_max(), std::chrono::seconds(1));
+}
+
+
+TEST(log, DynamicSubjects) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    LogT log;
+    std::vector<std::string> messages;
+    log.add_callback([&messages](LogT::LogMessage const & message) {
+        EXPECT_EQ(message.subject, LogT::Subjects::Default);
+        messages.push_back(message.get_subject_name() + ": " + message.string.c_str());
+    });
+
+    auto & plugin = log.add_subject("plugin");
+    auto & other = log.add_subject("other");
+    EXPECT_EQ(&log.add_subject("plugin"), &plugin);
+    EXPECT_EQ(log.find_subject("other"), &other);
+    EXPECT_EQ(log.find_subject("missing"), nullptr);
+    EXPECT_EQ(log.get_dynamic_subject_count(), 2);
+    EXPECT_TRUE(log.get_status(plugin));
+
+    log.info(plugin, "one");
+    log.info("default");
+    EXPECT_TRUE(log.set_status(other, false));
+    EXPECT_FALSE(log.is_live(LogT::Levels::Warn, other));
+    log.warn(other, "hidden");
+    log.error(plugin, "with field", kv("count", 3));
+
+    // the parent's status applies too
+    log.set_status(LogT::Subjects::Default, false);
+    EXPECT_FALSE(log.is_live(LogT::Levels::Info, plugin));
+    log.info(plugin, "parent off");
+    log.set_status(LogT::Subjects::Default, true);
+    log.set_status(other, true);
+    log.info(other, "back on");
+
+    EXPECT_THAT(messages, ::testing::ElementsAre(
+        "plugin: one",
+        "default: default",
+        "plugin: with field",
+        "other: back on"));
+
+    // statuses are spread across several blocks
+    std::vector<LogDynamicSubject const *> many;
+    for (size_t i = 0; i < LogSubjectRegistry::subjects_per_block * 2 + 1; i++) {
+        many.push_back(&log.add_subject("many." + std::to_string(i)));
+    }
+    for (size_t i = 0; i < many.size(); i += 3) {
+        log.set_status(*many[i], false);
+    }
+    for (size_t i = 0; i < many.size(); i++) {
+        EXPECT_EQ(log.get_status(*many[i]), i % 3 != 0);
+    }
+
+    // threads adding the same names get the same subjects
+    std::vector<std::thread> threads;
+    std::vector<std::vector<LogDynamicSubject const *>> added(4);
+    for (auto & thread_subjects : added) {
+        threads.emplace_back([&log, &thread_subjects] {
+            for (int i = 0; i < 100; i++) {
+                thread_subjects.push_back(&log.add_subject("shared." + std::to_string(i)));
+            }
+        });
+    }
+    for (auto & thread : threads) {
+        thread.join();
+    }
+    for (auto & thread_subjects : added) {
+        EXPECT_EQ(thread_subjects, added[0]);
+    }
+
+    // names survive the trip to the consumer thread
+    std::stringstream output;
+    log.clear_callbacks();
+    log.add_callback(output);
+    log.enable_async();
+    log.info(plugin, "queued");
+    log.flush();
+    EXPECT_THAT(output.str(), ::testing::EndsWith("plugin queued\n"));
+}
+
+
+TEST(log, DynamicSubjectsSaved) {
+    using LogT = xl::log::Log<xl::log::DefaultLevels, xl::log::DefaultSubjects>;
+    auto status_file_filename = "DynamicSubjectsSaved.log_status";
+    auto control_block_filename = "DynamicSubjectsSaved.control";
+    auto base_filename = std::string("DynamicSubjectsSaved");
+    std::filesystem::remove(status_file_filename);
+    std::filesystem::remove(control_block_filename);
+    std::filesystem::remove(base_filename + ".0");
+
+    {
+        LogT log;
+        log.enable_status_file(status_file_filename, StatusFile::RESET_FILE_CONTENTS);
+        log.enable_control_block(control_block_filename, StatusFile::RESET_FILE_CONTENTS);
+        auto & plugin = log.add_subject("plugin");
+        auto & other = log.add_subject("other");
+        log.set_status(other, false);
+
+        // saved after the subjects in the enum
+        LogStatusFile status_file(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+        EXPECT_EQ(status_file.subject_vector(), (LogStatusFile::Statuses{{"default", true}, {"plugin", true}, {"other", false}}));
+
+        LogControlBlock controller(control_block_filename);
+        EXPECT_THAT(controller.get_dynamic_subject_names(), ::testing::ElementsAre("plugin", "other"));
+        EXPECT_FALSE(controller.get_status(controller.get_dynamic_subject_status_index(1)));
+
+        // changed by another process through the control block
+        controller.set_status(controller.get_dynamic_subject_status_index(0), false);
+        log.refresh_control_block();
+        EXPECT_FALSE(log.get_status(plugin));
+        controller.set_status(controller.get_dynamic_subject_status_index(0), true);
+
+        // the parent subject is written along with the runtime subject's name
+        LogBinarySink<LogT> sink(base_filename, 4096);
+        log.add_callback([&](LogT::LogMessage const & message) {
+            sink(message);
+        });
+        log.info(plugin, "from the plugin", kv("count", 3));
+        log.info("from the enum");
+        log.clear_callbacks();
+    }
+
+    LogBinaryReader reader(base_filename + ".0");
+    auto record = reader.next();
+    ASSERT_TRUE(record);
+    EXPECT_EQ(reader.subject_names[record->subject], "default");
+    EXPECT_EQ(record->dynamic_subject, "plugin");
+    EXPECT_THAT(reader.to_text(*record), ::testing::EndsWith("] plugin from the plugin count=3"));
+    record = reader.next();
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->dynamic_subject, "");
+    EXPECT_EQ(reader.get_subject_name(*record), "default");
+
+    // a later run gets the statuses back as it adds the subjects, and keeps those it hasn't added yet
+    {
+        LogT log;
+        log.enable_status_file(status_file_filename);
+        EXPECT_FALSE(log.get_status(log.add_subject("other")));
+        LogStatusFile status_file(status_file_filename, StatusFile::USE_FILE_CONTENTS);
+        EXPECT_EQ(status_file.subject_vector(), (LogStatusFile::Statuses{{"default", true}, {"other", false}, {"plugin", true}}));
+    }
+    {
+        LogT log;
+        log.enable_control_block(control_block_filename);
+        EXPECT_TRUE(log.get_status(log.add_subject("plugin")));
+        EXPECT_FALSE(log.get_status(log.add_subject("other")));
+    }
+}